@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+
+#include "analysis_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <system_error>
+
+static constexpr char index_magic[8]{ 'R', 'I', 'F', 'E', 'A', 'N', 'A', '\0' };
+
+uint64_t AnalysisIndex::hash(const void* data, const size_t size, uint64_t h) noexcept
+{
+    const unsigned char* p{ static_cast<const unsigned char*>(data) };
+
+    for (size_t i{ 0 }; i < size; ++i)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+
+    return h;
+}
+
+bool AnalysisIndex::open(const std::filesystem::path& path, const Source& source)
+{
+    const int count{ (std::max)(source.num_frames - 1, 0) };
+    const size_t size{ sizeof(Header) + sizeof(Entry) * count };
+
+    Header header{};
+    std::memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.version = current_version;
+    header.entry_size = sizeof(Entry);
+    header.source = source;
+
+    file = MappedFile::open_writable(path);
+
+    if (!file.is_open() || file.size() != size || std::memcmp(file.data(), &header, sizeof(Header)))
+    {
+        file = MappedFile{};
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+
+        file = MappedFile::open_writable(path, size);
+        if (!file.is_open())
+            return false;
+
+        std::memcpy(file.writable_data(), &header, sizeof(Header));
+    }
+
+    entries = reinterpret_cast<Entry*>(file.writable_data() + sizeof(Header));
+    num_entries = count;
+
+    return true;
+}
+
+AnalysisIndex::Entry* AnalysisIndex::entry(const int n) const noexcept
+{
+    return (n >= 0 && n < num_entries) ? entries + n : nullptr;
+}
+
+std::optional<float> AnalysisIndex::get(const int n, const uint64_t pair_hash, const uint32_t flag, float Entry::* value) const noexcept
+{
+    Entry* e{ entry(n) };
+    if (!e || !(std::atomic_ref<uint32_t>(e->flags).load(std::memory_order_acquire) & flag) || e->pair_hash != pair_hash)
+        return std::nullopt;
+
+    return e->*value;
+}
+
+void AnalysisIndex::set(const int n, const uint64_t pair_hash, const uint32_t flag, float Entry::* value, const float v) noexcept
+{
+    if (Entry* e{ entry(n) })
+    {
+        // the other metric was computed from other frames
+        if (e->pair_hash != pair_hash)
+        {
+            std::atomic_ref<uint32_t>(e->flags).store(0, std::memory_order_release);
+            e->pair_hash = pair_hash;
+        }
+
+        e->*value = v;
+        std::atomic_ref<uint32_t>(e->flags).fetch_or(flag, std::memory_order_release);
+    }
+}
+
+std::optional<float> AnalysisIndex::sad(const int n, const uint64_t pair_hash) const noexcept
+{
+    return get(n, pair_hash, has_sad, &Entry::sad);
+}
+
+std::optional<float> AnalysisIndex::psnr(const int n, const uint64_t pair_hash) const noexcept
+{
+    return get(n, pair_hash, has_psnr, &Entry::psnr);
+}
+
+void AnalysisIndex::set_sad(const int n, const uint64_t pair_hash, const float sad) noexcept
+{
+    set(n, pair_hash, has_sad, &Entry::sad, sad);
+}
+
+void AnalysisIndex::set_psnr(const int n, const uint64_t pair_hash, const float psnr) noexcept
+{
+    set(n, pair_hash, has_psnr, &Entry::psnr, psnr);
+}
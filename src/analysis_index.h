@@ -0,0 +1,71 @@
+#pragma once
+
+// scene change and static frame metrics of every pair of a clip, kept in a memory mapped file (analysis_file) so that they are
+// computed once for all the renders of the same source, the thresholds are applied when they are looked up.
+// Every entry also keeps the hash of the frames of its pair, an entry of other frames (a source edited without changing
+// the frames hashed by Source) is a miss and is overwritten.
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+#include "mapped_file.h"
+
+class AnalysisIndex
+{
+public:
+    static constexpr uint32_t current_version{ 2 };
+
+    // what the metrics were computed from, a file made for another source or version is made again
+    struct Source
+    {
+        uint64_t hash;
+        int32_t num_frames;
+        int32_t width;
+        int32_t height;
+        int32_t pixel_type;
+    };
+
+    // FNV-1a
+    static uint64_t hash(const void* data, const size_t size, uint64_t h = 0xcbf29ce484222325ull) noexcept;
+
+    // false if the file cannot be created or mapped
+    bool open(const std::filesystem::path& path, const Source& source);
+
+    // metrics of the pair (n, n + 1) with the frames hash pair_hash, nullopt when they were not computed yet
+    std::optional<float> sad(const int n, const uint64_t pair_hash) const noexcept;
+    std::optional<float> psnr(const int n, const uint64_t pair_hash) const noexcept;
+
+    // the entries are written in place, a render that is stopped keeps the pairs that were done
+    void set_sad(const int n, const uint64_t pair_hash, const float sad) noexcept;
+    void set_psnr(const int n, const uint64_t pair_hash, const float psnr) noexcept;
+
+private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_size;
+        Source source;
+    };
+
+    struct Entry
+    {
+        uint64_t pair_hash;
+        float sad;
+        float psnr;
+        uint32_t flags; // has_sad | has_psnr, set after the value
+    };
+
+    static constexpr uint32_t has_sad{ 1 };
+    static constexpr uint32_t has_psnr{ 2 };
+
+    Entry* entry(const int n) const noexcept;
+    std::optional<float> get(const int n, const uint64_t pair_hash, const uint32_t flag, float Entry::* value) const noexcept;
+    void set(const int n, const uint64_t pair_hash, const uint32_t flag, float Entry::* value, const float v) noexcept;
+
+    MappedFile file;
+    Entry* entries{};
+    int num_entries{};
+};
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+
+#include "autotune.h"
+
+#include <fstream>
+#include <sstream>
+
+LocalSizeProfile::LocalSizeProfile(std::filesystem::path path) : path(std::move(path))
+{
+    std::ifstream ifs{ this->path };
+    std::string line;
+
+    while (std::getline(ifs, line))
+    {
+        std::istringstream iss{ line };
+        std::string key;
+        LocalSize local_size;
+
+        if (iss >> key >> local_size.x >> local_size.y >> local_size.z && local_size.x > 0 && local_size.y > 0 && local_size.z > 0)
+            entries[key] = local_size;
+    }
+}
+
+std::optional<LocalSize> LocalSizeProfile::find(const std::string& key) const
+{
+    if (const auto it{ entries.find(key) }; it != entries.end())
+        return it->second;
+
+    return std::nullopt;
+}
+
+void LocalSizeProfile::set(const std::string& key, const LocalSize& local_size)
+{
+    entries[key] = local_size;
+}
+
+bool LocalSizeProfile::save() const
+{
+    // another process can read the file at the same time
+    std::filesystem::path tmp{ path };
+    tmp += ".tmp";
+
+    {
+        std::ofstream ofs{ tmp, std::ios::trunc };
+        if (!ofs)
+            return false;
+
+        for (const auto& [key, local_size] : entries)
+            ofs << key << ' ' << local_size.x << ' ' << local_size.y << ' ' << local_size.z << '\n';
+
+        if (!ofs)
+            return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+
+    return !ec;
+}
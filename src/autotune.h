@@ -0,0 +1,47 @@
+#pragma once
+
+// local sizes of the custom compute shaders found by RIFE::autotune, stored per device, settings and clip size
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+struct LocalSize
+{
+    int x;
+    int y;
+    int z;
+
+    auto operator<=>(const LocalSize&) const = default;
+};
+
+// the first one is the default of the 3 channel shaders
+inline constexpr std::array<LocalSize, 9> local_size_candidates{ {
+    { 8, 8, 3 },
+    { 8, 8, 1 },
+    { 16, 8, 1 },
+    { 16, 16, 1 },
+    { 32, 8, 1 },
+    { 32, 4, 1 },
+    { 64, 4, 1 },
+    { 64, 1, 1 },
+    { 16, 4, 3 } } };
+
+// text file, one "key x y z" line per tuned shader
+class LocalSizeProfile
+{
+public:
+    explicit LocalSizeProfile(std::filesystem::path path);
+
+    std::optional<LocalSize> find(const std::string& key) const;
+    void set(const std::string& key, const LocalSize& local_size);
+    // false if the file cannot be written
+    bool save() const;
+
+private:
+    std::filesystem::path path;
+    std::map<std::string, LocalSize> entries;
+};
@@ -0,0 +1,970 @@
+// SPDX-License-Identifier: MIT
+
+// Checks and microbenchmarks of the CPU side kernels, no Vulkan device is used.
+
+#include "kernel_bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// ncnn
+#include "net.h"
+
+#include "../convert.h"
+#include "../frame_cache.h"
+#include "../kernels.h"
+#include "../remote.h"
+#include "../rife_ops.h"
+
+namespace
+{
+    struct Plane
+    {
+        std::vector<uint8_t> data;
+        ptrdiff_t stride; // bytes
+    };
+
+    Plane random_plane(std::mt19937& rng, const int w, const int h, const int bytes_per_comp, const int bit_depth)
+    {
+        Plane p;
+        p.stride = (static_cast<ptrdiff_t>(w) * bytes_per_comp + 63) & ~static_cast<ptrdiff_t>(63);
+        p.data.resize(p.stride * h);
+
+        std::uniform_int_distribution<uint32_t> int_dist(0, (bit_depth == 32) ? 0 : (1u << bit_depth) - 1);
+        std::uniform_real_distribution<float> float_dist(0.0f, 1.0f);
+
+        for (int y{ 0 }; y < h; ++y)
+        {
+            uint8_t* row{ p.data.data() + y * p.stride };
+
+            for (int x{ 0 }; x < w; ++x)
+            {
+                switch (bytes_per_comp)
+                {
+                    case 1: row[x] = static_cast<uint8_t>(int_dist(rng)); break;
+                    case 2: reinterpret_cast<uint16_t*>(row)[x] = static_cast<uint16_t>(int_dist(rng)); break;
+                    default: reinterpret_cast<float*>(row)[x] = float_dist(rng); break;
+                }
+            }
+        }
+
+        return p;
+    }
+
+    bool close(const double a, const double b, const double tolerance) noexcept
+    {
+        return std::abs(a - b) <= tolerance * (std::max)(1.0, std::abs(b));
+    }
+
+    // bilinear sample with the clamping of the Warp shaders
+    double warp_sample(const float* plane, const int w, const int h, const double sample_x, const double sample_y) noexcept
+    {
+        const int x0{ std::clamp(static_cast<int>(std::floor(sample_x)), 0, w - 1) };
+        const int y0{ std::clamp(static_cast<int>(std::floor(sample_y)), 0, h - 1) };
+        const int x1{ std::clamp(static_cast<int>(std::floor(sample_x)) + 1, 0, w - 1) };
+        const int y1{ std::clamp(static_cast<int>(std::floor(sample_y)) + 1, 0, h - 1) };
+        const double alpha{ sample_x - x0 };
+        const double beta{ sample_y - y0 };
+
+        const double v4{ plane[y0 * w + x0] * (1.0 - alpha) + plane[y0 * w + x1] * alpha };
+        const double v5{ plane[y1 * w + x0] * (1.0 - alpha) + plane[y1 * w + x1] * alpha };
+
+        return v4 * (1.0 - beta) + v5 * beta;
+    }
+
+    struct Linear
+    {
+        int s0;
+        int s1;
+        double f;
+    };
+
+    // coefficients of the bilinear Interp without align_corner
+    Linear linear_coeff(const int d, const int out_size, const int in_size) noexcept
+    {
+        double f{ (d + 0.5) * in_size / out_size - 0.5 };
+        int s0{ static_cast<int>(std::floor(f)) };
+        f -= s0;
+
+        if (s0 < 0)
+        {
+            s0 = 0;
+            f = 0.0;
+        }
+        if (s0 >= in_size - 1)
+        {
+            s0 = (std::max)(in_size - 2, 0);
+            f = 1.0;
+        }
+
+        return { s0, (std::min)(s0 + 1, in_size - 1), f };
+    }
+
+    double bilinear(const float* plane, const int w, const Linear& lx, const Linear& ly) noexcept
+    {
+        const double r0{ plane[ly.s0 * w + lx.s0] * (1.0 - lx.f) + plane[ly.s0 * w + lx.s1] * lx.f };
+        const double r1{ plane[ly.s1 * w + lx.s0] * (1.0 - lx.f) + plane[ly.s1 * w + lx.s1] * lx.f };
+
+        return r0 * (1.0 - ly.f) + r1 * ly.f;
+    }
+
+    int report(const std::string& name, const bool ok)
+    {
+        std::cerr << std::format("{}: {}\n", name, ok ? "ok" : "FAILED");
+        return ok ? 0 : 1;
+    }
+
+    int verify_sad(std::mt19937& rng)
+    {
+        const int w{ 333 };
+        const int h{ 97 };
+        const Plane a{ random_plane(rng, w, h, 4, 32) };
+        const Plane b{ random_plane(rng, w, h, 4, 32) };
+
+        long double ref{ 0.0 };
+        for (int y{ 0 }; y < h; ++y)
+        {
+            for (int x{ 0 }; x < w; ++x)
+            {
+                const float va{ reinterpret_cast<const float*>(a.data.data() + y * a.stride)[x] };
+                const float vb{ reinterpret_cast<const float*>(b.data.data() + y * b.stride)[x] };
+                ref += std::abs(static_cast<long double>(vb) - va);
+            }
+        }
+        ref /= static_cast<long double>(w) * h;
+
+        const double sad{ kernels::sad_plane(reinterpret_cast<const float*>(a.data.data()), a.stride / 4,
+            reinterpret_cast<const float*>(b.data.data()), b.stride / 4, w, h) };
+
+        return report("sad_plane", close(sad, static_cast<double>(ref), 1e-9));
+    }
+
+    int verify_block_motion(std::mt19937& rng)
+    {
+        const int w{ 333 };
+        const int h{ 97 };
+        const Plane a{ random_plane(rng, w, h, 2, 10) };
+        Plane b{ a };
+
+        // identical except the 32x32 block at (64, 32), where every sample is raised by 100
+        for (int y{ 32 }; y < 64; ++y)
+        {
+            uint16_t* row{ reinterpret_cast<uint16_t*>(b.data.data() + y * b.stride) };
+            for (int x{ 64 }; x < 96; ++x)
+                row[x] += 100;
+        }
+
+        const double still{ kernels::block_motion(reinterpret_cast<const uint16_t*>(a.data.data()), a.stride / 2,
+            reinterpret_cast<const uint16_t*>(a.data.data()), a.stride / 2, w, h, 1023.0) };
+        const double moving{ kernels::block_motion(reinterpret_cast<const uint16_t*>(a.data.data()), a.stride / 2,
+            reinterpret_cast<const uint16_t*>(b.data.data()), b.stride / 2, w, h, 1023.0) };
+
+        return report("block_motion", still == 0.0 && close(moving, 100.0 / 1023.0, 1e-12));
+    }
+
+    int verify_borders(std::mt19937& rng)
+    {
+        const int w{ 320 };
+        const int h{ 180 };
+        Plane p{ random_plane(rng, w, h, 1, 8) };
+
+        // 40 columns on the left, 24 rows at the top and 16 at the bottom of 16 +-2, no right border
+        for (int y{ 0 }; y < h; ++y)
+        {
+            for (int x{ 0 }; x < w; ++x)
+            {
+                if (x < 40 || y < 24 || y >= h - 16)
+                    p.data[y * p.stride + x] = static_cast<uint8_t>(16 + (x + y) % 3 - 1);
+                else if (x == w - 1)
+                    p.data[y * p.stride + x] = 200;
+            }
+        }
+        p.data[0] = 16;
+
+        const kernels::Borders b{ kernels::detect_borders(p.data.data(), p.stride, w, h, 4.0) };
+
+        // noise of 16..24, every row is within the tolerance of the bottom right corner (20)
+        Plane noisy{ random_plane(rng, w, h, 1, 8) };
+        for (int y{ 0 }; y < h; ++y)
+        {
+            for (int x{ 0 }; x < w; ++x)
+                noisy.data[y * noisy.stride + x] = static_cast<uint8_t>(16 + noisy.data[y * noisy.stride + x] % 9);
+        }
+        noisy.data[0] = 16;
+        noisy.data[(h - 1) * noisy.stride + w - 1] = 20;
+
+        const kernels::Borders flat{ kernels::detect_borders(noisy.data.data(), noisy.stride, w, h, 4.0) };
+
+        return report("detect_borders", b.left == 40 && b.top == 24 && b.right == 0 && b.bottom == 16) +
+            report("detect_borders near flat", flat.top == h);
+    }
+
+    int verify_dirty_rect(std::mt19937& rng)
+    {
+        const int w{ 300 };
+        const int h{ 200 };
+        const Plane a{ random_plane(rng, w, h, 4, 32) };
+        Plane b{ a };
+
+        Plane c{ a };
+
+        // changed samples in the tiles (1, 0) and (1, 1) of the area, the tile (2, 1) is touched below the threshold
+        for (int y{ 70 }; y < 80; ++y)
+        {
+            float* row{ reinterpret_cast<float*>(b.data.data() + y * b.stride) };
+            for (int x{ 130 }; x < 138; ++x)
+                row[x] += 0.8f;
+        }
+        for (int x{ 150 }; x < 160; ++x)
+            reinterpret_cast<float*>(b.data.data() + 100 * b.stride)[x] += 0.5f / 255;
+
+        // one changed sample in the tile (3, 2), far below the threshold as the mean of the tile
+        reinterpret_cast<float*>(c.data.data() + 150 * c.stride)[250] += 0.1f;
+
+        const kernels::Rect area{ 10, 10, 280, 180 };
+        const kernels::Rect still{ kernels::dirty_rect(reinterpret_cast<const float*>(a.data.data()), a.stride / 4,
+            reinterpret_cast<const float*>(a.data.data()), a.stride / 4, area, 64, 1.0 / 255) };
+        const kernels::Rect moving{ kernels::dirty_rect(reinterpret_cast<const float*>(a.data.data()), a.stride / 4,
+            reinterpret_cast<const float*>(b.data.data()), b.stride / 4, area, 64, 1.0 / 255) };
+        const kernels::Rect small{ kernels::dirty_rect(reinterpret_cast<const float*>(a.data.data()), a.stride / 4,
+            reinterpret_cast<const float*>(c.data.data()), c.stride / 4, area, 64, 1.0 / 255) };
+
+        return report("dirty_rect", still.width == 0 && moving.left == 74 && moving.top == 10 && moving.width == 64 &&
+            moving.height == 128) + report("dirty_rect small object", small.left == 202 && small.top == 138 && small.width == 64 &&
+            small.height == 52);
+    }
+
+    int verify_pack(std::mt19937& rng)
+    {
+        int failures{ 0 };
+
+        for (const int bytes : { 1, 2, 4 })
+        {
+            const int w{ 301 };
+            const int h{ 17 };
+            const Plane src{ random_plane(rng, w, h, bytes, bytes == 4 ? 32 : bytes * 8) };
+            std::vector<uint8_t> dst(static_cast<size_t>(w) * bytes * h);
+
+            kernels::pack_plane(dst.data(), src.data.data(), src.stride, static_cast<size_t>(w) * bytes, h);
+
+            bool ok{ true };
+            for (int y{ 0 }; y < h && ok; ++y)
+                ok = !std::memcmp(dst.data() + static_cast<size_t>(y) * w * bytes, src.data.data() + y * src.stride,
+                    static_cast<size_t>(w) * bytes);
+
+            failures += report(std::format("pack_plane {} byte", bytes), ok);
+        }
+
+        return failures;
+    }
+
+    int verify_unscale(std::mt19937& rng)
+    {
+        const int w{ 129 };
+        const int h{ 31 };
+        const ptrdiff_t dst_stride{ 192 };
+        std::uniform_real_distribution<float> dist(0.0f, 255.5f);
+
+        std::vector<float> src(static_cast<size_t>(w) * h * 3);
+        for (auto& v : src)
+            v = dist(rng);
+
+        std::vector<float> dst(dst_stride * h * 3);
+        kernels::unscale_planes(src.data(), src.data() + w * h, src.data() + 2 * w * h, dst.data(), dst.data() + dst_stride * h,
+            dst.data() + 2 * dst_stride * h, w, h, dst_stride);
+
+        bool ok{ true };
+        for (int c{ 0 }; c < 3 && ok; ++c)
+        {
+            for (int y{ 0 }; y < h && ok; ++y)
+            {
+                for (int x{ 0 }; x < w && ok; ++x)
+                    ok = close(dst[c * dst_stride * h + y * dst_stride + x], src[c * w * h + y * w + x] / 255.0, 1e-6);
+            }
+        }
+
+        return report("unscale_planes", ok);
+    }
+
+    // double precision model of rife_preproc -> rife_postproc -> readback
+    void convert_reference(const ConvertFormat& fmt, const double v0, const double v1, const double v2, double out[3])
+    {
+        if (!fmt.is_yuv)
+        {
+            out[0] = v0;
+            out[1] = v1;
+            out[2] = v2;
+        }
+        else
+        {
+            double y{ v0 };
+            double u{ v1 };
+            double v{ v2 };
+
+            if (!fmt.full_range)
+            {
+                y = (y - 16.0 / 255.0) * (255.0 / 219.0);
+                u = (u - 128.0 / 255.0) * (255.0 / 224.0);
+                v = (v - 128.0 / 255.0) * (255.0 / 224.0);
+            }
+            else if (fmt.bytes_per_comp != 4)
+            {
+                u -= 0.5;
+                v -= 0.5;
+            }
+
+            const double k[3][4]{ { 1.402, 0.3441, 0.7141, 1.772 }, { 1.5748, 0.1873, 0.4681, 1.8556 }, { 1.4746, 0.1645, 0.5713, 1.8814 } };
+            const auto& m{ k[fmt.matrix_in] };
+
+            out[0] = y + m[0] * v;
+            out[1] = y - m[1] * u - m[2] * v;
+            out[2] = y + m[3] * u;
+        }
+
+        for (int i{ 0 }; i < 3; ++i)
+            out[i] = (out[i] * 255.0 + 0.5) / 255.0;
+    }
+
+    int verify_convert(std::mt19937& rng)
+    {
+        int failures{ 0 };
+        const int w{ 130 };
+        const int h{ 258 }; // 4 threads of at least 8192 samples
+        ConvertThreads threads{ 4 };
+
+        for (const int bit_depth : { 8, 10, 16, 32 })
+        {
+            for (const int subsampling : { -1, 0, 1, 2 }) // -1 is RGB
+            {
+                for (const bool fp16 : { false, true })
+                {
+                    const int bytes{ (bit_depth == 32) ? 4 : (bit_depth > 8) ? 2 : 1 };
+                    const ConvertFormat fmt{ subsampling >= 0, (std::max)(subsampling, 0), 1, bytes, subsampling < 0 || bit_depth == 32,
+                        bit_depth, fp16 };
+                    const int cw{ (subsampling == 1 || subsampling == 2) ? w / 2 : w };
+                    const int ch{ (subsampling == 1) ? h / 2 : h };
+
+                    const Plane planes[3]{ random_plane(rng, w, h, bytes, bit_depth), random_plane(rng, cw, ch, bytes, bit_depth),
+                        random_plane(rng, cw, ch, bytes, bit_depth) };
+                    const uint8_t* src_p[3]{ planes[0].data.data(), planes[1].data.data(), planes[2].data.data() };
+                    const ptrdiff_t stride[3]{ planes[0].stride, planes[1].stride, planes[2].stride };
+
+                    std::vector<float> dst1(static_cast<size_t>(w) * h * 3);
+                    std::vector<float> dst4(dst1.size());
+                    convert_frame(fmt, src_p, stride, dst1.data(), dst1.data() + w * h, dst1.data() + 2 * w * h, w, w, h, nullptr);
+                    convert_frame(fmt, src_p, stride, dst4.data(), dst4.data() + w * h, dst4.data() + 2 * w * h, w, w, h, &threads);
+
+                    const double norm{ (bytes == 1) ? 255.0 : (bytes == 2) ? static_cast<double>((1 << bit_depth) - 1) : 1.0 };
+                    const auto load{ [&](const int p, const int x, const int y) -> double {
+                        const uint8_t* row{ planes[p].data.data() + y * planes[p].stride };
+                        switch (bytes)
+                        {
+                            case 1: return row[x] / norm;
+                            case 2: return reinterpret_cast<const uint16_t*>(row)[x] / norm;
+                            default: return reinterpret_cast<const float*>(row)[x];
+                        }
+                        } };
+
+                    // fp16 storage keeps 11 significant bits, the values can be somewhat above 1 before clamping
+                    const double tolerance{ fp16 ? 2e-3 : 1e-5 };
+                    bool ok{ dst1 == dst4 };
+
+                    for (int y{ 0 }; y < h && ok; ++y)
+                    {
+                        for (int x{ 0 }; x < w && ok; ++x)
+                        {
+                            const int xc{ (subsampling == 1 || subsampling == 2) ? x / 2 : x };
+                            const int yc{ (subsampling == 1) ? y / 2 : y };
+                            double ref[3];
+                            convert_reference(fmt, load(0, x, y), load(1, xc, yc), load(2, xc, yc), ref);
+
+                            for (int c{ 0 }; c < 3 && ok; ++c)
+                                ok = close(dst1[c * w * h + y * w + x], ref[c], tolerance);
+                        }
+                    }
+
+                    failures += report(std::format("convert_frame {} {}-bit{}", (subsampling < 0) ? "rgb" :
+                        (subsampling == 0) ? "444" : (subsampling == 1) ? "420" : "422", bit_depth, fp16 ? " fp16" : ""), ok);
+                }
+            }
+        }
+
+        return failures;
+    }
+
+#ifndef _WIN32
+    // rife_server protocol, RemoteRIFE against a server that blends the source planes on the CPU (every plane of dst is
+    // src0 * (1 - timestep) + src1 * timestep of the plane with the same index), a negative timestep fails
+    class MockServer
+    {
+    public:
+        explicit MockServer(const std::string& path) : path(path)
+        {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, path.c_str(), (std::min)(path.size(), sizeof(addr.sun_path) - 1));
+
+            ::unlink(path.c_str());
+            listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) || ::listen(listen_fd, 8))
+                return;
+
+            listener = std::thread([this] {
+                while (!stopped)
+                {
+                    pollfd p{ listen_fd, POLLIN };
+                    if (::poll(&p, 1, 50) <= 0)
+                        continue;
+
+                    if (const int fd{ ::accept(listen_fd, nullptr, nullptr) }; fd >= 0)
+                        connections.emplace_back(&MockServer::serve, fd);
+                }
+                });
+        }
+
+        ~MockServer()
+        {
+            stopped = true;
+            if (listener.joinable())
+                listener.join();
+            // the clients are closed, the connections end
+            for (auto& t : connections)
+                t.join();
+
+            if (listen_fd >= 0)
+                ::close(listen_fd);
+            ::unlink(path.c_str());
+        }
+
+    private:
+        static void serve(const int fd)
+        {
+            remote::OpenRequest request{};
+            const int shm_fd{ remote::recv_with_fd(fd, &request, sizeof(request)) };
+            const remote::Layout layout{ remote::layout(request.width, request.height, request.model.bytes_per_comp,
+                request.model.chroma_subsampling) };
+            void* const mapping{ (shm_fd >= 0) ? ::mmap(nullptr, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0) : MAP_FAILED };
+            auto buffer{ static_cast<unsigned char*>(mapping) };
+            if (shm_fd >= 0)
+                ::close(shm_fd);
+
+            const remote::OpenReply reply{ (mapping != MAP_FAILED) ? remote::ok : remote::bad_buffer, 1 };
+            bool open{ remote::send_all(fd, &reply, sizeof(reply)) && reply.status == remote::ok };
+
+            for (remote::Request call{}; open && remote::recv_all(fd, &call, sizeof(call));)
+            {
+                remote::Reply result{ (call.timestep < 0.0f) ? remote::failed : remote::ok };
+
+                if (result.status == remote::ok)
+                {
+                    ptrdiff_t stride[3];
+                    remote::src_strides(call.width, 1, request.model.chroma_subsampling, stride);
+
+                    for (int i{ 0 }; i < 3; ++i)
+                    {
+                        float* dst{ reinterpret_cast<float*>(buffer + layout.dst[i]) };
+                        const int sx{ (i && request.model.chroma_subsampling) ? 1 : 0 };
+                        const int sy{ (i && request.model.chroma_subsampling == 1) ? 1 : 0 };
+
+                        for (int y{ 0 }; y < call.height; ++y)
+                        {
+                            for (int x{ 0 }; x < call.width; ++x)
+                            {
+                                const ptrdiff_t offset{ (y >> sy) * stride[i] + (x >> sx) };
+                                dst[y * call.width + x] = buffer[layout.src0[i] + offset] * (1.0f - call.timestep) +
+                                    buffer[layout.src1[i] + offset] * call.timestep;
+                            }
+                        }
+                    }
+
+                    result.timings.infer = 1.0;
+                }
+
+                open = remote::send_all(fd, &result, sizeof(result));
+            }
+
+            if (mapping != MAP_FAILED)
+                ::munmap(mapping, layout.size);
+            ::close(fd);
+        }
+
+        std::string path;
+        int listen_fd{ -1 };
+        std::atomic<bool> stopped{};
+        std::thread listener;
+        std::vector<std::thread> connections; // joined after the listener
+    };
+
+    int verify_remote()
+    {
+        const std::string path{ std::format("/tmp/rife_verify_{}.sock", ::getpid()) };
+        remote::Model model{};
+        std::strcpy(model.path, "mock");
+        model.is_yuv = 1;
+        model.chroma_subsampling = 1;
+        model.bytes_per_comp = 1;
+        model.bit_depth = 8;
+
+        int failures{ report("remote no server", !RemoteRIFE::connect(path, model, 64, 32, 2)) };
+
+        MockServer server{ path };
+        const auto client{ RemoteRIFE::connect(path, model, 64, 32, 2) };
+        failures += report("remote connect", client != nullptr);
+        if (!client)
+            return failures;
+
+        // 40x20 of the 64x32 buffer, the source planes have their own strides
+        const int w{ 40 };
+        const int h{ 20 };
+        const ptrdiff_t stride[3]{ 100, 60, 60 };
+        std::vector<uint8_t> planes0[3];
+        std::vector<uint8_t> planes1[3];
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            planes0[i].assign(stride[i] * h, static_cast<uint8_t>(10 * (i + 1)));
+            planes1[i].assign(stride[i] * h, static_cast<uint8_t>(30 * (i + 1)));
+        }
+
+        const uint8_t* const src0_p[3]{ planes0[0].data(), planes0[1].data(), planes0[2].data() };
+        const uint8_t* const src1_p[3]{ planes1[0].data(), planes1[1].data(), planes1[2].data() };
+        const ptrdiff_t dst_stride{ 48 };
+
+        // more calls at the same time than connections
+        std::atomic<int> wrong{};
+        std::vector<std::thread> threads;
+        for (int t{ 0 }; t < 4; ++t)
+        {
+            threads.emplace_back([&] {
+                std::vector<float> dst(dst_stride * h * 3);
+                for (int j{ 0 }; j < 20; ++j)
+                {
+                    RIFETimings timings{};
+                    if (client->process(src0_p, src1_p, dst.data(), dst.data() + dst_stride * h, dst.data() + 2 * dst_stride * h, w, h, stride,
+                        stride, dst_stride, 0.25f, nullptr, &timings) || timings.infer != 1.0 || dst[5] != 15.0f ||
+                        dst[dst_stride * h + (h - 1) * dst_stride + w - 1] != 30.0f || dst[2 * dst_stride * h] != 45.0f)
+                        ++wrong;
+                }
+                });
+        }
+        for (auto& t : threads)
+            t.join();
+
+        failures += report("remote process", wrong == 0);
+
+        std::vector<float> dst(dst_stride * h * 3);
+        float* const dst_p[3]{ dst.data(), dst.data() + dst_stride * h, dst.data() + 2 * dst_stride * h };
+        failures += report("remote failed call", client->process_blend(src0_p, src1_p, dst_p[0], dst_p[1], dst_p[2], w, h, stride, stride,
+            dst_stride, -1.0f) != 0);
+        failures += report("remote call larger than the buffer", client->process(src0_p, src1_p, dst_p[0], dst_p[1], dst_p[2], 100, h,
+            stride, stride, dst_stride, 0.5f) != 0);
+
+        return failures;
+    }
+#endif
+
+    int verify_frame_cache()
+    {
+        const std::filesystem::path dir{ std::filesystem::temp_directory_path() /
+            std::format("rife_verify_cache_{}", std::chrono::steady_clock::now().time_since_epoch().count()) };
+        const int w{ 64 };
+        const int h{ 32 };
+        // the record header and the fp16 planes, 64 byte aligned
+        const uint64_t record_size{ (24 + static_cast<uint64_t>(w) * h * 6 + 63) & ~uint64_t{ 63 } };
+
+        std::vector<float> src(w * h * 3);
+        std::vector<float> dst(src.size());
+        const float* const src_p[3]{ src.data(), src.data() + w * h, src.data() + 2 * w * h };
+        float* const dst_p[3]{ dst.data(), dst.data() + w * h, dst.data() + 2 * w * h };
+
+        // frame k has the samples k/16 + i/4, exact in fp16
+        const auto put{ [&](FrameCache& cache, const uint64_t key) {
+            for (size_t i{ 0 }; i < src.size(); ++i)
+                src[i] = static_cast<float>(key % 64) / 16.0f + static_cast<float>(i % 4) / 4.0f;
+            cache.put(key, src_p, w, w, h, 0.5);
+            } };
+        const auto found{ [&](FrameCache& cache, const uint64_t key) {
+            double active_area{};
+            if (!cache.get(key, dst_p, w, w, h, active_area) || active_area != 0.5)
+                return false;
+
+            for (size_t i{ 0 }; i < dst.size(); ++i)
+            {
+                if (dst[i] != static_cast<float>(key % 64) / 16.0f + static_cast<float>(i % 4) / 4.0f)
+                    return false;
+            }
+
+            return true;
+            } };
+        const auto dir_size{ [&](const std::filesystem::path& path) {
+            uint64_t bytes{ 0 };
+            for (const auto& entry : std::filesystem::directory_iterator(path))
+                bytes += entry.file_size();
+
+            return bytes;
+            } };
+        const auto segment_count{ [&](const std::filesystem::path& path) {
+            const std::filesystem::directory_iterator it{ path };
+            return std::distance(std::filesystem::begin(it), std::filesystem::end(it));
+            } };
+
+        int failures{ 0 };
+
+        {
+            const std::filesystem::path path{ dir / "records" };
+            bool ok{ true };
+            {
+                FrameCache cache;
+                ok = cache.open(path, 64 << 20);
+                for (uint64_t key{ 1 }; key <= 10; ++key)
+                    put(cache, key);
+                for (uint64_t key{ 1 }; key <= 10 && ok; ++key)
+                    ok = found(cache, key);
+                ok = ok && !found(cache, 11);
+            }
+            failures += report("frame_cache put/get", ok);
+
+            // the index is rebuilt from the keys of the records
+            {
+                FrameCache cache;
+                ok = cache.open(path, 64 << 20);
+                for (uint64_t key{ 1 }; key <= 10 && ok; ++key)
+                    ok = found(cache, key);
+            }
+            failures += report("frame_cache reopen", ok);
+
+            // a record whose key was not written ends the segment, like a put that was stopped
+            {
+                // the only segment
+                std::fstream file{ std::filesystem::directory_iterator{ path }->path(), std::ios::in | std::ios::out | std::ios::binary };
+                const uint64_t zero{ 0 };
+                file.seekp(static_cast<std::streamoff>(5 * record_size));
+                file.write(reinterpret_cast<const char*>(&zero), sizeof(zero));
+            }
+            {
+                FrameCache cache;
+                ok = cache.open(path, 64 << 20);
+                for (uint64_t key{ 1 }; key <= 10 && ok; ++key)
+                    ok = found(cache, key) == (key <= 5);
+            }
+            failures += report("frame_cache torn record", ok);
+        }
+
+        {
+            // 1 MiB segments, the oldest ones are removed
+            const std::filesystem::path path{ dir / "evict" };
+            const uint64_t max_bytes{ 3 << 20 };
+            FrameCache cache;
+            bool ok{ cache.open(path, max_bytes) };
+            for (uint64_t key{ 1 }; key <= 400; ++key)
+                put(cache, key);
+
+            ok = ok && found(cache, 400) && !found(cache, 1) && dir_size(path) <= max_bytes;
+            failures += report("frame_cache eviction", ok);
+        }
+
+        {
+            // the active segment of another cache is not evicted, it's evicted once that cache is closed
+            const std::filesystem::path path{ dir / "shared" };
+            bool ok{};
+            {
+                FrameCache first;
+                ok = first.open(path, 64 << 20);
+                for (uint64_t key{ 1 }; key <= 10; ++key)
+                    put(first, key);
+
+                FrameCache second;
+                ok = ok && second.open(path, 1) && segment_count(path) == 1;
+
+                put(first, 11);
+                ok = ok && found(first, 1) && found(first, 11);
+            }
+            {
+                FrameCache cache;
+                ok = ok && cache.open(path, 64 << 20) && found(cache, 1) && found(cache, 11);
+            }
+            {
+                FrameCache cache;
+                ok = ok && cache.open(path, 1) && segment_count(path) == 0;
+            }
+            failures += report("frame_cache shared dir", ok);
+        }
+
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+
+        return failures;
+    }
+
+    // best of a few runs, in milliseconds
+    double measure(const std::function<void()>& f)
+    {
+        f();
+
+        double best{ 1e30 };
+        for (int i{ 0 }; i < 5; ++i)
+        {
+            const auto start{ std::chrono::steady_clock::now() };
+            f();
+            best = (std::min)(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        return best;
+    }
+}
+
+int verify_kernels()
+{
+    std::mt19937 rng{ 12345 };
+
+    int failures{ verify_sad(rng) + verify_block_motion(rng) + verify_borders(rng) + verify_dirty_rect(rng) + verify_pack(rng) + verify_unscale(rng) + verify_convert(rng) +
+        verify_frame_cache() };
+#ifndef _WIN32
+    failures += verify_remote();
+#endif
+    std::cerr << std::format("{} failure(s)\n", failures);
+
+    return failures ? 2 : 0;
+}
+
+int verify_warp(const int gpu_id)
+{
+    const ncnn::VulkanDevice* vkdev{ ncnn::get_gpu_device(gpu_id) };
+    std::mt19937 rng{ 12345 };
+    std::uniform_real_distribution<float> value_dist(0.0f, 1.0f);
+    // some samples fall outside of the image
+    std::uniform_real_distribution<float> flow_dist(-20.0f, 20.0f);
+
+    // the inputs are stored as fp16 on the device, the reference uses the same values
+    const auto fp16{ [](const float v) { return ncnn::float16_to_float32(ncnn::float32_to_float16(v)); } };
+
+    constexpr float flow_scale{ 2.0f };
+    int failures{ 0 };
+
+    // 300x260 takes the channel loop path for pack1, 3/8/16 channels are pack1/pack4/pack8,
+    // FusedWarp gets the flow at half size like after Interp
+    for (const bool fused : { false, true })
+    {
+        for (const auto& [w, h] : { std::pair{ 62, 38 }, std::pair{ 300, 260 } })
+        {
+            for (const int c : { 3, 8, 16 })
+            {
+                ncnn::VkAllocator* blob_vkallocator{ vkdev->acquire_blob_allocator() };
+                ncnn::VkAllocator* staging_vkallocator{ vkdev->acquire_staging_allocator() };
+
+                ncnn::Option opt;
+                opt.use_vulkan_compute = true;
+                opt.use_fp16_packed = true;
+                opt.use_fp16_storage = true;
+                opt.use_fp16_arithmetic = false;
+                opt.use_int8_storage = false;
+                opt.use_shader_pack8 = true;
+                opt.blob_vkallocator = blob_vkallocator;
+                opt.workspace_vkallocator = blob_vkallocator;
+                opt.staging_vkallocator = staging_vkallocator;
+
+                std::unique_ptr<ncnn::Layer> layer;
+                if (fused)
+                {
+                    layer = std::make_unique<FusedWarp>();
+
+                    ncnn::ParamDict pd;
+                    pd.set(0, 0);
+                    pd.set(1, flow_scale);
+                    layer->load_param(pd);
+                }
+                else
+                    layer = std::make_unique<Warp>();
+
+                layer->vkdev = vkdev;
+                layer->create_pipeline(opt);
+
+                const int flow_w{ fused ? w / 2 : w };
+                const int flow_h{ fused ? h / 2 : h };
+
+                ncnn::Mat image(w, h, c);
+                ncnn::Mat flow(flow_w, flow_h, 2);
+                for (int q{ 0 }; q < c; ++q)
+                {
+                    float* p{ image.channel(q) };
+                    for (int i{ 0 }; i < w * h; ++i)
+                        p[i] = fp16(value_dist(rng));
+                }
+                for (int q{ 0 }; q < 2; ++q)
+                {
+                    float* p{ flow.channel(q) };
+                    for (int i{ 0 }; i < flow_w * flow_h; ++i)
+                        p[i] = fp16(fused ? flow_dist(rng) / flow_scale : flow_dist(rng));
+                }
+
+                const int elempack{ (c % 8 == 0) ? 8 : (c % 4 == 0) ? 4 : 1 };
+                const std::string name{ std::format("{} {}x{}x{} pack{}", fused ? "FusedWarp" : "Warp", w, h, c, elempack) };
+
+                ncnn::Mat out;
+                {
+                    ncnn::VkCompute cmd(vkdev);
+
+                    ncnn::VkMat image_gpu;
+                    ncnn::VkMat image_gpu_packed;
+                    ncnn::VkMat flow_gpu;
+                    cmd.record_upload(image, image_gpu, opt);
+                    cmd.record_upload(flow, flow_gpu, opt);
+                    vkdev->convert_packing(image_gpu, image_gpu_packed, elempack, cmd, opt);
+
+                    std::vector<ncnn::VkMat> bottom_blobs{ image_gpu_packed, flow_gpu };
+                    std::vector<ncnn::VkMat> top_blobs(1);
+                    if (!layer->forward(bottom_blobs, top_blobs, cmd, opt))
+                    {
+                        ncnn::VkMat top_gpu;
+                        vkdev->convert_packing(top_blobs[0], top_gpu, 1, cmd, opt);
+                        cmd.record_download(top_gpu, out, opt);
+                        cmd.submit_and_wait();
+                    }
+                }
+
+                layer->destroy_pipeline(opt);
+                vkdev->reclaim_blob_allocator(blob_vkallocator);
+                vkdev->reclaim_staging_allocator(staging_vkallocator);
+
+                const float* flow_x{ flow.channel(0) };
+                const float* flow_y{ flow.channel(1) };
+                bool ok{ !out.empty() };
+
+                for (int y{ 0 }; y < h && ok; ++y)
+                {
+                    for (int x{ 0 }; x < w && ok; ++x)
+                    {
+                        double dx;
+                        double dy;
+                        if (fused)
+                        {
+                            const Linear lx{ linear_coeff(x, w, flow_w) };
+                            const Linear ly{ linear_coeff(y, h, flow_h) };
+                            dx = bilinear(flow_x, flow_w, lx, ly) * flow_scale;
+                            dy = bilinear(flow_y, flow_w, lx, ly) * flow_scale;
+                        }
+                        else
+                        {
+                            dx = flow_x[y * w + x];
+                            dy = flow_y[y * w + x];
+                        }
+
+                        for (int q{ 0 }; q < c && ok; ++q)
+                        {
+                            const float* p{ image.channel(q) };
+                            const float* o{ out.channel(q) };
+
+                            // fp16 output, plus fp16 blending on devices that support it
+                            ok = close(o[y * w + x], warp_sample(p, w, h, x + dx, y + dy), 4e-3);
+                        }
+                    }
+                }
+
+                failures += report(name, ok);
+            }
+        }
+    }
+
+    return failures;
+}
+
+std::string bench_kernels(const int cpu_threads)
+{
+    std::mt19937 rng{ 12345 };
+    std::string s{ "{\n  \"kernels\": [\n" };
+    ConvertThreads threads{ cpu_threads };
+    bool first{ true };
+
+    const auto add{ [&](const std::string& name, const int w, const int h, const int bit_depth, const double ms, const double bytes) {
+        s += std::format("{}    {{ \"kernel\": \"{}\", \"width\": {}, \"height\": {}, \"bit_depth\": {}, \"ms\": {:.3f}, \"gbps\": {:.2f} }}",
+            first ? "" : ",\n", name, w, h, bit_depth, ms, bytes / (ms * 1e6));
+        first = false;
+        std::cerr << std::format("{} {}x{} {}-bit: {:.3f} ms\n", name, w, h, bit_depth, ms);
+        } };
+
+    for (const auto [w, h] : { std::pair{ 1280, 720 }, std::pair{ 1920, 1080 }, std::pair{ 3840, 2160 } })
+    {
+        {
+            const Plane a{ random_plane(rng, w, h, 4, 32) };
+            const Plane b{ random_plane(rng, w, h, 4, 32) };
+            volatile double sink{};
+            const double ms{ measure([&] {
+                sink = kernels::sad_plane(reinterpret_cast<const float*>(a.data.data()), a.stride / 4,
+                    reinterpret_cast<const float*>(b.data.data()), b.stride / 4, w, h);
+                }) };
+            add("sad_plane", w, h, 32, ms, 8.0 * w * h);
+        }
+
+        {
+            const Plane a{ random_plane(rng, w, h, 1, 8) };
+            const Plane b{ random_plane(rng, w, h, 1, 8) };
+            volatile double sink{};
+            const double ms{ measure([&] {
+                sink = kernels::block_motion(a.data.data(), a.stride, b.data.data(), b.stride, w, h, 255.0);
+                }) };
+            add("block_motion", w, h, 8, ms, 2.0 * w * h);
+        }
+
+        {
+            std::vector<float> src(static_cast<size_t>(w) * h * 3, 128.0f);
+            const ptrdiff_t dst_stride{ (w + 15) & ~15 };
+            std::vector<float> dst(dst_stride * h * 3);
+            const double ms{ measure([&] {
+                kernels::unscale_planes(src.data(), src.data() + w * h, src.data() + 2 * w * h, dst.data(), dst.data() + dst_stride * h,
+                    dst.data() + 2 * dst_stride * h, w, h, dst_stride);
+                }) };
+            add("unscale_planes", w, h, 32, ms, 24.0 * w * h);
+        }
+
+        for (const int bit_depth : { 8, 10, 16, 32 })
+        {
+            const int bytes{ (bit_depth == 32) ? 4 : (bit_depth > 8) ? 2 : 1 };
+
+            {
+                const Plane src{ random_plane(rng, w, h, bytes, bit_depth) };
+                std::vector<uint8_t> dst(static_cast<size_t>(w) * h * bytes);
+                const double ms{ measure([&] { kernels::pack_plane(dst.data(), src.data.data(), src.stride, static_cast<size_t>(w) * bytes, h); }) };
+                add("pack_plane", w, h, bit_depth, ms, 2.0 * w * h * bytes);
+            }
+
+            {
+                const ConvertFormat fmt{ true, 1, 1, bytes, bit_depth == 32, bit_depth, true };
+                const Plane planes[3]{ random_plane(rng, w, h, bytes, bit_depth), random_plane(rng, w / 2, h / 2, bytes, bit_depth),
+                    random_plane(rng, w / 2, h / 2, bytes, bit_depth) };
+                const uint8_t* src_p[3]{ planes[0].data.data(), planes[1].data.data(), planes[2].data.data() };
+                const ptrdiff_t stride[3]{ planes[0].stride, planes[1].stride, planes[2].stride };
+                std::vector<float> dst(static_cast<size_t>(w) * h * 3);
+
+                const double ms{ measure([&] {
+                    convert_frame(fmt, src_p, stride, dst.data(), dst.data() + w * h, dst.data() + 2 * w * h, w, w, h, &threads);
+                    }) };
+                add("convert_frame yuv420", w, h, bit_depth, ms, (1.5 * bytes + 12.0) * w * h);
+            }
+        }
+    }
+
+    s += "\n  ]\n}\n";
+
+    return s;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+// compares the CPU kernels with double precision references, returns 0 when everything matches
+int verify_kernels();
+
+// compares Warp and FusedWarp (every packing and path) with a double precision reference on the device, returns the number of failures
+int verify_warp(const int gpu_id);
+
+// times the CPU kernels at 720p/1080p/2160p and 8/10/16/32-bit, returns the JSON report
+std::string bench_kernels(const int cpu_threads);
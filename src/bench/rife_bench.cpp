@@ -0,0 +1,840 @@
+// SPDX-License-Identifier: MIT
+
+// Standalone benchmark of the RIFE class, no AviSynth host is needed.
+// Runs on any Vulkan device including software ICDs (lavapipe, SwiftShader).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gpu.h"
+
+#include "kernel_bench.h"
+#include "../convert.h"
+#include "../model_pack.h"
+#include "../rife.h"
+#include "../trace.h"
+
+struct Format
+{
+    bool is_yuv;
+    int chroma_subsampling; // 0=4:4:4, 1=4:2:0, 2=4:2:2
+    int bit_depth;
+
+    int bytes_per_comp() const noexcept
+    {
+        return (bit_depth == 32) ? 4 : (bit_depth > 8) ? 2 : 1;
+    }
+
+    int chroma_w(const int w) const noexcept
+    {
+        return (is_yuv && chroma_subsampling != 0) ? (w + 1) / 2 : w;
+    }
+
+    int chroma_h(const int h) const noexcept
+    {
+        return (is_yuv && chroma_subsampling == 1) ? (h + 1) / 2 : h;
+    }
+};
+
+struct Frame
+{
+    std::vector<uint8_t> planes[3];
+    ptrdiff_t stride[3];
+
+    void pointers(const uint8_t* p[3]) const noexcept
+    {
+        for (int i{ 0 }; i < 3; ++i)
+            p[i] = planes[i].data();
+    }
+};
+
+struct Options
+{
+    std::vector<std::filesystem::path> models;
+    std::optional<std::filesystem::path> y4m;
+    std::string format_name{ "yuv420p8" };
+    int width{ 1920 };
+    int height{ 1080 };
+    int frames{ 50 };
+    int warmup{ 2 };
+    int gpu_id{ -1 };
+    int matrix_in{ 1 };
+    bool full_range{};
+    std::vector<int> tta{ 1 };
+    std::vector<int> uhd{ 0 };
+    std::vector<int> threads{ 1 };
+    std::vector<std::string> modes{ "interp", "copy", "blend" };
+    std::string output;
+    std::string trace_file;
+    std::string autotune_file;
+    bool stages{};
+    bool fusion{ true };
+    int tta_batch{ 8 };
+    bool verify{};
+    bool kernels{};
+};
+
+static void usage()
+{
+    std::cerr <<
+        "usage: rife_bench [options]\n"
+        "  --model <dir>         model dir, or a dir of model dirs (repeatable)\n"
+        "  --y4m <file>          read the frames from a Y4M file instead of generating them\n"
+        "  --format <fmt>        yuv420|yuv422|yuv444|rgb followed by p8|p10|p12|p16|ps (default yuv420p8)\n"
+        "  --size <w>x<h>        size of the synthetic frames (default 1920x1080)\n"
+        "  --frames <n>          measured frames per run (default 50)\n"
+        "  --warmup <n>          frames per thread that are not measured (default 2)\n"
+        "  --gpu <id>            Vulkan device (default: ncnn default device)\n"
+        "  --matrix <0|1|2>      matrix_in of YUV input (default 1)\n"
+        "  --full-range          full range input\n"
+        "  --tta <list>          TTA levels, e.g. 1,2,4,8 (default 1), 0 is the same as 1\n"
+        "  --uhd <list>          e.g. 0,1 (default 0)\n"
+        "  --threads <list>      e.g. 1,2,4 (default 1)\n"
+        "  --mode <list>         interp,copy,blend (default all)\n"
+        "  --output <file>       write the JSON report to a file instead of stdout\n"
+        "  --trace <file>        write a Chrome trace of the run\n"
+        "  --autotune <file>     tune the shader local sizes before the runs, the profile is read from/written to the file\n"
+        "  --no-fusion           load the networks without FusedWarp\n"
+        "  --tta-batch <n>       TTA augmentations whose inputs are alive at the same time, 1-8 (default 8)\n"
+        "  --stages              report the mean time of each stage, the stages are submitted separately\n"
+        "  --verify              check the CPU kernels and the Warp layer against the reference implementations\n"
+        "  --kernels             time the CPU kernels instead of the GPU pipeline (--threads sets the row threads)\n";
+}
+
+static std::vector<std::string> split(const std::string& s)
+{
+    std::vector<std::string> out;
+    size_t start{ 0 };
+
+    while (start <= s.size())
+    {
+        const size_t end{ (std::min)(s.find(',', start), s.size()) };
+        if (end > start)
+            out.emplace_back(s.substr(start, end - start));
+        start = end + 1;
+    }
+
+    return out;
+}
+
+static std::vector<int> split_int(const std::string& s)
+{
+    std::vector<int> out;
+    for (const auto& v : split(s))
+        out.emplace_back(std::stoi(v));
+
+    return out;
+}
+
+static std::optional<Format> parse_format(const std::string& s)
+{
+    Format f{};
+    std::string depth;
+
+    if (s.starts_with("yuv420") || s.starts_with("yuv422") || s.starts_with("yuv444"))
+    {
+        f.is_yuv = true;
+        f.chroma_subsampling = (s[5] == '0') ? 1 : (s[5] == '2') ? 2 : 0;
+        depth = s.substr(6);
+    }
+    else if (s.starts_with("rgb"))
+        depth = s.substr(3);
+    else
+        return std::nullopt;
+
+    if (depth == "p8")
+        f.bit_depth = 8;
+    else if (depth == "p10")
+        f.bit_depth = 10;
+    else if (depth == "p12")
+        f.bit_depth = 12;
+    else if (depth == "p16")
+        f.bit_depth = 16;
+    else if (depth == "ps")
+        f.bit_depth = 32;
+    else
+        return std::nullopt;
+
+    return f;
+}
+
+static Frame alloc_frame(const Format& f, const int w, const int h)
+{
+    Frame frame;
+
+    for (int i{ 0 }; i < 3; ++i)
+    {
+        const int pw{ (i == 0) ? w : f.chroma_w(w) };
+        const int ph{ (i == 0) ? h : f.chroma_h(h) };
+        // 64 byte aligned rows like AviSynth frames
+        frame.stride[i] = (static_cast<ptrdiff_t>(pw) * f.bytes_per_comp() + 63) & ~static_cast<ptrdiff_t>(63);
+        frame.planes[i].assign(frame.stride[i] * ph, 0);
+    }
+
+    return frame;
+}
+
+// moving gradients with some detail, deterministic
+static std::vector<Frame> synthetic_frames(const Format& f, const int w, const int h, const int count)
+{
+    std::vector<Frame> frames;
+    const double max_value{ (f.bit_depth == 32) ? 1.0 : static_cast<double>((1 << f.bit_depth) - 1) };
+
+    for (int n{ 0 }; n < count; ++n)
+    {
+        Frame frame{ alloc_frame(f, w, h) };
+
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            const int pw{ (i == 0) ? w : f.chroma_w(w) };
+            const int ph{ (i == 0) ? h : f.chroma_h(h) };
+
+            for (int y{ 0 }; y < ph; ++y)
+            {
+                uint8_t* row{ frame.planes[i].data() + y * frame.stride[i] };
+
+                for (int x{ 0 }; x < pw; ++x)
+                {
+                    const double fx{ static_cast<double>(x + n * 4) / pw };
+                    const double fy{ static_cast<double>(y + n * 2) / ph };
+                    double v{ 0.5 + 0.25 * std::sin(6.2831853 * (fx * (i + 1) + fy)) + 0.2 * std::sin(0.15 * (x + y + n * 8)) };
+                    if (f.is_yuv && i > 0)
+                        v = 0.5 + (v - 0.5) * 0.5;
+                    v = std::clamp(v, 0.0, 1.0) * max_value;
+
+                    switch (f.bytes_per_comp())
+                    {
+                        case 1: row[x] = static_cast<uint8_t>(v + 0.5); break;
+                        case 2: reinterpret_cast<uint16_t*>(row)[x] = static_cast<uint16_t>(v + 0.5); break;
+                        default: reinterpret_cast<float*>(row)[x] = static_cast<float>(v); break;
+                    }
+                }
+            }
+        }
+
+        frames.emplace_back(std::move(frame));
+    }
+
+    return frames;
+}
+
+static std::vector<Frame> read_y4m(const std::filesystem::path& path, Format& f, int& w, int& h, const int max_frames)
+{
+    std::ifstream ifs{ path, std::ios::binary };
+    if (!ifs)
+        throw std::runtime_error("cannot open " + path.string());
+
+    std::string header;
+    std::getline(ifs, header);
+    if (!header.starts_with("YUV4MPEG2"))
+        throw std::runtime_error("not a Y4M file");
+
+    std::string colorspace{ "420" };
+    size_t pos{ 0 };
+
+    while ((pos = header.find(' ', pos)) != std::string::npos)
+    {
+        ++pos;
+        const size_t end{ (std::min)(header.find(' ', pos), header.size()) };
+        const std::string token{ header.substr(pos, end - pos) };
+
+        if (token.empty())
+            continue;
+        if (token[0] == 'W')
+            w = std::stoi(token.substr(1));
+        else if (token[0] == 'H')
+            h = std::stoi(token.substr(1));
+        else if (token[0] == 'C')
+            colorspace = token.substr(1);
+    }
+
+    f = Format{ true, 1, 8 };
+    if (colorspace.starts_with("422"))
+        f.chroma_subsampling = 2;
+    else if (colorspace.starts_with("444"))
+        f.chroma_subsampling = 0;
+    else if (!colorspace.starts_with("420"))
+        throw std::runtime_error("unsupported Y4M colorspace " + colorspace);
+
+    if (const size_t p{ colorspace.find('p', 3) }; p != std::string::npos && p + 1 < colorspace.size())
+        f.bit_depth = std::stoi(colorspace.substr(p + 1));
+
+    std::vector<Frame> frames;
+
+    while (static_cast<int>(frames.size()) < max_frames)
+    {
+        std::string frame_header;
+        if (!std::getline(ifs, frame_header) || !frame_header.starts_with("FRAME"))
+            break;
+
+        Frame frame{ alloc_frame(f, w, h) };
+
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            const int pw{ (i == 0) ? w : f.chroma_w(w) };
+            const int ph{ (i == 0) ? h : f.chroma_h(h) };
+
+            for (int y{ 0 }; y < ph; ++y)
+                ifs.read(reinterpret_cast<char*>(frame.planes[i].data() + y * frame.stride[i]), static_cast<std::streamsize>(pw) *
+                    f.bytes_per_comp());
+        }
+
+        if (!ifs)
+            break;
+
+        frames.emplace_back(std::move(frame));
+    }
+
+    if (frames.size() < 2)
+        throw std::runtime_error("Y4M file must have at least 2 frames");
+
+    return frames;
+}
+
+// model dirs in the argument order, dirs without flownet.param are searched one level deep
+static std::vector<std::filesystem::path> collect_models(const std::vector<std::filesystem::path>& paths)
+{
+    std::vector<std::filesystem::path> models;
+
+    for (const auto& path : paths)
+    {
+        if (std::filesystem::exists(path / "flownet.param"))
+        {
+            models.emplace_back(path);
+            continue;
+        }
+
+        std::vector<std::filesystem::path> sub;
+        for (const auto& entry : std::filesystem::directory_iterator(path))
+        {
+            if (entry.is_directory() && std::filesystem::exists(entry.path() / "flownet.param"))
+                sub.emplace_back(entry.path());
+        }
+
+        std::sort(sub.begin(), sub.end());
+        models.insert(models.end(), sub.begin(), sub.end());
+    }
+
+    return models;
+}
+
+// same as the models table of the plugin
+static int model_padding(const std::string& name)
+{
+    if (name.find("rife-v4.25-lite") != std::string::npos)
+        return 128;
+    if (name.find("rife-v4.25") != std::string::npos || name.find("rife-v4.26") != std::string::npos)
+        return 64;
+
+    return 32;
+}
+
+struct ModelInfo
+{
+    bool rife_v2;
+    bool rife_v4;
+    int padding;
+};
+
+// from the manifest of a rife_optimize pack, otherwise from the dir name like the plugin
+static ModelInfo model_info(const std::filesystem::path& dir)
+{
+    if (const auto pack{ find_model_pack(dir) })
+        return { pack->generation == "v2", pack->generation == "v4", pack->padding };
+
+    const std::string name{ dir.filename().string() };
+    return { name.find("rife-v2") != std::string::npos || name.find("rife-v3") != std::string::npos,
+        name.find("rife-v4") != std::string::npos || name.find("rife4") != std::string::npos, model_padding(name) };
+}
+
+// device local heap usage in bytes, 0 if VK_EXT_memory_budget is not available
+static uint64_t device_memory_usage(const int gpu_id)
+{
+    const ncnn::GpuInfo& info{ ncnn::get_gpu_info(gpu_id) };
+    if (!info.support_VK_EXT_memory_budget())
+        return 0;
+
+    static const auto get_properties2{ reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2>(
+        vkGetInstanceProcAddr(ncnn::get_gpu_instance(), "vkGetPhysicalDeviceMemoryProperties2")) };
+    if (!get_properties2)
+        return 0;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+
+    get_properties2(info.physical_device(), &properties);
+
+    uint64_t usage{ 0 };
+    for (uint32_t i{ 0 }; i < properties.memoryProperties.memoryHeapCount; ++i)
+    {
+        if (properties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            usage += budget.heapUsage[i];
+    }
+
+    return usage;
+}
+
+struct Result
+{
+    std::string mode;
+    std::string model;
+    int tta;
+    bool uhd;
+    int threads;
+    int frames;
+    int failures;
+    double fps;
+    double mean_ms;
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+    double peak_vram_mb;
+    std::optional<RIFETimings> stages; // mean per frame
+};
+
+static double percentile(const std::vector<double>& sorted, const double p)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    const size_t i{ static_cast<size_t>(std::ceil(p / 100.0 * sorted.size())) };
+    return sorted[std::clamp<size_t>(i, 1, sorted.size()) - 1];
+}
+
+template <typename F>
+static Result run(const std::string& mode, const int threads, const int frames, const int warmup, const int gpu_id, const bool stages,
+    F&& process_frame)
+{
+    std::vector<double> latencies;
+    latencies.reserve(frames);
+    std::mutex mutex;
+    int failures{ 0 };
+    uint64_t peak_usage{ device_memory_usage(gpu_id) };
+    RIFETimings total{};
+
+    const auto worker{ [&](const int index, const int count) {
+        std::vector<float> dst;
+
+        for (int i{ 0 }; i < warmup; ++i)
+            process_frame(index + i, dst, nullptr);
+
+        for (int i{ 0 }; i < count; ++i)
+        {
+            RIFETimings timings{};
+            const auto start{ std::chrono::steady_clock::now() };
+            const int ret{ process_frame(index + i, dst, stages ? &timings : nullptr) };
+            const std::chrono::duration<double, std::milli> elapsed{ std::chrono::steady_clock::now() - start };
+
+            const uint64_t usage{ device_memory_usage(gpu_id) };
+
+            std::lock_guard lock(mutex);
+            latencies.emplace_back(elapsed.count());
+            failures += (ret != 0);
+            peak_usage = (std::max)(peak_usage, usage);
+            total.upload += timings.upload;
+            total.preproc += timings.preproc;
+            total.infer += timings.infer;
+            total.postproc += timings.postproc;
+            total.readback += timings.readback;
+            total.convert += timings.convert;
+            total.peak_vram = (std::max)(total.peak_vram, timings.peak_vram);
+        }
+        } };
+
+    const auto start{ std::chrono::steady_clock::now() };
+
+    std::vector<std::thread> workers;
+    for (int t{ 0 }; t < threads; ++t)
+    {
+        const int count{ frames / threads + (t < frames % threads) };
+        workers.emplace_back(worker, t * (frames / threads + 1), count);
+    }
+
+    for (auto& w : workers)
+        w.join();
+
+    const std::chrono::duration<double> wall{ std::chrono::steady_clock::now() - start };
+
+    std::sort(latencies.begin(), latencies.end());
+
+    Result r{};
+    r.mode = mode;
+    r.threads = threads;
+    r.frames = frames;
+    r.failures = failures;
+    r.fps = frames / wall.count();
+    for (const double l : latencies)
+        r.mean_ms += l;
+    r.mean_ms /= (std::max)(static_cast<size_t>(1), latencies.size());
+    r.p50_ms = percentile(latencies, 50.0);
+    r.p95_ms = percentile(latencies, 95.0);
+    r.p99_ms = percentile(latencies, 99.0);
+    r.peak_vram_mb = peak_usage / (1024.0 * 1024.0);
+
+    if (stages)
+        r.stages = RIFETimings{ total.upload / frames, total.preproc / frames, total.infer / frames, total.postproc / frames,
+            total.readback / frames, total.convert / frames, total.peak_vram };
+
+    return r;
+}
+
+static std::string json_escape(const std::string& s)
+{
+    std::string out;
+    for (const char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+
+    return out;
+}
+
+static std::string to_json(const Options& opt, const std::string& device, const int w, const int h, const std::vector<Result>& results)
+{
+    std::string s{ "{\n" };
+    s += std::format("  \"device\": \"{}\",\n", json_escape(device));
+    s += std::format("  \"width\": {},\n  \"height\": {},\n  \"format\": \"{}\",\n", w, h, json_escape(opt.format_name));
+    s += "  \"results\": [\n";
+
+    for (size_t i{ 0 }; i < results.size(); ++i)
+    {
+        const Result& r{ results[i] };
+        s += std::format("    {{ \"mode\": \"{}\", \"model\": \"{}\", \"tta\": {}, \"uhd\": {}, \"threads\": {}, \"frames\": {}, "
+            "\"failures\": {}, \"fps\": {:.3f}, \"latency_ms\": {{ \"mean\": {:.3f}, \"p50\": {:.3f}, \"p95\": {:.3f}, \"p99\": {:.3f} }}, "
+            "\"peak_vram_mb\": {:.1f}", r.mode, json_escape(r.model), r.tta, r.uhd, r.threads, r.frames, r.failures, r.fps,
+            r.mean_ms, r.p50_ms, r.p95_ms, r.p99_ms, r.peak_vram_mb);
+
+        if (r.stages)
+            s += std::format(", \"stages_us\": {{ \"upload\": {:.1f}, \"preproc\": {:.1f}, \"infer\": {:.1f}, \"postproc\": {:.1f}, "
+                "\"readback\": {:.1f}, \"convert\": {:.1f} }}, \"blob_peak_mb\": {:.1f}", r.stages->upload, r.stages->preproc,
+                r.stages->infer, r.stages->postproc, r.stages->readback, r.stages->convert, r.stages->peak_vram / (1024.0 * 1024.0));
+
+        s += std::format(" }}{}\n", (i + 1 < results.size()) ? "," : "");
+    }
+
+    s += "  ]\n}\n";
+
+    return s;
+}
+
+static std::optional<Options> parse_args(const int argc, char** argv)
+{
+    Options opt;
+
+    for (int i{ 1 }; i < argc; ++i)
+    {
+        const std::string arg{ argv[i] };
+        const auto next{ [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("missing value of " + arg);
+            return argv[++i];
+            } };
+
+        if (arg == "--model")
+            opt.models.emplace_back(next());
+        else if (arg == "--y4m")
+            opt.y4m = next();
+        else if (arg == "--format")
+            opt.format_name = next();
+        else if (arg == "--size")
+        {
+            const std::string v{ next() };
+            const size_t x{ v.find('x') };
+            if (x == std::string::npos)
+                throw std::runtime_error("invalid --size");
+            opt.width = std::stoi(v.substr(0, x));
+            opt.height = std::stoi(v.substr(x + 1));
+        }
+        else if (arg == "--frames")
+            opt.frames = std::stoi(next());
+        else if (arg == "--warmup")
+            opt.warmup = std::stoi(next());
+        else if (arg == "--gpu")
+            opt.gpu_id = std::stoi(next());
+        else if (arg == "--matrix")
+            opt.matrix_in = std::stoi(next());
+        else if (arg == "--full-range")
+            opt.full_range = true;
+        else if (arg == "--tta")
+            opt.tta = split_int(next());
+        else if (arg == "--uhd")
+            opt.uhd = split_int(next());
+        else if (arg == "--threads")
+            opt.threads = split_int(next());
+        else if (arg == "--mode")
+            opt.modes = split(next());
+        else if (arg == "--output")
+            opt.output = next();
+        else if (arg == "--trace")
+            opt.trace_file = next();
+        else if (arg == "--autotune")
+            opt.autotune_file = next();
+        else if (arg == "--no-fusion")
+            opt.fusion = false;
+        else if (arg == "--tta-batch")
+            opt.tta_batch = std::stoi(next());
+        else if (arg == "--stages")
+            opt.stages = true;
+        else if (arg == "--verify")
+            opt.verify = true;
+        else if (arg == "--kernels")
+            opt.kernels = true;
+        else
+            return std::nullopt;
+    }
+
+    if (opt.width < 2 || opt.height < 2 || opt.frames < 1 || opt.warmup < 0)
+        throw std::runtime_error("invalid size or frame count");
+    if (std::any_of(opt.threads.begin(), opt.threads.end(), [](const int t) { return t < 1; }))
+        throw std::runtime_error("thread count must be at least 1");
+    if (opt.tta_batch < 1 || opt.tta_batch > 8)
+        throw std::runtime_error("--tta-batch must be between 1 and 8");
+    for (int& tta : opt.tta)
+    {
+        if (tta == 0)
+            tta = 1;
+        else if (tta != 1 && tta != 2 && tta != 4 && tta != 8)
+            throw std::runtime_error("--tta levels must be 0, 1, 2, 4 or 8");
+    }
+
+    return opt;
+}
+
+static void write_report(const Options& opt, const std::string& json)
+{
+    if (opt.output.empty())
+        std::cout << json;
+    else
+    {
+        std::ofstream ofs{ opt.output };
+        if (!ofs)
+            throw std::runtime_error("cannot write " + opt.output);
+        ofs << json;
+    }
+}
+
+static int bench(const Options& opt)
+{
+    int w{ opt.width };
+    int h{ opt.height };
+    std::optional<Format> fmt{ parse_format(opt.format_name) };
+    if (!fmt)
+        throw std::runtime_error("unknown format " + opt.format_name);
+
+    const std::vector<Frame> frames{ opt.y4m ? read_y4m(*opt.y4m, *fmt, w, h, 16) : synthetic_frames(*fmt, w, h, 8) };
+    const int frame_count{ static_cast<int>(frames.size()) };
+    const bool full_range{ opt.full_range || !fmt->is_yuv || fmt->bit_depth == 32 };
+
+    const int gpu_id{ (opt.gpu_id < 0) ? ncnn::get_default_gpu_index() : opt.gpu_id };
+    if (gpu_id >= ncnn::get_gpu_count())
+        throw std::runtime_error("invalid GPU device");
+
+    const std::vector<std::filesystem::path> models{ collect_models(opt.models) };
+    const auto wants{ [&](const char* mode) { return std::find(opt.modes.begin(), opt.modes.end(), mode) != opt.modes.end(); } };
+
+    // copy and blend need a loaded instance as well
+    if (models.empty())
+        throw std::runtime_error("--model is required");
+
+    const auto make_rife{ [&](const std::filesystem::path& dir, const int tta, const bool uhd) {
+        const ModelInfo info{ model_info(dir) };
+
+        auto rife{ std::make_unique<RIFE>(gpu_id, tta, uhd, 1, info.rife_v2, info.rife_v4, info.padding, fmt->is_yuv,
+            fmt->chroma_subsampling, opt.matrix_in, fmt->bytes_per_comp(), full_range, fmt->bit_depth, opt.tta_batch) };
+        if (rife->load(dir.generic_string(), opt.fusion))
+            throw std::runtime_error("failed to load " + dir.string());
+        if (!opt.autotune_file.empty() && rife->autotune(w, h, opt.autotune_file))
+            throw std::runtime_error("autotune failed");
+
+        return rife;
+        } };
+
+    const ptrdiff_t dst_stride{ w };
+    const auto dst_planes{ [&](std::vector<float>& dst) {
+        dst.resize(static_cast<size_t>(dst_stride) * h * 3);
+        return std::make_tuple(dst.data(), dst.data() + dst_stride * h, dst.data() + 2 * dst_stride * h);
+        } };
+
+    std::vector<Result> results;
+
+    if (wants("interp"))
+    {
+        for (const auto& dir : models)
+        {
+            const bool rife_v4{ model_info(dir).rife_v4 };
+
+            for (const int tta : opt.tta)
+            {
+                // not supported by the v4 models
+                if (tta > 1 && rife_v4)
+                    continue;
+
+                for (const int uhd : opt.uhd)
+                {
+                    const auto rife{ make_rife(dir, tta, uhd) };
+
+                    for (const int threads : opt.threads)
+                    {
+                        Result r{ run("interp", threads, opt.frames, opt.warmup, gpu_id, opt.stages,
+                            [&](const int n, std::vector<float>& dst, RIFETimings* timings) {
+                            const Frame& f0{ frames[n % frame_count] };
+                            const Frame& f1{ frames[(n + 1) % frame_count] };
+                            const uint8_t* p0[3];
+                            const uint8_t* p1[3];
+                            f0.pointers(p0);
+                            f1.pointers(p1);
+                            const auto [r_, g_, b_] { dst_planes(dst) };
+
+                            return (rife_v4) ?
+                                rife->process_v4(p0, p1, r_, g_, b_, w, h, f0.stride, f1.stride, dst_stride, 0.5f, nullptr, timings) :
+                                rife->process(p0, p1, r_, g_, b_, w, h, f0.stride, f1.stride, dst_stride, 0.5f, nullptr, timings);
+                            }) };
+                        r.model = dir.filename().string();
+                        r.tta = tta;
+                        r.uhd = uhd;
+                        results.emplace_back(std::move(r));
+
+                        std::cerr << std::format("{} tta={} uhd={} threads={}: {:.2f} fps\n", r.model, tta, uhd, threads,
+                            results.back().fps);
+                    }
+                }
+            }
+        }
+    }
+
+    if (wants("copy") || wants("blend"))
+    {
+        // any model dir works, only the conversion pipelines are used
+        const auto rife{ make_rife(models.front(), false, false) };
+
+        for (const int threads : opt.threads)
+        {
+            if (wants("copy"))
+            {
+                ConvertThreads convert_threads{ threads };
+
+                // the same thread count for the rows as for the frames
+                results.emplace_back(run("copy", threads, opt.frames, opt.warmup, gpu_id, opt.stages,
+                    [&](const int n, std::vector<float>& dst, RIFETimings* timings) {
+                    const Frame& f{ frames[n % frame_count] };
+                    const uint8_t* p[3];
+                    f.pointers(p);
+                    const auto [r_, g_, b_] { dst_planes(dst) };
+
+                    return rife->process_copy(p, r_, g_, b_, w, h, f.stride, dst_stride, &convert_threads, timings);
+                    }));
+            }
+
+            if (wants("blend"))
+            {
+                results.emplace_back(run("blend", threads, opt.frames, opt.warmup, gpu_id, opt.stages,
+                    [&](const int n, std::vector<float>& dst, RIFETimings* timings) {
+                    const Frame& f0{ frames[n % frame_count] };
+                    const Frame& f1{ frames[(n + 1) % frame_count] };
+                    const uint8_t* p0[3];
+                    const uint8_t* p1[3];
+                    f0.pointers(p0);
+                    f1.pointers(p1);
+                    const auto [r_, g_, b_] { dst_planes(dst) };
+
+                    return rife->process_blend(p0, p1, r_, g_, b_, w, h, f0.stride, f1.stride, dst_stride, 0.5f, timings);
+                    }));
+            }
+        }
+    }
+
+    write_report(opt, to_json(opt, ncnn::get_gpu_info(gpu_id).device_name(), w, h, results));
+
+    return std::any_of(results.begin(), results.end(), [](const Result& r) { return r.failures > 0; }) ? 2 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        const std::optional<Options> opt{ parse_args(argc, argv) };
+        if (!opt)
+        {
+            usage();
+            return 1;
+        }
+
+        // no model needed
+        if (opt->verify || opt->kernels)
+        {
+            int ret{ 0 };
+            if (opt->verify)
+            {
+                ret = verify_kernels() ? 2 : 0;
+
+                // Warp needs a device, it's skipped without one
+                const bool instance{ !ncnn::create_gpu_instance() };
+                if (instance && ncnn::get_gpu_count() > 0)
+                {
+                    if (verify_warp((opt->gpu_id < 0) ? ncnn::get_default_gpu_index() : opt->gpu_id))
+                        ret = 2;
+                }
+                else
+                    std::cerr << "rife_bench: no Vulkan device, Warp is not verified\n";
+
+                if (instance)
+                    ncnn::destroy_gpu_instance();
+            }
+            if (opt->kernels)
+                write_report(*opt, bench_kernels(opt->threads.back()));
+
+            return ret;
+        }
+
+        if (ncnn::create_gpu_instance())
+        {
+            std::cerr << "rife_bench: failed to create GPU instance\n";
+            return 1;
+        }
+
+        if (!opt->trace_file.empty())
+            trace::start(opt->trace_file);
+
+        int ret;
+        try
+        {
+            ret = bench(*opt);
+        }
+        catch (...)
+        {
+            trace::flush();
+            ncnn::destroy_gpu_instance();
+            throw;
+        }
+
+        trace::flush();
+        ncnn::destroy_gpu_instance();
+
+        return ret;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "rife_bench: " << e.what() << "\n";
+        return 1;
+    }
+}
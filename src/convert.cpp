@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: MIT
+
+#include "convert.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <type_traits>
+
+// float -> fp16 -> float, round to nearest even like the store to a fp16 buffer
+static inline float round_fp16(const float v) noexcept
+{
+    const float a{ std::abs(v) };
+
+    // fp16 subnormals have a fixed step of 2^-24, the ulp of 0.5f
+    if (a < 6.103515625e-05f)
+        return std::copysign((a + 0.5f) - 0.5f, v);
+
+    uint32_t u{ std::bit_cast<uint32_t>(v) };
+    u = (u + 0x0FFFu + ((u >> 13) & 1u)) & 0xFFFFE000u;
+
+    return std::bit_cast<float>(u);
+}
+
+struct ConvertConstants
+{
+    float norm; // 1 / max value, unused for float input
+    float y_offset;
+    float y_scale;
+    float c_offset;
+    float c_scale;
+    float kr_v;
+    float kg_u;
+    float kg_v;
+    float kb_u;
+};
+
+template <typename T>
+static inline float load(const T* __restrict p, const int x, const float norm) noexcept
+{
+    if constexpr (std::is_same_v<T, float>)
+        return p[x];
+    else
+        return static_cast<float>(p[x]) / norm;
+}
+
+template <bool fp16>
+static inline float store(const float v) noexcept
+{
+    // rife_postproc and the readback scaling
+    return ((fp16 ? round_fp16(v) : v) * 255.0f + 0.5f) * (1 / 255.0f);
+}
+
+template <typename T, bool is_yuv, bool subsampled_w, bool fp16>
+static void convert_rows(const ConvertConstants& k, const uint8_t* const src_p[3], const ptrdiff_t stride[3], float* dstR, float* dstG,
+    float* dstB, const ptrdiff_t dst_stride, const int w, const int y_start, const int y_end, const bool subsampled_h) noexcept
+{
+    for (int y{ y_start }; y < y_end; ++y)
+    {
+        const int y_chroma{ subsampled_h ? y / 2 : y };
+        const T* __restrict src0{ reinterpret_cast<const T*>(src_p[0] + y * stride[0]) };
+        const T* __restrict src1{ reinterpret_cast<const T*>(src_p[1] + y_chroma * stride[1]) };
+        const T* __restrict src2{ reinterpret_cast<const T*>(src_p[2] + y_chroma * stride[2]) };
+        float* __restrict r_out{ dstR + y * dst_stride };
+        float* __restrict g_out{ dstG + y * dst_stride };
+        float* __restrict b_out{ dstB + y * dst_stride };
+
+        for (int x{ 0 }; x < w; ++x)
+        {
+            const int x_chroma{ subsampled_w ? x / 2 : x };
+
+            float v0{ load(src0, x, k.norm) };
+            float v1{ load(src1, x_chroma, k.norm) };
+            float v2{ load(src2, x_chroma, k.norm) };
+
+            float r;
+            float g;
+            float b;
+
+            if constexpr (is_yuv)
+            {
+                v0 = (v0 - k.y_offset) * k.y_scale;
+                v1 = (v1 - k.c_offset) * k.c_scale;
+                v2 = (v2 - k.c_offset) * k.c_scale;
+
+                r = v0 + k.kr_v * v2;
+                g = v0 - k.kg_u * v1 - k.kg_v * v2;
+                b = v0 + k.kb_u * v1;
+            }
+            else
+            {
+                r = v0;
+                g = v1;
+                b = v2;
+            }
+
+            r_out[x] = store<fp16>(r);
+            g_out[x] = store<fp16>(g);
+            b_out[x] = store<fp16>(b);
+        }
+    }
+}
+
+using convert_rows_func = void (*)(const ConvertConstants&, const uint8_t* const[3], const ptrdiff_t[3], float*, float*, float*,
+    const ptrdiff_t, const int, const int, const int, const bool);
+
+template <typename T>
+static convert_rows_func select_rows(const bool is_yuv, const bool subsampled_w, const bool fp16) noexcept
+{
+    if (is_yuv)
+    {
+        if (subsampled_w)
+            return fp16 ? convert_rows<T, true, true, true> : convert_rows<T, true, true, false>;
+        else
+            return fp16 ? convert_rows<T, true, false, true> : convert_rows<T, true, false, false>;
+    }
+    else
+        return fp16 ? convert_rows<T, false, false, true> : convert_rows<T, false, false, false>;
+}
+
+ConvertThreads::ConvertThreads(const int num_threads)
+{
+    workers.reserve((std::max)(num_threads - 1, 0));
+
+    for (int i{ 1 }; i < num_threads; ++i)
+        workers.emplace_back(&ConvertThreads::worker, this);
+}
+
+ConvertThreads::~ConvertThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        stopping = true;
+    }
+    job_ready.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ConvertThreads::worker()
+{
+    std::unique_lock<std::mutex> lock{ mutex };
+
+    while (true)
+    {
+        job_ready.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+            return;
+
+        const Job job{ jobs.front() };
+        jobs.pop_front();
+
+        lock.unlock();
+        (*job.f)(job.i);
+        lock.lock();
+
+        if (--*job.pending == 0)
+            job_done.notify_all();
+    }
+}
+
+void ConvertThreads::run(const int n, const std::function<void(int)>& f)
+{
+    int pending{ (std::min)(n, size()) - 1 };
+
+    if (pending > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            for (int i{ 1 }; i <= pending; ++i)
+                jobs.push_back({ &f, i, &pending });
+        }
+        job_ready.notify_all();
+    }
+
+    f(0);
+
+    // the jobs above the worker count run on the calling thread
+    for (int i{ size() }; i < n; ++i)
+        f(i);
+
+    std::unique_lock<std::mutex> lock{ mutex };
+    job_done.wait(lock, [&] { return pending == 0; });
+}
+
+void convert_frame(const ConvertFormat& fmt, const uint8_t* const src_p[3], const ptrdiff_t stride[3], float* dstR, float* dstG,
+    float* dstB, const ptrdiff_t dst_stride, const int w, const int h, ConvertThreads* threads)
+{
+    // constants are folded the same way the shader compiler does it
+    ConvertConstants k{};
+    k.norm = (fmt.bytes_per_comp == 1) ? 255.0f : static_cast<float>((1 << fmt.bit_depth) - 1);
+    k.y_scale = 1.0f;
+    k.c_scale = 1.0f;
+
+    if (!fmt.full_range)
+    {
+        k.y_offset = static_cast<float>(16.0 / 255.0);
+        k.y_scale = static_cast<float>(255.0 / 219.0);
+        k.c_offset = static_cast<float>(128.0 / 255.0);
+        k.c_scale = static_cast<float>(255.0 / 224.0);
+    }
+    else if (fmt.bytes_per_comp != 4)
+        k.c_offset = 0.5f;
+
+    switch (fmt.matrix_in)
+    {
+        case 0: k.kr_v = 1.402f; k.kg_u = 0.3441f; k.kg_v = 0.7141f; k.kb_u = 1.772f; break;
+        case 1: k.kr_v = 1.5748f; k.kg_u = 0.1873f; k.kg_v = 0.4681f; k.kb_u = 1.8556f; break;
+        default: k.kr_v = 1.4746f; k.kg_u = 0.1645f; k.kg_v = 0.5713f; k.kb_u = 1.8814f; break;
+    }
+
+    const bool subsampled_w{ fmt.is_yuv && (fmt.chroma_subsampling == 1 || fmt.chroma_subsampling == 2) };
+    const bool subsampled_h{ fmt.is_yuv && fmt.chroma_subsampling == 1 };
+
+    const convert_rows_func rows{ [&]() {
+        switch (fmt.bytes_per_comp)
+        {
+            case 1: return select_rows<uint8_t>(fmt.is_yuv, subsampled_w, fmt.fp16_storage);
+            case 2: return select_rows<uint16_t>(fmt.is_yuv, subsampled_w, fmt.fp16_storage);
+            default: return select_rows<float>(fmt.is_yuv, subsampled_w, fmt.fp16_storage);
+        }
+        }() };
+
+    // keep at least 8192 samples (64 rows of 128) per thread, the borders filled by fill_outside are usually converted on the calling thread
+    const int max_threads{ threads ? threads->size() : 1 };
+    const int num_threads{ static_cast<int>(std::clamp<int64_t>(static_cast<int64_t>(w) * h / 8192, 1, (std::min)(max_threads, h))) };
+
+    if (num_threads == 1)
+    {
+        rows(k, src_p, stride, dstR, dstG, dstB, dst_stride, w, 0, h, subsampled_h);
+        return;
+    }
+
+    const int rows_per_thread{ (h + num_threads - 1) / num_threads };
+
+    threads->run(num_threads, [&](const int i) {
+        const int y_start{ i * rows_per_thread };
+        const int y_end{ (std::min)(y_start + rows_per_thread, h) };
+        if (y_start < y_end)
+            rows(k, src_p, stride, dstR, dstG, dstB, dst_stride, w, y_start, y_end, subsampled_h);
+        });
+}
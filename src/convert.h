@@ -0,0 +1,63 @@
+#pragma once
+
+// planar YUV/RGB -> RGBPS on the CPU
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ConvertFormat
+{
+    bool is_yuv;
+    int chroma_subsampling; // 0=4:4:4, 1=4:2:0, 2=4:2:2
+    int matrix_in; // 0=601, 1=709, 2=2020
+    int bytes_per_comp; // 1=8b, 2=16b, 4=32f
+    bool full_range; // 0=limited, 1=full
+    int bit_depth;
+    bool fp16_storage; // the padded GPU tensors are fp16
+};
+
+// Worker threads kept for the lifetime of the owner (the filter instance), so that a conversion doesn't start threads.
+// run can be called from several threads at once.
+class ConvertThreads
+{
+public:
+    // num_threads - 1 workers, the calling thread is the last one
+    explicit ConvertThreads(const int num_threads);
+    ~ConvertThreads();
+
+    ConvertThreads(const ConvertThreads&) = delete;
+    ConvertThreads& operator=(const ConvertThreads&) = delete;
+
+    int size() const noexcept { return static_cast<int>(workers.size()) + 1; }
+
+    // f(0) .. f(n - 1), f(0) on the calling thread, returns when all are done
+    void run(const int n, const std::function<void(int)>& f);
+
+private:
+    struct Job
+    {
+        const std::function<void(int)>* f;
+        int i;
+        int* pending;
+    };
+
+    void worker();
+
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+    std::deque<Job> jobs;
+    bool stopping{ false };
+    std::vector<std::thread> workers;
+};
+
+// Same arithmetic as rife_preproc -> rife_postproc -> readback, including the fp16 rounding of the padded tensor.
+// Rows are split between the threads of threads (nullptr: the calling thread only), small frames are converted on the calling thread.
+void convert_frame(const ConvertFormat& fmt, const uint8_t* const src_p[3], const ptrdiff_t stride[3], float* dstR, float* dstG,
+    float* dstB, const ptrdiff_t dst_stride, const int w, const int h, ConvertThreads* threads);
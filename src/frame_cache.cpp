@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: MIT
+
+#include "frame_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "kernels.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+FrameCache::FileLock::~FileLock()
+{
+    unlock();
+}
+
+FrameCache::FileLock::FileLock(FileLock&& other) noexcept : handle(std::exchange(other.handle, -1))
+{
+}
+
+FrameCache::FileLock& FrameCache::FileLock::operator=(FileLock&& other) noexcept
+{
+    if (this != &other)
+    {
+        unlock();
+        handle = std::exchange(other.handle, -1);
+    }
+
+    return *this;
+}
+
+bool FrameCache::FileLock::try_lock(const std::filesystem::path& path, const bool create_new) noexcept
+{
+    unlock();
+
+#ifdef _WIN32
+    const HANDLE file{ CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, (create_new) ? CREATE_NEW : OPEN_EXISTING, 0, nullptr) };
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    // a byte past the end of any segment, the lock doesn't block the reads and writes of the mappings
+    OVERLAPPED overlapped{};
+    overlapped.OffsetHigh = 0x40000000;
+    if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    handle = reinterpret_cast<intptr_t>(file);
+#else
+    const int fd{ ::open(path.c_str(), O_RDWR | O_CLOEXEC | ((create_new) ? O_CREAT | O_EXCL : 0), 0644) };
+    if (fd < 0)
+        return false;
+
+    if (flock(fd, LOCK_EX | LOCK_NB))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    handle = fd;
+#endif
+
+    return true;
+}
+
+void FrameCache::FileLock::unlock() noexcept
+{
+    if (handle == -1)
+        return;
+
+    // closing the file releases the lock
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(handle));
+#else
+    ::close(static_cast<int>(handle));
+#endif
+
+    handle = -1;
+}
+
+uint64_t FrameCache::record_size(const int width, const int height) noexcept
+{
+    return (sizeof(Record) + static_cast<uint64_t>(width) * height * 3 * sizeof(uint16_t) + 63) & ~uint64_t{ 63 };
+}
+
+std::filesystem::path FrameCache::segment_path(const uint32_t id) const
+{
+    return dir / std::format("segment_{:08}.bin", id);
+}
+
+bool FrameCache::open(const std::filesystem::path& cache_dir, const uint64_t max_size)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir, ec);
+    if (!std::filesystem::is_directory(cache_dir, ec))
+        return false;
+
+    std::lock_guard lock(mutex);
+    dir = cache_dir;
+    max_bytes = max_size;
+    segment_size = (std::max)(max_bytes / 8, uint64_t{ 1 } << 20);
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        const std::string name{ entry.path().filename().string() };
+        uint32_t id{};
+        if (!name.starts_with("segment_") || !name.ends_with(".bin") ||
+            std::from_chars(name.data() + 8, name.data() + name.size() - 4, id).ec != std::errc{})
+            continue;
+
+        auto segment{ std::make_shared<Segment>(Segment{ id, MappedFile::open_writable(entry.path()), 0, 0 }) };
+        if (!segment->file.is_open())
+            continue;
+
+        const unsigned char* data{ segment->file.data() };
+        const uint64_t size{ segment->file.size() };
+        uint64_t offset{ 0 };
+
+        while (offset + sizeof(Record) <= size)
+        {
+            Record record;
+            std::memcpy(&record, data + offset, sizeof(Record));
+            const uint64_t length{ record_size(record.width, record.height) };
+            if (!record.key || offset + length > size)
+                break;
+
+            index.insert_or_assign(record.key, Location{ segment, offset });
+            offset += length;
+        }
+
+        segment->used = offset;
+        segments.emplace(id, std::move(segment));
+    }
+
+    // the ids are in the order the segments were made, the oldest ones are evicted first
+    for (auto& [id, segment] : segments)
+        segment->last_use = ++clock;
+
+    // the records of this process go to new segments, the segments of other processes that use the same dir are not written
+    evict();
+    return true;
+}
+
+std::shared_ptr<FrameCache::Segment> FrameCache::new_segment(const uint64_t size)
+{
+    // the next ids can be taken by the segments that other processes made after open
+    uint32_t id{ segments.empty() ? 1 : segments.rbegin()->first + 1 };
+    for (int attempt{ 0 }; attempt < 64; ++attempt, ++id)
+    {
+        // the file is locked as soon as it's made, so that the other processes don't evict it
+        const std::filesystem::path path{ segment_path(id) };
+        FileLock lock;
+        if (!lock.try_lock(path, true))
+            continue;
+
+        MappedFile file{ MappedFile::open_writable(path, size) };
+        if (!file.is_open())
+        {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            continue;
+        }
+
+        auto segment{ std::make_shared<Segment>(Segment{ id, std::move(file), 0, ++clock, std::move(lock) }) };
+        segments.emplace(id, segment);
+        return segment;
+    }
+
+    return nullptr;
+}
+
+void FrameCache::evict()
+{
+    uint64_t bytes{ 0 };
+    std::vector<std::shared_ptr<Segment>> victims;
+
+    for (const auto& [id, segment] : segments)
+    {
+        bytes += segment->file.size();
+        if (segment != active)
+            victims.emplace_back(segment);
+    }
+
+    // the least recently used first
+    std::sort(victims.begin(), victims.end(), [](const auto& a, const auto& b) { return a->last_use < b->last_use; });
+
+    for (const auto& victim : victims)
+    {
+        if (bytes <= max_bytes)
+            break;
+
+        // the active segments of the other processes are locked, the lock is held until the file is removed
+        const std::filesystem::path path{ segment_path(victim->id) };
+        FileLock lock;
+        if (!lock.try_lock(path))
+            continue;
+
+        std::erase_if(index, [&](const auto& entry) { return entry.second.segment == victim; });
+
+        // readers that hold the segment keep the mapping until they are done
+        segments.erase(victim->id);
+        bytes -= victim->file.size();
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+}
+
+bool FrameCache::get(const uint64_t key, float* const planes[3], const ptrdiff_t stride, const int width, const int height,
+    double& active_area)
+{
+    std::shared_ptr<Segment> segment;
+    uint64_t offset;
+    {
+        std::lock_guard lock(mutex);
+        const auto it{ index.find(key) };
+        if (it == index.end())
+            return false;
+
+        segment = it->second.segment;
+        offset = it->second.offset;
+        segment->last_use = ++clock;
+    }
+
+    const unsigned char* data{ segment->file.data() + offset };
+    Record record;
+    std::memcpy(&record, data, sizeof(Record));
+    if (record.key != key || record.width != static_cast<uint32_t>(width) || record.height != static_cast<uint32_t>(height))
+        return false;
+
+    const uint16_t* src{ reinterpret_cast<const uint16_t*>(data + sizeof(Record)) };
+
+    for (int i{ 0 }; i < 3; ++i)
+    {
+        for (int y{ 0 }; y < height; ++y, src += width)
+            std::transform(src, src + width, planes[i] + y * stride, kernels::half_to_float);
+    }
+
+    active_area = record.active_area;
+    return true;
+}
+
+void FrameCache::put(const uint64_t key, const float* const planes[3], const ptrdiff_t stride, const int width, const int height,
+    const double active_area)
+{
+    const uint64_t size{ record_size(width, height) };
+    std::shared_ptr<Segment> segment;
+    uint64_t offset;
+    {
+        std::lock_guard lock(mutex);
+        if (index.contains(key))
+            return;
+
+        if (!active || active->used + size > active->file.size())
+        {
+            // a full segment can be evicted by the other processes
+            if (active)
+                active->lock = FileLock{};
+
+            active = new_segment((std::max)(segment_size, size));
+            if (!active)
+                return;
+
+            evict();
+        }
+
+        segment = active;
+        offset = segment->used;
+        segment->used += size;
+        segment->last_use = ++clock;
+    }
+
+    // the planes are converted without the lock, the key is written last so that a record that was not finished ends the segment
+    unsigned char* data{ segment->file.writable_data() + offset };
+    uint16_t* dst{ reinterpret_cast<uint16_t*>(data + sizeof(Record)) };
+
+    for (int i{ 0 }; i < 3; ++i)
+    {
+        for (int y{ 0 }; y < height; ++y, dst += width)
+            std::transform(planes[i] + y * stride, planes[i] + y * stride + width, dst, kernels::float_to_half);
+    }
+
+    Record* record{ reinterpret_cast<Record*>(data) };
+    record->width = static_cast<uint32_t>(width);
+    record->height = static_cast<uint32_t>(height);
+    record->active_area = static_cast<float>(active_area);
+    record->reserved = 0;
+    std::atomic_ref<uint64_t>(record->key).store(key, std::memory_order_release);
+
+    std::lock_guard lock(mutex);
+    if (segments.contains(segment->id))
+        index.emplace(key, Location{ std::move(segment), offset });
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// content addressed disk cache of interpolated frames (cache_dir)
+// the frames are stored as fp16 planes in memory mapped segment files, every record starts with its key so the index is rebuilt
+// from the segments when the cache is opened, the least recently used segment is deleted when the size limit is exceeded
+// the processes that share the dir append only to the segments they created, a process holds an advisory lock on the segment it
+// appends to and the segments locked by other processes are not evicted
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "mapped_file.h"
+
+class FrameCache
+{
+public:
+    // false if the dir cannot be created
+    bool open(const std::filesystem::path& dir, const uint64_t max_bytes);
+
+    // copies the frame of key to the float planes, false on a miss
+    // get and put can throw (std::bad_alloc, std::filesystem::filesystem_error)
+    bool get(const uint64_t key, float* const planes[3], const ptrdiff_t stride, const int width, const int height, double& active_area);
+    void put(const uint64_t key, const float* const planes[3], const ptrdiff_t stride, const int width, const int height,
+        const double active_area);
+
+private:
+    // exclusive advisory lock of a file (flock / LockFileEx), released when destroyed
+    class FileLock
+    {
+    public:
+        FileLock() noexcept = default;
+        ~FileLock();
+
+        FileLock(FileLock&& other) noexcept;
+        FileLock& operator=(FileLock&& other) noexcept;
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+
+        // false if the file cannot be opened or another process (or FileLock) holds the lock, create_new fails when the file exists
+        bool try_lock(const std::filesystem::path& path, const bool create_new = false) noexcept;
+
+    private:
+        void unlock() noexcept;
+
+        intptr_t handle{ -1 };
+    };
+
+    struct Record
+    {
+        uint64_t key; // 0=end of the segment, written after the planes
+        uint32_t width;
+        uint32_t height;
+        float active_area;
+        uint32_t reserved;
+    };
+
+    struct Segment
+    {
+        uint32_t id;
+        MappedFile file;
+        uint64_t used; // bytes of the records
+        uint64_t last_use;
+        FileLock lock; // held while it's the active segment of this process
+    };
+
+    struct Location
+    {
+        std::shared_ptr<Segment> segment;
+        uint64_t offset;
+    };
+
+    static uint64_t record_size(const int width, const int height) noexcept;
+    std::filesystem::path segment_path(const uint32_t id) const;
+    std::shared_ptr<Segment> new_segment(const uint64_t size);
+    void evict();
+
+    std::mutex mutex;
+    std::filesystem::path dir;
+    uint64_t max_bytes{};
+    uint64_t segment_size{};
+    uint64_t clock{};
+    std::map<uint32_t, std::shared_ptr<Segment>> segments;
+    std::unordered_map<uint64_t, Location> index;
+    std::shared_ptr<Segment> active; // the records are appended to it
+};
@@ -0,0 +1,3 @@
+#pragma once
+
+static const char fused_warp_comp_data[] = { 0x23,0x76,0x65,0x72,0x73,0x69,0x6f,0x6e,0x20,0x34,0x35,0x30,0x0d,0x0a,0x0d,0x0a,0x23,0x69,0x66,0x20,0x4e,0x43,0x4e,0x4e,0x5f,0x66,0x70,0x31,0x36,0x5f,0x73,0x74,0x6f,0x72,0x61,0x67,0x65,0x0d,0x0a,0x23,0x65,0x78,0x74,0x65,0x6e,0x73,0x69,0x6f,0x6e,0x20,0x47,0x4c,0x5f,0x45,0x58,0x54,0x5f,0x73,0x68,0x61,0x64,0x65,0x72,0x5f,0x31,0x36,0x62,0x69,0x74,0x5f,0x73,0x74,0x6f,0x72,0x61,0x67,0x65,0x3a,0x20,0x72,0x65,0x71,0x75,0x69,0x72,0x65,0x0d,0x0a,0x23,0x65,0x6e,0x64,0x69,0x66,0x0d,0x0a,0x23,0x69,0x66,0x20,0x4e,0x43,0x4e,0x4e,0x5f,0x66,0x70,0x31,0x36,0x5f,0x61,0x72,0x69,0x74,0x68,0x6d,0x65,0x74,0x69,0x63,0x0d,0x0a,0x23,0x65,0x78,0x74,0x65,0x6e,0x73,0x69,0x6f,0x6e,0x20,0x47,0x4c,0x5f,0x45,0x58,0x54,0x5f,0x73,0x68,0x61,0x64,0x65,0x72,0x5f,0x65,0x78,0x70,0x6c,0x69,0x63,0x69,0x74,0x5f,0x61,0x72,0x69,0x74,0x68,0x6d,0x65,0x74,0x69,0x63,0x5f,0x74,0x79,0x70,0x65,0x73,0x5f,0x66,0x6c,0x6f,0x61,0x74,0x31,0x36,0x3a,0x20,0x72,0x65,0x71,0x75,0x69,0x72,0x65,0x0d,0x0a,0x23,0x65,0x6e,0x64,0x69,0x66,0x0d,0x0a,0x0d,0x0a,0x6c,0x61,0x79,0x6f,0x75,0x74,0x20,0x28,0x62,0x69,0x6e,0x64,0x69,0x6e,0x67,0x20,0x3d,0x20,0x30,0x29,0x20,0x72,0x65,0x61,0x64,0x6f,0x6e,0x6c,0x79,0x20,0x62,0x75,0x66,0x66,0x65,0x72,0x20,0x69,0x6d,0x61,0x67,0x65,0x5f,0x62,0x6c,0x6f,0x62,0x20,0x7b,0x20,0x73,0x66,0x70,0x20,0x69,0x6d,0x61,0x67,0x65,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x5b,0x5d,0x3b,0x20,0x7d,0x3b,0x0d,0x0a,0x6c,0x61,0x79,0x6f,0x75,0x74,0x20,0x28,0x62,0x69,0x6e,0x64,0x69,0x6e,0x67,0x20,0x3d,0x20,0x31,0x29,0x20,0x72,0x65,0x61,0x64,0x6f,0x6e,0x6c,0x79,0x20,0x62,0x75,0x66,0x66,0x65,0x72,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x20,0x7b,0x20,0x73,0x66,0x70,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x5b,0x5d,0x3b,0x20,0x7d,0x3b,0x0d,0x0a,0x6c,0x61,0x79,0x6f,0x75,0x74,0x20,0x28,0x62,0x69,0x6e,0x64,0x69,0x6e,0x67,0x20,0x3d,0x20,0x32,0x29,0x20,0x77,0x72,0x69,0x74,0x65,0x6f,0x6e,0x6c,0x79,0x20,0x62,0x75,0x66,0x66,0x65,0x72,0x20,0x74,0x6f,0x70,0x5f,0x62,0x6c,0x6f,0x62,0x20,0x7b,0x20,0x73,0x66,0x70,0x20,0x74,0x6f,0x70,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x5b,0x5d,0x3b,0x20,0x7d,0x3b,0x0d,0x0a,0x0d,0x0a,0x6c,0x61,0x79,0x6f,0x75,0x74,0x20,0x28,0x70,0x75,0x73,0x68,0x5f,0x63,0x6f,0x6e,0x73,0x74,0x61,0x6e,0x74,0x29,0x20,0x75,0x6e,0x69,0x66,0x6f,0x72,0x6d,0x20,0x70,0x61,0x72,0x61,0x6d,0x65,0x74,0x65,0x72,0x0d,0x0a,0x7b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x77,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x68,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x63,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x63,0x73,0x74,0x65,0x70,0x3b,0x0d,0x0a,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x77,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x68,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x63,0x73,0x74,0x65,0x70,0x3b,0x0d,0x0a,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x73,0x63,0x61,0x6c,0x65,0x5f,0x78,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x73,0x63,0x61,0x6c,0x65,0x5f,0x79,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x61,0x6c,0x69,0x67,0x6e,0x5f,0x63,0x6f,0x72,0x6e,0x65,0x72,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x73,0x63,0x61,0x6c,0x65,0x3b,0x0d,0x0a,0x7d,0x20,0x70,0x3b,0x0d,0x0a,0x0d,0x0a,0x2f,0x2f,0x20,0x73,0x61,0x6d,0x65,0x20,0x63,0x6f,0x65,0x66,0x66,0x69,0x63,0x69,0x65,0x6e,0x74,0x73,0x20,0x61,0x73,0x20,0x74,0x68,0x65,0x20,0x62,0x69,0x6c,0x69,0x6e,0x65,0x61,0x72,0x20,0x49,0x6e,0x74,0x65,0x72,0x70,0x0d,0x0a,0x76,0x6f,0x69,0x64,0x20,0x6c,0x69,0x6e,0x65,0x61,0x72,0x5f,0x63,0x6f,0x65,0x66,0x66,0x28,0x69,0x6e,0x74,0x20,0x64,0x78,0x2c,0x20,0x66,0x6c,0x6f,0x61,0x74,0x20,0x73,0x63,0x61,0x6c,0x65,0x2c,0x20,0x69,0x6e,0x74,0x20,0x73,0x69,0x7a,0x65,0x2c,0x20,0x6f,0x75,0x74,0x20,0x69,0x6e,0x74,0x20,0x73,0x78,0x30,0x2c,0x20,0x6f,0x75,0x74,0x20,0x69,0x6e,0x74,0x20,0x73,0x78,0x31,0x2c,0x20,0x6f,0x75,0x74,0x20,0x66,0x6c,0x6f,0x61,0x74,0x20,0x66,0x78,0x29,0x0d,0x0a,0x7b,0x0d,0x0a,0x66,0x78,0x20,0x3d,0x20,0x28,0x70,0x2e,0x61,0x6c,0x69,0x67,0x6e,0x5f,0x63,0x6f,0x72,0x6e,0x65,0x72,0x20,0x3d,0x3d,0x20,0x31,0x29,0x20,0x3f,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x64,0x78,0x29,0x20,0x2a,0x20,0x73,0x63,0x61,0x6c,0x65,0x20,0x3a,0x20,0x28,0x66,0x6c,0x6f,0x61,0x74,0x28,0x64,0x78,0x29,0x20,0x2b,0x20,0x30,0x2e,0x35,0x66,0x29,0x20,0x2a,0x20,0x73,0x63,0x61,0x6c,0x65,0x20,0x2d,0x20,0x30,0x2e,0x35,0x66,0x3b,0x0d,0x0a,0x73,0x78,0x30,0x20,0x3d,0x20,0x69,0x6e,0x74,0x28,0x66,0x6c,0x6f,0x6f,0x72,0x28,0x66,0x78,0x29,0x29,0x3b,0x0d,0x0a,0x66,0x78,0x20,0x2d,0x3d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x73,0x78,0x30,0x29,0x3b,0x0d,0x0a,0x0d,0x0a,0x69,0x66,0x20,0x28,0x73,0x78,0x30,0x20,0x3c,0x20,0x30,0x29,0x0d,0x0a,0x7b,0x0d,0x0a,0x73,0x78,0x30,0x20,0x3d,0x20,0x30,0x3b,0x0d,0x0a,0x66,0x78,0x20,0x3d,0x20,0x30,0x2e,0x66,0x3b,0x0d,0x0a,0x7d,0x0d,0x0a,0x69,0x66,0x20,0x28,0x73,0x78,0x30,0x20,0x3e,0x3d,0x20,0x73,0x69,0x7a,0x65,0x20,0x2d,0x20,0x31,0x29,0x0d,0x0a,0x7b,0x0d,0x0a,0x73,0x78,0x30,0x20,0x3d,0x20,0x6d,0x61,0x78,0x28,0x73,0x69,0x7a,0x65,0x20,0x2d,0x20,0x32,0x2c,0x20,0x30,0x29,0x3b,0x0d,0x0a,0x66,0x78,0x20,0x3d,0x20,0x31,0x2e,0x66,0x3b,0x0d,0x0a,0x7d,0x0d,0x0a,0x0d,0x0a,0x73,0x78,0x31,0x20,0x3d,0x20,0x6d,0x69,0x6e,0x28,0x73,0x78,0x30,0x20,0x2b,0x20,0x31,0x2c,0x20,0x73,0x69,0x7a,0x65,0x20,0x2d,0x20,0x31,0x29,0x3b,0x0d,0x0a,0x7d,0x0d,0x0a,0x0d,0x0a,0x2f,0x2f,0x20,0x49,0x6e,0x74,0x65,0x72,0x70,0x20,0x2d,0x3e,0x20,0x42,0x69,0x6e,0x61,0x72,0x79,0x4f,0x70,0x20,0x6d,0x75,0x6c,0x20,0x2d,0x3e,0x20,0x57,0x61,0x72,0x70,0x2c,0x20,0x6f,0x6e,0x65,0x20,0x69,0x6e,0x76,0x6f,0x63,0x61,0x74,0x69,0x6f,0x6e,0x20,0x70,0x65,0x72,0x20,0x70,0x69,0x78,0x65,0x6c,0x20,0x66,0x6f,0x72,0x20,0x61,0x6c,0x6c,0x20,0x63,0x68,0x61,0x6e,0x6e,0x65,0x6c,0x73,0x0d,0x0a,0x76,0x6f,0x69,0x64,0x20,0x6d,0x61,0x69,0x6e,0x28,0x29,0x0d,0x0a,0x7b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x67,0x78,0x20,0x3d,0x20,0x69,0x6e,0x74,0x28,0x67,0x6c,0x5f,0x47,0x6c,0x6f,0x62,0x61,0x6c,0x49,0x6e,0x76,0x6f,0x63,0x61,0x74,0x69,0x6f,0x6e,0x49,0x44,0x2e,0x78,0x29,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x67,0x79,0x20,0x3d,0x20,0x69,0x6e,0x74,0x28,0x67,0x6c,0x5f,0x47,0x6c,0x6f,0x62,0x61,0x6c,0x49,0x6e,0x76,0x6f,0x63,0x61,0x74,0x69,0x6f,0x6e,0x49,0x44,0x2e,0x79,0x29,0x3b,0x0d,0x0a,0x0d,0x0a,0x69,0x66,0x20,0x28,0x67,0x78,0x20,0x3e,0x3d,0x20,0x70,0x2e,0x77,0x20,0x7c,0x7c,0x20,0x67,0x79,0x20,0x3e,0x3d,0x20,0x70,0x2e,0x68,0x29,0x0d,0x0a,0x72,0x65,0x74,0x75,0x72,0x6e,0x3b,0x0d,0x0a,0x0d,0x0a,0x2f,0x2f,0x20,0x75,0x70,0x73,0x63,0x61,0x6c,0x65,0x64,0x20,0x66,0x6c,0x6f,0x77,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x78,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x79,0x3b,0x0d,0x0a,0x7b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x73,0x78,0x30,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x73,0x78,0x31,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x73,0x79,0x30,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x73,0x79,0x31,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x66,0x78,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x66,0x79,0x3b,0x0d,0x0a,0x6c,0x69,0x6e,0x65,0x61,0x72,0x5f,0x63,0x6f,0x65,0x66,0x66,0x28,0x67,0x78,0x2c,0x20,0x70,0x2e,0x73,0x63,0x61,0x6c,0x65,0x5f,0x78,0x2c,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x77,0x2c,0x20,0x73,0x78,0x30,0x2c,0x20,0x73,0x78,0x31,0x2c,0x20,0x66,0x78,0x29,0x3b,0x0d,0x0a,0x6c,0x69,0x6e,0x65,0x61,0x72,0x5f,0x63,0x6f,0x65,0x66,0x66,0x28,0x67,0x79,0x2c,0x20,0x70,0x2e,0x73,0x63,0x61,0x6c,0x65,0x5f,0x79,0x2c,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x68,0x2c,0x20,0x73,0x79,0x30,0x2c,0x20,0x73,0x79,0x31,0x2c,0x20,0x66,0x79,0x29,0x3b,0x0d,0x0a,0x0d,0x0a,0x63,0x6f,0x6e,0x73,0x74,0x20,0x69,0x6e,0x74,0x20,0x69,0x30,0x30,0x20,0x3d,0x20,0x73,0x79,0x30,0x20,0x2a,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x77,0x20,0x2b,0x20,0x73,0x78,0x30,0x3b,0x0d,0x0a,0x63,0x6f,0x6e,0x73,0x74,0x20,0x69,0x6e,0x74,0x20,0x69,0x30,0x31,0x20,0x3d,0x20,0x73,0x79,0x30,0x20,0x2a,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x77,0x20,0x2b,0x20,0x73,0x78,0x31,0x3b,0x0d,0x0a,0x63,0x6f,0x6e,0x73,0x74,0x20,0x69,0x6e,0x74,0x20,0x69,0x31,0x30,0x20,0x3d,0x20,0x73,0x79,0x31,0x20,0x2a,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x77,0x20,0x2b,0x20,0x73,0x78,0x30,0x3b,0x0d,0x0a,0x63,0x6f,0x6e,0x73,0x74,0x20,0x69,0x6e,0x74,0x20,0x69,0x31,0x31,0x20,0x3d,0x20,0x73,0x79,0x31,0x20,0x2a,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x77,0x20,0x2b,0x20,0x73,0x78,0x31,0x3b,0x0d,0x0a,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x72,0x30,0x20,0x3d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x69,0x30,0x30,0x29,0x29,0x20,0x2a,0x20,0x28,0x31,0x2e,0x66,0x20,0x2d,0x20,0x66,0x78,0x29,0x20,0x2b,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x69,0x30,0x31,0x29,0x29,0x20,0x2a,0x20,0x66,0x78,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x72,0x31,0x20,0x3d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x69,0x31,0x30,0x29,0x29,0x20,0x2a,0x20,0x28,0x31,0x2e,0x66,0x20,0x2d,0x20,0x66,0x78,0x29,0x20,0x2b,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x69,0x31,0x31,0x29,0x29,0x20,0x2a,0x20,0x66,0x78,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x77,0x5f,0x78,0x20,0x3d,0x20,0x28,0x72,0x30,0x20,0x2a,0x20,0x28,0x31,0x2e,0x66,0x20,0x2d,0x20,0x66,0x79,0x29,0x20,0x2b,0x20,0x72,0x31,0x20,0x2a,0x20,0x66,0x79,0x29,0x20,0x2a,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x73,0x63,0x61,0x6c,0x65,0x3b,0x0d,0x0a,0x0d,0x0a,0x72,0x30,0x20,0x3d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x63,0x73,0x74,0x65,0x70,0x20,0x2b,0x20,0x69,0x30,0x30,0x29,0x29,0x20,0x2a,0x20,0x28,0x31,0x2e,0x66,0x20,0x2d,0x20,0x66,0x78,0x29,0x20,0x2b,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x63,0x73,0x74,0x65,0x70,0x20,0x2b,0x20,0x69,0x30,0x31,0x29,0x29,0x20,0x2a,0x20,0x66,0x78,0x3b,0x0d,0x0a,0x72,0x31,0x20,0x3d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x63,0x73,0x74,0x65,0x70,0x20,0x2b,0x20,0x69,0x31,0x30,0x29,0x29,0x20,0x2a,0x20,0x28,0x31,0x2e,0x66,0x20,0x2d,0x20,0x66,0x78,0x29,0x20,0x2b,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x66,0x6c,0x6f,0x77,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x63,0x73,0x74,0x65,0x70,0x20,0x2b,0x20,0x69,0x31,0x31,0x29,0x29,0x20,0x2a,0x20,0x66,0x78,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x77,0x5f,0x79,0x20,0x3d,0x20,0x28,0x72,0x30,0x20,0x2a,0x20,0x28,0x31,0x2e,0x66,0x20,0x2d,0x20,0x66,0x79,0x29,0x20,0x2b,0x20,0x72,0x31,0x20,0x2a,0x20,0x66,0x79,0x29,0x20,0x2a,0x20,0x70,0x2e,0x66,0x6c,0x6f,0x77,0x5f,0x73,0x63,0x61,0x6c,0x65,0x3b,0x0d,0x0a,0x7d,0x0d,0x0a,0x0d,0x0a,0x2f,0x2f,0x20,0x63,0x6f,0x6f,0x72,0x64,0x69,0x6e,0x61,0x74,0x65,0x73,0x20,0x69,0x6e,0x20,0x66,0x70,0x33,0x32,0x2c,0x20,0x66,0x70,0x31,0x36,0x20,0x63,0x61,0x6e,0x6e,0x6f,0x74,0x20,0x72,0x65,0x70,0x72,0x65,0x73,0x65,0x6e,0x74,0x20,0x65,0x76,0x65,0x72,0x79,0x20,0x70,0x69,0x78,0x65,0x6c,0x20,0x61,0x62,0x6f,0x76,0x65,0x20,0x32,0x30,0x34,0x38,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x73,0x61,0x6d,0x70,0x6c,0x65,0x5f,0x78,0x20,0x3d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x67,0x78,0x29,0x20,0x2b,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x78,0x3b,0x0d,0x0a,0x66,0x6c,0x6f,0x61,0x74,0x20,0x73,0x61,0x6d,0x70,0x6c,0x65,0x5f,0x79,0x20,0x3d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x67,0x79,0x29,0x20,0x2b,0x20,0x66,0x6c,0x6f,0x77,0x5f,0x79,0x3b,0x0d,0x0a,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x78,0x30,0x20,0x3d,0x20,0x69,0x6e,0x74,0x28,0x66,0x6c,0x6f,0x6f,0x72,0x28,0x73,0x61,0x6d,0x70,0x6c,0x65,0x5f,0x78,0x29,0x29,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x79,0x30,0x20,0x3d,0x20,0x69,0x6e,0x74,0x28,0x66,0x6c,0x6f,0x6f,0x72,0x28,0x73,0x61,0x6d,0x70,0x6c,0x65,0x5f,0x79,0x29,0x29,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x78,0x31,0x20,0x3d,0x20,0x78,0x30,0x20,0x2b,0x20,0x31,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x79,0x31,0x20,0x3d,0x20,0x79,0x30,0x20,0x2b,0x20,0x31,0x3b,0x0d,0x0a,0x0d,0x0a,0x78,0x30,0x20,0x3d,0x20,0x63,0x6c,0x61,0x6d,0x70,0x28,0x78,0x30,0x2c,0x20,0x30,0x2c,0x20,0x70,0x2e,0x77,0x20,0x2d,0x20,0x31,0x29,0x3b,0x0d,0x0a,0x79,0x30,0x20,0x3d,0x20,0x63,0x6c,0x61,0x6d,0x70,0x28,0x79,0x30,0x2c,0x20,0x30,0x2c,0x20,0x70,0x2e,0x68,0x20,0x2d,0x20,0x31,0x29,0x3b,0x0d,0x0a,0x78,0x31,0x20,0x3d,0x20,0x63,0x6c,0x61,0x6d,0x70,0x28,0x78,0x31,0x2c,0x20,0x30,0x2c,0x20,0x70,0x2e,0x77,0x20,0x2d,0x20,0x31,0x29,0x3b,0x0d,0x0a,0x79,0x31,0x20,0x3d,0x20,0x63,0x6c,0x61,0x6d,0x70,0x28,0x79,0x31,0x2c,0x20,0x30,0x2c,0x20,0x70,0x2e,0x68,0x20,0x2d,0x20,0x31,0x29,0x3b,0x0d,0x0a,0x0d,0x0a,0x61,0x66,0x70,0x20,0x61,0x6c,0x70,0x68,0x61,0x20,0x3d,0x20,0x61,0x66,0x70,0x28,0x73,0x61,0x6d,0x70,0x6c,0x65,0x5f,0x78,0x20,0x2d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x78,0x30,0x29,0x29,0x3b,0x0d,0x0a,0x61,0x66,0x70,0x20,0x62,0x65,0x74,0x61,0x20,0x3d,0x20,0x61,0x66,0x70,0x28,0x73,0x61,0x6d,0x70,0x6c,0x65,0x5f,0x79,0x20,0x2d,0x20,0x66,0x6c,0x6f,0x61,0x74,0x28,0x79,0x30,0x29,0x29,0x3b,0x0d,0x0a,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x69,0x30,0x20,0x3d,0x20,0x79,0x30,0x20,0x2a,0x20,0x70,0x2e,0x77,0x20,0x2b,0x20,0x78,0x30,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x69,0x31,0x20,0x3d,0x20,0x79,0x30,0x20,0x2a,0x20,0x70,0x2e,0x77,0x20,0x2b,0x20,0x78,0x31,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x69,0x32,0x20,0x3d,0x20,0x79,0x31,0x20,0x2a,0x20,0x70,0x2e,0x77,0x20,0x2b,0x20,0x78,0x30,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x69,0x33,0x20,0x3d,0x20,0x79,0x31,0x20,0x2a,0x20,0x70,0x2e,0x77,0x20,0x2b,0x20,0x78,0x31,0x3b,0x0d,0x0a,0x69,0x6e,0x74,0x20,0x67,0x69,0x20,0x3d,0x20,0x67,0x79,0x20,0x2a,0x20,0x70,0x2e,0x77,0x20,0x2b,0x20,0x67,0x78,0x3b,0x0d,0x0a,0x0d,0x0a,0x66,0x6f,0x72,0x20,0x28,0x69,0x6e,0x74,0x20,0x7a,0x20,0x3d,0x20,0x30,0x3b,0x20,0x7a,0x20,0x3c,0x20,0x70,0x2e,0x63,0x3b,0x20,0x7a,0x2b,0x2b,0x29,0x0d,0x0a,0x7b,0x0d,0x0a,0x2f,0x2f,0x20,0x62,0x69,0x6c,0x69,0x6e,0x65,0x61,0x72,0x20,0x69,0x6e,0x74,0x65,0x72,0x70,0x6f,0x6c,0x61,0x74,0x65,0x0d,0x0a,0x61,0x66,0x70,0x20,0x76,0x30,0x20,0x3d,0x20,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x69,0x6d,0x61,0x67,0x65,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x69,0x30,0x29,0x3b,0x0d,0x0a,0x61,0x66,0x70,0x20,0x76,0x31,0x20,0x3d,0x20,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x69,0x6d,0x61,0x67,0x65,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x69,0x31,0x29,0x3b,0x0d,0x0a,0x61,0x66,0x70,0x20,0x76,0x32,0x20,0x3d,0x20,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x69,0x6d,0x61,0x67,0x65,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x69,0x32,0x29,0x3b,0x0d,0x0a,0x61,0x66,0x70,0x20,0x76,0x33,0x20,0x3d,0x20,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x6c,0x64,0x31,0x28,0x69,0x6d,0x61,0x67,0x65,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x69,0x33,0x29,0x3b,0x0d,0x0a,0x0d,0x0a,0x61,0x66,0x70,0x20,0x76,0x34,0x20,0x3d,0x20,0x76,0x30,0x20,0x2a,0x20,0x28,0x61,0x66,0x70,0x28,0x31,0x2e,0x66,0x29,0x20,0x2d,0x20,0x61,0x6c,0x70,0x68,0x61,0x29,0x20,0x2b,0x20,0x76,0x31,0x20,0x2a,0x20,0x61,0x6c,0x70,0x68,0x61,0x3b,0x0d,0x0a,0x61,0x66,0x70,0x20,0x76,0x35,0x20,0x3d,0x20,0x76,0x32,0x20,0x2a,0x20,0x28,0x61,0x66,0x70,0x28,0x31,0x2e,0x66,0x29,0x20,0x2d,0x20,0x61,0x6c,0x70,0x68,0x61,0x29,0x20,0x2b,0x20,0x76,0x33,0x20,0x2a,0x20,0x61,0x6c,0x70,0x68,0x61,0x3b,0x0d,0x0a,0x0d,0x0a,0x62,0x75,0x66,0x66,0x65,0x72,0x5f,0x73,0x74,0x31,0x28,0x74,0x6f,0x70,0x5f,0x62,0x6c,0x6f,0x62,0x5f,0x64,0x61,0x74,0x61,0x2c,0x20,0x67,0x69,0x2c,0x20,0x76,0x34,0x20,0x2a,0x20,0x28,0x61,0x66,0x70,0x28,0x31,0x2e,0x66,0x29,0x20,0x2d,0x20,0x62,0x65,0x74,0x61,0x29,0x20,0x2b,0x20,0x76,0x35,0x20,0x2a,0x20,0x62,0x65,0x74,0x61,0x29,0x3b,0x0d,0x0a,0x0d,0x0a,0x69,0x30,0x20,0x2b,0x3d,0x20,0x70,0x2e,0x63,0x73,0x74,0x65,0x70,0x3b,0x0d,0x0a,0x69,0x31,0x20,0x2b,0x3d,0x20,0x70,0x2e,0x63,0x73,0x74,0x65,0x70,0x3b,0x0d,0x0a,0x69,0x32,0x20,0x2b,0x3d,0x20,0x70,0x2e,0x63,0x73,0x74,0x65,0x70,0x3b,0x0d,0x0a,0x69,0x33,0x20,0x2b,0x3d,0x20,0x70,0x2e,0x63,0x73,0x74,0x65,0x70,0x3b,0x0d,0x0a,0x67,0x69,0x20,0x2b,0x3d,0x20,0x70,0x2e,0x63,0x73,0x74,0x65,0x70,0x3b,0x0d,0x0a,0x7d,0x0d,0x0a,0x7d,0x0d,0x0a };
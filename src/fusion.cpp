@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: MIT
+
+#include "fusion.h"
+
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+#include "param_graph.h"
+
+std::string fuse_warp(const std::string& param, int* fused)
+{
+    if (fused)
+        *fused = 0;
+
+    std::vector<ParamLayer> layers;
+    try
+    {
+        if (!parse_param(param, layers))
+            return param;
+    }
+    catch (const std::exception&)
+    {
+        return param;
+    }
+
+    const auto consumers{ param_consumers(layers) };
+
+    const auto single_consumer{ [&](const std::string& blob) -> const std::pair<size_t, size_t>* {
+        const auto it{ consumers.find(blob) };
+        return (it != consumers.end() && it->second.size() == 1) ? &it->second.front() : nullptr;
+        } };
+
+    const auto is_warp_flow{ [&](const std::pair<size_t, size_t>* consumer) {
+        return consumer && layers[consumer->first].type == "rife.Warp" && layers[consumer->first].inputs.size() == 2 &&
+            consumer->second == 1;
+        } };
+
+    int count{ 0 };
+
+    try
+    {
+        for (size_t i{ 0 }; i < layers.size(); ++i)
+        {
+            ParamLayer& interp{ layers[i] };
+
+            // bilinear, fixed output size
+            if (interp.removed || interp.type != "Interp" || interp.inputs.size() != 1 || interp.outputs.size() != 1 ||
+                interp.param_int(0, 0) != 2 || interp.param_int(5, 0) != 0)
+                continue;
+
+            std::vector<size_t> chain;
+            std::string flow{ interp.outputs[0] };
+            float flow_scale{ 1.0f };
+
+            const std::pair<size_t, size_t>* next{ single_consumer(flow) };
+            if (!next)
+                continue;
+
+            if (const ParamLayer& mul{ layers[next->first] }; mul.type == "BinaryOp" && mul.inputs.size() == 1 && mul.outputs.size() == 1 &&
+                mul.param_int(0, 0) == 2 && mul.param_int(1, 0) == 1)
+            {
+                chain.emplace_back(next->first);
+                flow_scale = mul.param_float(2, 0.0f);
+                flow = mul.outputs[0];
+                next = single_consumer(flow);
+                if (!next)
+                    continue;
+            }
+
+            std::vector<size_t> warps;
+
+            if (const ParamLayer& split{ layers[next->first] }; split.type == "Split")
+            {
+                chain.emplace_back(next->first);
+
+                for (const auto& output : split.outputs)
+                {
+                    const std::pair<size_t, size_t>* consumer{ single_consumer(output) };
+                    if (!is_warp_flow(consumer))
+                    {
+                        warps.clear();
+                        break;
+                    }
+
+                    warps.emplace_back(consumer->first);
+                }
+            }
+            else if (is_warp_flow(next))
+                warps.emplace_back(next->first);
+
+            if (warps.empty())
+                continue;
+
+            const std::string low_res_flow{ interp.inputs[0] };
+            const int align_corner{ interp.param_int(6, 0) };
+
+            for (const size_t c : chain)
+                layers[c].removed = true;
+
+            // the low resolution flow is split for the fused layers, otherwise it replaces the Interp output
+            std::vector<std::string> flows;
+            if (warps.size() > 1)
+            {
+                interp.type = "Split";
+                interp.name = "splitncnn_fused_" + interp.name;
+                interp.outputs.clear();
+                interp.params.clear();
+                for (size_t k{ 0 }; k < warps.size(); ++k)
+                    interp.outputs.emplace_back(std::format("{}_fused_{}", low_res_flow, k));
+
+                flows = interp.outputs;
+            }
+            else
+            {
+                interp.removed = true;
+                flows.emplace_back(low_res_flow);
+            }
+
+            for (size_t k{ 0 }; k < warps.size(); ++k)
+            {
+                ParamLayer& warp{ layers[warps[k]] };
+                warp.type = "rife.FusedWarp";
+                warp.inputs[1] = flows[k];
+                warp.params = { std::format("0={}", align_corner), std::format("1={:e}", flow_scale) };
+            }
+
+            count += static_cast<int>(warps.size());
+        }
+    }
+    catch (const std::exception&)
+    {
+        return param;
+    }
+
+    if (fused)
+        *fused = count;
+
+    return count ? write_param(layers) : param;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// load time rewrite of the ncnn param text of the RIFE networks
+
+#include <string>
+
+// Interp (bilinear) -> BinaryOp (mul by a scalar, optional) -> [Split] -> rife.Warp (flow input) chains become rife.FusedWarp layers
+// that sample the low resolution flow directly. Only chains whose intermediate blobs have no other consumer are fused.
+// The layers that are removed have no weights, the model file is read as before. Returns the param text unchanged when nothing
+// matches or it cannot be parsed.
+std::string fuse_warp(const std::string& param, int* fused = nullptr);
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: MIT
+
+#include "gpu_scheduler.h"
+
+#include <algorithm>
+#include <format>
+
+#include "trace.h"
+
+static int64_t now_us() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::mutex g_schedulers_mutex;
+static std::map<int, std::weak_ptr<GpuScheduler>> g_schedulers;
+
+std::shared_ptr<GpuScheduler> GpuScheduler::get(const int gpu_id, const int slots, const int batch)
+{
+    std::lock_guard lock(g_schedulers_mutex);
+
+    auto& weak_ref{ g_schedulers[gpu_id] };
+    std::shared_ptr<GpuScheduler> scheduler{ weak_ref.lock() };
+    if (!scheduler)
+    {
+        scheduler = std::make_shared<GpuScheduler>(slots, batch);
+        weak_ref = scheduler;
+    }
+
+    return scheduler;
+}
+
+std::string GpuScheduler::all_to_string(const bool reset)
+{
+    std::lock_guard lock(g_schedulers_mutex);
+
+    std::string s;
+    for (const auto& [gpu_id, weak_ref] : g_schedulers)
+    {
+        if (const auto scheduler{ weak_ref.lock() })
+        {
+            s += std::format("gpu {} ", gpu_id) + scheduler->to_string();
+            if (reset)
+                scheduler->reset();
+        }
+    }
+
+    return s;
+}
+
+GpuScheduler::GpuScheduler(const int slots, const int batch)
+    : free_slots(slots), slots(slots), batch(batch), since_us(now_us())
+{
+}
+
+GpuScheduler::Item* GpuScheduler::take(const void* model)
+{
+    if (queues.empty())
+        return nullptr;
+
+    // round robin over the clients, only the oldest item of a client can be taken
+    auto it{ queues.upper_bound(last_client) };
+    for (size_t i{ 0 }; i < queues.size(); ++i, ++it)
+    {
+        if (it == queues.end())
+            it = queues.begin();
+
+        if (Item* item{ it->second.front() }; !model || item->model == model)
+        {
+            last_client = it->first;
+            it->second.pop_front();
+            if (it->second.empty())
+                queues.erase(it);
+
+            depth.fetch_sub(1, std::memory_order_relaxed);
+            return item;
+        }
+    }
+
+    return nullptr;
+}
+
+void GpuScheduler::dispatch()
+{
+    bool granted{};
+
+    while (free_slots > 0)
+    {
+        Item* item{ take(nullptr) };
+        if (!item)
+            break;
+
+        item->granted = true;
+        --free_slots;
+        granted = true;
+    }
+
+    if (granted)
+        cv.notify_all();
+}
+
+void GpuScheduler::run(const void* client, const void* model, const std::function<void()>& work)
+{
+    const auto start{ std::chrono::steady_clock::now() };
+    Item item{ model, &work };
+
+    std::unique_lock lock(mutex);
+
+    queues[client].emplace_back(&item);
+    const int queued{ depth.fetch_add(1, std::memory_order_relaxed) + 1 };
+    if (queued > peak_depth.load(std::memory_order_relaxed))
+        peak_depth.store(queued, std::memory_order_relaxed);
+
+    dispatch();
+
+    {
+        trace::Scope scope{ "gpu queue wait" };
+        cv.wait(lock, [&] { return item.granted || item.done; });
+    }
+
+    wait.add(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+    if (item.done)
+    {
+        // run by the thread that held a slot
+        if (item.error)
+            std::rethrow_exception(item.error);
+
+        return;
+    }
+
+    lock.unlock();
+
+    const auto slot_start{ std::chrono::steady_clock::now() };
+    std::exception_ptr error;
+
+    try
+    {
+        work();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    items.fetch_add(1, std::memory_order_relaxed);
+    acquisitions.fetch_add(1, std::memory_order_relaxed);
+
+    // the queued work of the same model is run on this slot
+    for (int i{ 1 }; i < batch && !error; ++i)
+    {
+        lock.lock();
+        Item* next{ take(model) };
+        lock.unlock();
+
+        if (!next)
+            break;
+
+        try
+        {
+            (*next->work)();
+        }
+        catch (...)
+        {
+            next->error = std::current_exception();
+        }
+
+        items.fetch_add(1, std::memory_order_relaxed);
+
+        lock.lock();
+        next->done = true;
+        lock.unlock();
+        cv.notify_all();
+    }
+
+    busy_us.fetch_add(static_cast<uint64_t>(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - slot_start).count()),
+        std::memory_order_relaxed);
+
+    lock.lock();
+    ++free_slots;
+    dispatch();
+    lock.unlock();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+std::string GpuScheduler::to_string() const
+{
+    const double elapsed_us{ static_cast<double>(now_us() - since_us.load(std::memory_order_relaxed)) };
+    const uint64_t n{ items.load(std::memory_order_relaxed) };
+    const uint64_t s{ acquisitions.load(std::memory_order_relaxed) };
+
+    return std::format("scheduler: {} slots, {} items in {} slot acquisitions ({:.2f} items per slot), queue depth {} (peak {}), "
+        "queue wait mean {:.2f} ms (p99 < {:.2f} ms), utilisation {:.1f}%\n", slots, n, s, s ? static_cast<double>(n) / s : 0.0,
+        depth.load(std::memory_order_relaxed), peak_depth.load(std::memory_order_relaxed), wait.mean_ms(), wait.percentile_ms(99.0),
+        (elapsed_us > 0.0) ? busy_us.load(std::memory_order_relaxed) / (elapsed_us * slots) * 100.0 : 0.0);
+}
+
+void GpuScheduler::reset() noexcept
+{
+    since_us.store(now_us(), std::memory_order_relaxed);
+    busy_us.store(0, std::memory_order_relaxed);
+    items.store(0, std::memory_order_relaxed);
+    acquisitions.store(0, std::memory_order_relaxed);
+    peak_depth.store(depth.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    wait.reset();
+}
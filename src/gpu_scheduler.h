@@ -0,0 +1,66 @@
+#pragma once
+
+// per device scheduler of the GPU work of all RIFE instances
+// the slots (gpu_thread) are given to the instances in turn instead of to the first thread that wakes up, and a thread that holds a slot
+// also runs the queued work of the same model (up to gpu_batch items) before the slot is released
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "stats.h"
+
+class GpuScheduler
+{
+public:
+    // the scheduler of the device, created with slots and batch by the first instance that uses the device, the values of the later instances are ignored
+    static std::shared_ptr<GpuScheduler> get(const int gpu_id, const int slots, const int batch);
+    // the schedulers that are still used
+    static std::string all_to_string(const bool reset);
+
+    GpuScheduler(const int slots, const int batch);
+
+    // runs work on a slot of the device, client is the instance (fairness), model the RIFE object (work of the same model is batched)
+    void run(const void* client, const void* model, const std::function<void()>& work);
+
+    std::string to_string() const;
+    void reset() noexcept;
+
+private:
+    struct Item
+    {
+        const void* model;
+        const std::function<void()>* work;
+        bool granted{}; // the owner runs it on a slot
+        bool done{}; // run by another thread
+        std::exception_ptr error; // of the work run by another thread
+    };
+
+    // next queued item, the clients after last_client first; model=nullptr takes any model
+    Item* take(const void* model);
+    void dispatch();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<const void*, std::deque<Item*>> queues; // by client
+    const void* last_client{};
+    int free_slots;
+    const int slots;
+    const int batch;
+    std::atomic<int> depth{}; // queued items
+
+    std::atomic<int64_t> since_us; // start of the utilisation period
+    std::atomic<uint64_t> busy_us{}; // slot time of all slots
+    std::atomic<uint64_t> items{};
+    std::atomic<uint64_t> acquisitions{}; // slots given to a thread, not Vulkan submissions
+    std::atomic<int> peak_depth{};
+    LatencyHistogram wait; // time in the queue
+};
@@ -0,0 +1,283 @@
+#pragma once
+
+// CPU side loops shared by the plugin, the RIFE class and rife_bench
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace kernels
+{
+    // mean absolute difference of two float planes, from avs_core/filters/conditional/conditional_functions.cpp
+    inline double sad_plane(const float* c_plane, const ptrdiff_t c_pitch, const float* t_plane, const ptrdiff_t t_pitch, const int width,
+        const int height) noexcept
+    {
+        double accum{ 0.0 };
+
+        for (int y{ 0 }; y < height; ++y)
+        {
+            for (int x{ 0 }; x < width; ++x)
+                accum += std::abs(t_plane[x] - c_plane[x]);
+
+            c_plane += c_pitch;
+            t_plane += t_pitch;
+        }
+
+        return (accum / (static_cast<double>(height) * width));
+    }
+
+    // largest mean absolute difference of the block x block areas of two planes, every step-th pixel of every step-th row is
+    // sampled, scaled to 0..1 by peak
+    // unlike sad_plane a small moving area is not averaged away by the static rest of the frame
+    template <typename T>
+    double block_motion(const T* c_plane, const ptrdiff_t c_pitch, const T* t_plane, const ptrdiff_t t_pitch, const int width,
+        const int height, const double peak, const int block = 32, const int step = 2)
+    {
+        const int blocks_x{ (width + block - 1) / block };
+        std::vector<double> sums(blocks_x);
+        std::vector<int> counts(blocks_x);
+        double motion{ 0.0 };
+
+        for (int block_y{ 0 }; block_y < height; block_y += block)
+        {
+            std::fill(sums.begin(), sums.end(), 0.0);
+            std::fill(counts.begin(), counts.end(), 0);
+
+            for (int y{ block_y }; y < (std::min)(block_y + block, height); y += step)
+            {
+                const T* c_row{ c_plane + y * c_pitch };
+                const T* t_row{ t_plane + y * t_pitch };
+
+                for (int x{ 0 }; x < width; x += step)
+                {
+                    sums[x / block] += std::abs(static_cast<double>(t_row[x]) - static_cast<double>(c_row[x]));
+                    ++counts[x / block];
+                }
+            }
+
+            for (int i{ 0 }; i < blocks_x; ++i)
+                motion = (std::max)(motion, sums[i] / counts[i]);
+        }
+
+        return motion / peak;
+    }
+
+    struct Borders
+    {
+        int left;
+        int top;
+        int right;
+        int bottom;
+    };
+
+    // rows/columns at the edges of a plane whose samples are all within tolerance of the corner sample, top == height for a
+    // flat plane
+    template <typename T>
+    Borders detect_borders(const T* plane, const ptrdiff_t pitch, const int width, const int height, const double tolerance)
+    {
+        const auto flat{ [&](const double ref, const int x0, const int y0, const int x1, const int y1) {
+            for (int y{ y0 }; y < y1; ++y)
+            {
+                for (int x{ x0 }; x < x1; ++x)
+                {
+                    if (std::abs(static_cast<double>(plane[y * pitch + x]) - ref) > tolerance)
+                        return false;
+                }
+            }
+
+            return true;
+            } };
+
+        const double top_left{ static_cast<double>(plane[0]) };
+        const double bottom_right{ static_cast<double>(plane[(height - 1) * pitch + width - 1]) };
+        Borders b{};
+
+        while (b.top < height && flat(top_left, 0, b.top, width, b.top + 1))
+            ++b.top;
+        if (b.top == height)
+            return b;
+
+        // the corners can differ by less than 2 * tolerance, the borders can then cover the whole plane (noisy near flat frame)
+        while (b.bottom < height - b.top && flat(bottom_right, 0, height - 1 - b.bottom, width, height - b.bottom))
+            ++b.bottom;
+        while (b.bottom < height - b.top && b.left < width && flat(top_left, b.left, b.top, b.left + 1, height - b.bottom))
+            ++b.left;
+        while (b.bottom < height - b.top && b.right < width - b.left &&
+            flat(bottom_right, width - 1 - b.right, b.top, width - b.right, height - b.bottom))
+            ++b.right;
+
+        if (b.bottom == height - b.top || b.left == width || b.right == width - b.left)
+            return { 0, height, 0, 0 };
+
+        return b;
+    }
+
+    struct Rect
+    {
+        int left;
+        int top;
+        int width;
+        int height;
+    };
+
+    // bounding box of the tile x tile blocks of area with a sample whose absolute difference is above threshold, clamped to area,
+    // width == 0 when no block changed
+    // the largest difference is used instead of the mean, a small moving object (a cursor) changes its block too
+    template <typename T>
+    Rect dirty_rect(const T* c_plane, const ptrdiff_t c_pitch, const T* t_plane, const ptrdiff_t t_pitch, const Rect& area, const int tile,
+        const double threshold)
+    {
+        const int tiles_x{ (area.width + tile - 1) / tile };
+        std::vector<double> diffs(tiles_x);
+        int left{ tiles_x };
+        int right{ -1 };
+        int top{ -1 };
+        int bottom{ -1 };
+
+        for (int tile_y{ 0 }; tile_y * tile < area.height; ++tile_y)
+        {
+            const int y0{ area.top + tile_y * tile };
+            const int y1{ (std::min)(y0 + tile, area.top + area.height) };
+            std::fill(diffs.begin(), diffs.end(), 0.0);
+
+            for (int y{ y0 }; y < y1; ++y)
+            {
+                const T* c_row{ c_plane + y * c_pitch + area.left };
+                const T* t_row{ t_plane + y * t_pitch + area.left };
+
+                for (int x{ 0 }; x < area.width; ++x)
+                    diffs[x / tile] = (std::max)(diffs[x / tile], std::abs(static_cast<double>(t_row[x]) - static_cast<double>(c_row[x])));
+            }
+
+            for (int i{ 0 }; i < tiles_x; ++i)
+            {
+                if (diffs[i] <= threshold)
+                    continue;
+
+                left = (std::min)(left, i);
+                right = (std::max)(right, i);
+                if (top < 0)
+                    top = tile_y;
+                bottom = tile_y;
+            }
+        }
+
+        if (right < 0)
+            return { area.left, area.top, 0, 0 };
+
+        const int x0{ area.left + left * tile };
+        const int y0{ area.top + top * tile };
+
+        return { x0, y0, (std::min)(area.left + (right + 1) * tile, area.left + area.width) - x0,
+            (std::min)(area.top + (bottom + 1) * tile, area.top + area.height) - y0 };
+    }
+
+    inline float half_to_float(const uint16_t h) noexcept
+    {
+        const uint32_t sign{ static_cast<uint32_t>(h & 0x8000) << 16 };
+        uint32_t exponent{ static_cast<uint32_t>(h >> 10) & 0x1f };
+        uint32_t mantissa{ static_cast<uint32_t>(h) & 0x3ff };
+
+        if (exponent == 0)
+        {
+            if (mantissa == 0)
+                return std::bit_cast<float>(sign);
+
+            // subnormal
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            ++exponent;
+            mantissa &= 0x3ff;
+        }
+        else if (exponent == 31)
+            return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+
+        return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    // round to nearest even
+    inline uint16_t float_to_half(const float f) noexcept
+    {
+        const uint32_t x{ std::bit_cast<uint32_t>(f) };
+        const uint16_t sign{ static_cast<uint16_t>((x >> 16) & 0x8000) };
+        const uint32_t abs{ x & 0x7fffffff };
+
+        if (abs >= 0x7f800000)
+            return sign | 0x7c00 | ((abs > 0x7f800000) ? 0x200 : 0);
+        if (abs >= 0x477ff000)
+            return sign | 0x7c00;
+        if (abs < 0x38800000)
+        {
+            // subnormal or zero
+            const float v{ std::bit_cast<float>(abs) * 16777216.0f };
+            return sign | static_cast<uint16_t>(std::nearbyint(v));
+        }
+
+        const uint32_t rounded{ abs + 0xfff + ((abs >> 13) & 1) };
+        return sign | static_cast<uint16_t>((rounded - 0x38000000) >> 13);
+    }
+
+    // 64-bit hash of the bytes (murmur3 mixing), chained through h
+    inline uint64_t hash64(const void* data, size_t size, uint64_t h) noexcept
+    {
+        constexpr uint64_t k1{ 0x87c37b91114253d5ull };
+        constexpr uint64_t k2{ 0x4cf5ad432745937full };
+        const unsigned char* p{ static_cast<const unsigned char*>(data) };
+
+        for (; size >= 8; size -= 8, p += 8)
+        {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            h ^= std::rotl(w * k1, 31) * k2;
+            h = std::rotl(h, 27) * 5 + 0x52dce729;
+        }
+
+        uint64_t tail{};
+        std::memcpy(&tail, p, size);
+        h ^= std::rotl((tail ^ (static_cast<uint64_t>(size) << 56)) * k1, 31) * k2;
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+
+        return h;
+    }
+
+    // strided rows -> packed rows
+    inline void pack_plane(uint8_t* __restrict dst, const uint8_t* __restrict src, const ptrdiff_t src_stride, const size_t row_size,
+        const int height) noexcept
+    {
+        if (static_cast<ptrdiff_t>(row_size) == src_stride)
+        {
+            std::memcpy(dst, src, row_size * height);
+            return;
+        }
+
+        for (int y{ 0 }; y < height; ++y)
+            std::memcpy(dst + y * row_size, src + y * src_stride, row_size);
+    }
+
+    // postproc output (0..255) -> 0..1
+    inline void unscale_planes(const float* __restrict outR, const float* __restrict outG, const float* __restrict outB,
+        float* __restrict dstR, float* __restrict dstG, float* __restrict dstB, const int w, const int h, const ptrdiff_t dst_stride) noexcept
+    {
+        for (int y{ 0 }; y < h; ++y)
+        {
+            for (int x{ 0 }; x < w; ++x)
+            {
+                dstR[dst_stride * y + x] = outR[w * y + x] * (1 / 255.0f);
+                dstG[dst_stride * y + x] = outG[w * y + x] * (1 / 255.0f);
+                dstB[dst_stride * y + x] = outB[w * y + x] * (1 / 255.0f);
+            }
+        }
+    }
+}
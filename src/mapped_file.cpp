@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: MIT
+
+#include "mapped_file.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    const HANDLE file{ CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    // the view keeps the mapping alive
+    const HANDLE mapping{ CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+    CloseHandle(file);
+    if (!mapping)
+        return;
+
+    const void* view{ MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) };
+    CloseHandle(mapping);
+    if (!view)
+        return;
+
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+    const int fd{ open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0)
+    {
+        ::close(fd);
+        return;
+    }
+
+    void* view{ mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0) };
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return;
+
+    // the weights are read once, front to back
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+}
+
+MappedFile MappedFile::open_writable(const std::filesystem::path& path, const size_t size, const bool create_new)
+{
+    MappedFile m;
+
+#ifdef _WIN32
+    const HANDLE file{ CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        (create_new) ? CREATE_NEW : OPEN_ALWAYS, FILE_FLAG_RANDOM_ACCESS, nullptr) };
+    if (file == INVALID_HANDLE_VALUE)
+        return m;
+
+    LARGE_INTEGER file_size;
+    if (size)
+    {
+        file_size.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(file, file_size, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+        {
+            CloseHandle(file);
+            return m;
+        }
+    }
+    else if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return m;
+    }
+
+    const HANDLE mapping{ CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr) };
+    CloseHandle(file);
+    if (!mapping)
+        return m;
+
+    void* view{ MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0) };
+    CloseHandle(mapping);
+    if (!view)
+        return m;
+
+    m.data_ = static_cast<const unsigned char*>(view);
+    m.size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+    const int fd{ open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | ((create_new) ? O_EXCL : 0), 0644) };
+    if (fd < 0)
+        return m;
+
+    struct stat st;
+    if (size ? ftruncate(fd, static_cast<off_t>(size)) != 0 || fstat(fd, &st) : fstat(fd, &st) || st.st_size == 0)
+    {
+        ::close(fd);
+        return m;
+    }
+
+    void* view{ mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) };
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return m;
+
+    m.data_ = static_cast<const unsigned char*>(view);
+    m.size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    m.writable_ = true;
+    return m;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)), writable_(std::exchange(other.writable_, false))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        writable_ = std::exchange(other.writable_, false);
+    }
+
+    return *this;
+}
+
+void MappedFile::close() noexcept
+{
+    if (!data_)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+#else
+    munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+
+    data_ = nullptr;
+    size_ = 0;
+    writable_ = false;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// memory mapping of a whole file, the pages are shared with every other process that maps the same file
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+class MappedFile
+{
+public:
+    MappedFile() noexcept = default;
+    // read-only
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    // read-write, the file is created when it's missing and resized to size bytes (zero filled) when size != 0
+    // create_new fails when the file exists
+    static MappedFile open_writable(const std::filesystem::path& path, const size_t size = 0, const bool create_new = false);
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false if the file cannot be opened or mapped, or it's empty
+    bool is_open() const noexcept
+    {
+        return data_ != nullptr;
+    }
+
+    // page aligned
+    const unsigned char* data() const noexcept
+    {
+        return data_;
+    }
+
+    // nullptr for a read-only mapping
+    unsigned char* writable_data() noexcept
+    {
+        return writable_ ? const_cast<unsigned char*>(data_) : nullptr;
+    }
+
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+
+private:
+    void close() noexcept;
+
+    const unsigned char* data_{};
+    size_t size_{};
+    bool writable_{};
+};
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: MIT
+
+#include "model_pack.h"
+
+#include <fstream>
+#include <sstream>
+
+bool ModelPackManifest::write(const std::filesystem::path& path) const
+{
+    std::ofstream ofs{ path, std::ios::trunc };
+    if (!ofs)
+        return false;
+
+    ofs << "rife_optimize " << version << '\n';
+    ofs << "generation " << generation << '\n';
+    ofs << "padding " << padding << '\n';
+    ofs << "fp16_weights " << fp16_weights << '\n';
+
+    for (const auto& source : sources)
+        ofs << "source " << source.name << ' ' << source.size << ' ' << source.mtime << '\n';
+    for (const auto& lifetime : lifetimes)
+        ofs << "lifetime " << lifetime.net << ' ' << lifetime.blob << ' ' << lifetime.first << ' ' << lifetime.last << '\n';
+
+    return static_cast<bool>(ofs);
+}
+
+std::optional<ModelPackManifest> ModelPackManifest::read(const std::filesystem::path& path)
+{
+    std::ifstream ifs{ path };
+    if (!ifs)
+        return std::nullopt;
+
+    ModelPackManifest manifest;
+    manifest.version = 0;
+
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        std::istringstream iss{ line };
+        std::string key;
+        iss >> key;
+
+        if (key == "rife_optimize")
+            iss >> manifest.version;
+        else if (key == "generation")
+            iss >> manifest.generation;
+        else if (key == "padding")
+            iss >> manifest.padding;
+        else if (key == "fp16_weights")
+            iss >> manifest.fp16_weights;
+        else if (key == "source")
+        {
+            Source source;
+            if (iss >> source.name >> source.size >> source.mtime)
+                manifest.sources.emplace_back(std::move(source));
+        }
+        else if (key == "lifetime")
+        {
+            Lifetime lifetime;
+            if (iss >> lifetime.net >> lifetime.blob >> lifetime.first >> lifetime.last)
+                manifest.lifetimes.emplace_back(std::move(lifetime));
+        }
+    }
+
+    if (manifest.version != current_version || manifest.padding < 1 || manifest.generation.empty())
+        return std::nullopt;
+
+    return manifest;
+}
+
+std::optional<ModelPackManifest::Source> model_pack_source(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    const uintmax_t size{ std::filesystem::file_size(path, ec) };
+    if (ec)
+        return std::nullopt;
+
+    const auto mtime{ std::filesystem::last_write_time(path, ec) };
+    if (ec)
+        return std::nullopt;
+
+    return ModelPackManifest::Source{ path.filename().string(), size,
+        static_cast<int64_t>(mtime.time_since_epoch().count()) };
+}
+
+std::optional<ModelPackManifest> find_model_pack(const std::filesystem::path& modeldir)
+{
+    auto manifest{ ModelPackManifest::read(modeldir / model_pack_dir / model_pack_manifest) };
+    if (!manifest || manifest->sources.empty())
+        return std::nullopt;
+
+    // a pack of older files is ignored
+    for (const auto& source : manifest->sources)
+    {
+        const auto current{ model_pack_source(modeldir / source.name) };
+        if (!current || current->size != source.size || current->mtime != source.mtime)
+            return std::nullopt;
+    }
+
+    return manifest;
+}
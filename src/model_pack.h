@@ -0,0 +1,49 @@
+#pragma once
+
+// pre-optimized copy of a model dir written by rife_optimize to <model dir>/optimized
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct ModelPackManifest
+{
+    static constexpr int current_version{ 1 };
+
+    struct Source
+    {
+        std::string name;
+        uintmax_t size;
+        int64_t mtime;
+    };
+
+    // first and last layer index of a blob in the optimized param
+    struct Lifetime
+    {
+        std::string net;
+        std::string blob;
+        int first;
+        int last;
+    };
+
+    int version{ current_version };
+    std::string generation; // v1, v2 (also rife-v3), v4
+    int padding{};
+    bool fp16_weights{};
+    std::vector<Source> sources; // files of the model dir the pack was made from
+    std::vector<Lifetime> lifetimes;
+
+    bool write(const std::filesystem::path& path) const;
+    static std::optional<ModelPackManifest> read(const std::filesystem::path& path);
+};
+
+inline constexpr const char* model_pack_dir{ "optimized" };
+inline constexpr const char* model_pack_manifest{ "manifest.txt" };
+
+// size and modification time of the file
+std::optional<ModelPackManifest::Source> model_pack_source(const std::filesystem::path& path);
+
+// the manifest of <modeldir>/optimized if it's present, has the current version and was made from the current files of modeldir
+std::optional<ModelPackManifest> find_model_pack(const std::filesystem::path& modeldir);
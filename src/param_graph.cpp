@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: MIT
+
+#include "param_graph.h"
+
+#include <format>
+#include <set>
+#include <sstream>
+
+static const std::string* find_param(const ParamLayer& layer, const int key)
+{
+    const std::string prefix{ std::to_string(key) + "=" };
+
+    for (const auto& param : layer.params)
+    {
+        if (param.starts_with(prefix))
+            return &param;
+    }
+
+    return nullptr;
+}
+
+int ParamLayer::param_int(const int key, const int def) const
+{
+    const std::string* param{ find_param(*this, key) };
+    return param ? std::stoi(param->substr(param->find('=') + 1)) : def;
+}
+
+float ParamLayer::param_float(const int key, const float def) const
+{
+    const std::string* param{ find_param(*this, key) };
+    return param ? std::stof(param->substr(param->find('=') + 1)) : def;
+}
+
+bool ParamLayer::has_param(const int key) const
+{
+    return find_param(*this, key) != nullptr;
+}
+
+void ParamLayer::set_param(const int key, const std::string& value)
+{
+    const std::string prefix{ std::to_string(key) + "=" };
+
+    for (auto& param : params)
+    {
+        if (param.starts_with(prefix))
+        {
+            param = prefix + value;
+            return;
+        }
+    }
+
+    params.emplace_back(prefix + value);
+}
+
+bool parse_param(const std::string& param, std::vector<ParamLayer>& layers)
+{
+    std::istringstream iss{ param };
+
+    int magic;
+    int layer_count;
+    int blob_count;
+    if (!(iss >> magic >> layer_count >> blob_count) || magic != 7767517 || layer_count < 0)
+        return false;
+
+    layers.resize(layer_count);
+
+    for (auto& layer : layers)
+    {
+        size_t input_count;
+        size_t output_count;
+        if (!(iss >> layer.type >> layer.name >> input_count >> output_count))
+            return false;
+
+        layer.inputs.resize(input_count);
+        layer.outputs.resize(output_count);
+        for (auto& input : layer.inputs)
+            iss >> input;
+        for (auto& output : layer.outputs)
+            iss >> output;
+
+        std::string rest;
+        std::getline(iss, rest);
+        std::istringstream params{ rest };
+        for (std::string p; params >> p;)
+            layer.params.emplace_back(std::move(p));
+
+        if (!iss)
+            return false;
+    }
+
+    return true;
+}
+
+std::string write_param(const std::vector<ParamLayer>& layers)
+{
+    std::set<std::string> blobs;
+    size_t layer_count{ 0 };
+
+    for (const auto& layer : layers)
+    {
+        if (layer.removed)
+            continue;
+
+        ++layer_count;
+        blobs.insert(layer.inputs.begin(), layer.inputs.end());
+        blobs.insert(layer.outputs.begin(), layer.outputs.end());
+    }
+
+    std::string s{ std::format("7767517\n{} {}\n", layer_count, blobs.size()) };
+
+    for (const auto& layer : layers)
+    {
+        if (layer.removed)
+            continue;
+
+        s += std::format("{} {} {} {}", layer.type, layer.name, layer.inputs.size(), layer.outputs.size());
+        for (const auto& input : layer.inputs)
+            s += " " + input;
+        for (const auto& output : layer.outputs)
+            s += " " + output;
+        for (const auto& param : layer.params)
+            s += " " + param;
+        s += "\n";
+    }
+
+    return s;
+}
+
+std::map<std::string, std::vector<std::pair<size_t, size_t>>> param_consumers(const std::vector<ParamLayer>& layers)
+{
+    std::map<std::string, std::vector<std::pair<size_t, size_t>>> consumers;
+
+    for (size_t i{ 0 }; i < layers.size(); ++i)
+    {
+        if (layers[i].removed)
+            continue;
+
+        for (size_t j{ 0 }; j < layers[i].inputs.size(); ++j)
+            consumers[layers[i].inputs[j]].emplace_back(i, j);
+    }
+
+    return consumers;
+}
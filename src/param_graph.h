@@ -0,0 +1,32 @@
+#pragma once
+
+// the text .param format of ncnn as a list of layers, used by the load time rewrites and rife_optimize
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ParamLayer
+{
+    std::string type;
+    std::string name;
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    std::vector<std::string> params; // key=value
+    bool removed;
+
+    int param_int(const int key, const int def) const;
+    float param_float(const int key, const float def) const;
+    bool has_param(const int key) const;
+    // replaces the value or appends the pair
+    void set_param(const int key, const std::string& value);
+};
+
+// false if the text is not a valid param file, may throw std::invalid_argument/std::out_of_range on malformed values
+bool parse_param(const std::string& param, std::vector<ParamLayer>& layers);
+// the layer and blob counts are recomputed, removed layers are skipped
+std::string write_param(const std::vector<ParamLayer>& layers);
+
+// blob -> (layer, input index) of the layers that are not removed
+std::map<std::string, std::vector<std::pair<size_t, size_t>>> param_consumers(const std::vector<ParamLayer>& layers);
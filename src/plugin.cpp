@@ -4,20 +4,35 @@
 
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
-#include <semaphore>
+#include <optional>
 #include <span>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "analysis_index.h"
 #include "avs_c_api_loader.hpp"
+#include "convert.h"
+#include "frame_cache.h"
+#include "gpu_scheduler.h"
+#include "kernels.h"
+#include "model_pack.h"
+#include "remote.h"
 #include "rife.h"
+#include "stats.h"
+#include "trace.h"
 
 #if defined(__linux__) || defined(__APPLE__)
 #include <mach-o/dyld.h>
@@ -25,12 +40,11 @@
 
 static std::atomic<int> numGPUInstances{ 0 };
 static std::mutex g_global_mutex;
-static std::unique_ptr<std::counting_semaphore<1024>> g_global_semaphore;
 
 struct ModelKey {
     std::string modelPath;
     int gpuId;
-    bool tta;
+    int tta_level;
     bool uhd;
     bool rife_v2;
     bool rife_v4;
@@ -41,11 +55,17 @@ struct ModelKey {
     int component_size;
     bool full_range;
     int bits_per_component;
+    bool fusion;
+    int tta_batch;
+    int vram_cap;
 
     auto operator<=>(const ModelKey&) const = default;
 };
 
 static std::map<ModelKey, std::weak_ptr<RIFE>> g_model_cache;
+static std::map<std::filesystem::path, std::weak_ptr<FrameCache>> g_frame_caches;
+// all instances since the plugin was loaded
+static FrameStats g_frame_stats;
 
 inline std::filesystem::path get_current_module_path()
 {
@@ -172,6 +192,94 @@ static constexpr std::array<std::tuple<int, std::string_view, int>, 74> models_n
 
 static constexpr auto map_models{ Map<int, std::string_view, int, 74>{ { models_num } } };
 
+// output_cache, the finished frames by output frame number, the least recently used frame is dropped when the cache is full
+struct OutputCache
+{
+    std::mutex mutex;
+    std::list<int> lru; // most recently used first
+    std::unordered_map<int, std::pair<avs_helpers::avs_video_frame_ptr, std::list<int>::iterator>> frames;
+    size_t capacity; // frames
+
+    // new reference to the frame n, null on a miss
+    avs_helpers::avs_video_frame_ptr get(const int n)
+    {
+        std::lock_guard lock(mutex);
+
+        const auto it{ frames.find(n) };
+        if (it == frames.end())
+            return nullptr;
+
+        lru.splice(lru.begin(), lru, it->second.second);
+
+        return avs_helpers::avs_video_frame_ptr{ g_avs_api->avs_copy_video_frame(it->second.first.get()) };
+    }
+
+    void put(const int n, AVS_VideoFrame* frame)
+    {
+        std::lock_guard lock(mutex);
+
+        if (frames.contains(n))
+            return;
+
+        if (frames.size() >= capacity)
+        {
+            frames.erase(lru.back());
+            lru.pop_back();
+        }
+
+        lru.emplace_front(n);
+        frames.emplace(n, std::make_pair(avs_helpers::avs_video_frame_ptr{ g_avs_api->avs_copy_video_frame(frame) }, lru.begin()));
+    }
+
+    bool contains(const int n)
+    {
+        std::lock_guard lock(mutex);
+        return frames.contains(n);
+    }
+};
+
+// lookahead, the interpolations of the next output frames run on a worker thread while the frames are requested in order.
+// get_frame fetches the source frames and makes the output frames on the thread of AviSynth, the worker only runs filter.
+struct LookaheadQueue
+{
+    struct Job
+    {
+        avs_helpers::avs_video_frame_ptr src0;
+        avs_helpers::avs_video_frame_ptr src1;
+        avs_helpers::avs_video_frame_ptr dst;
+        float timestep;
+        bool has_analysis;
+        RIFEAnalysis analysis;
+        RIFETimings timings{};
+        double active_area{ -1.0 };
+        bool cached{};
+        int ret{};
+        bool started{};
+        bool done{};
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<int, Job> jobs; // by output frame, queued, in progress or done
+    std::thread worker;
+    int frames;
+    int last_n{ -1 };
+    bool stop{};
+
+    ~LookaheadQueue()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stop = true;
+        }
+
+        cv.notify_all();
+
+        if (worker.joinable())
+            worker.join();
+    }
+};
+
 struct RIFEData
 {
     AVS_FilterInfo* fi;
@@ -181,20 +289,167 @@ struct RIFEData
     int64_t factorNum;
     int64_t factorDen;
     std::shared_ptr<RIFE> rife;
+    std::unique_ptr<RemoteRIFE> remote; // server, rife is not loaded
+    std::shared_ptr<GpuScheduler> scheduler; // shared by the instances of the device
     int oldNumFrames;
     int bf;
     int ff;
     float denoise_timestep;
     std::array<int, 3> planes;
     int src_comp_size;
+    bool gpu_analysis;
+    double motion_threshold; // 0=disabled
+    int motion_mode; // 0=blend, 1=nearest frame
+    int motion_plane; // luma, green for RGB
+    double sample_peak; // largest sample value, 1.0 for float
+    bool cropped;
+    kernels::Rect crop; // active area of the frames, the whole frame without crop_detect
+    int dirty_tile; // 0=disabled
+    int dirty_margin;
+    int padding;
+    int chroma_shift_w;
+    int chroma_shift_h;
+    std::unique_ptr<AnalysisIndex> analysis_index; // analysis_file
+    std::shared_ptr<FrameCache> frame_cache; // cache_dir, shared by the instances that use the same dir
+    uint64_t cache_seed; // model and options that change the interpolated frames
+    int cpu_threads;
+    std::unique_ptr<ConvertThreads> convert_threads; // cpu_thread workers of process_copy
+    bool profile;
+    FrameStats stats;
+    std::string stats_file;
+    AVS_GetFrame compute; // RIFE_get_frame<...> matching the arguments
+    std::unique_ptr<OutputCache> output_cache; // output_cache
+    std::unique_ptr<LookaheadQueue> lookahead; // lookahead
 };
 
-static void filter(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, AVS_VideoFrame* dst, const float timestep,
-    const RIFEData* const __restrict d) noexcept
+// bytes from the start of the plane i to the sample of the luma position (x, y)
+static AVS_FORCEINLINE ptrdiff_t plane_offset(const RIFEData* const __restrict d, const int i, const int x, const int y, const ptrdiff_t pitch)
+{
+    const int shift_w{ (i > 0) ? d->chroma_shift_w : 0 };
+    const int shift_h{ (i > 0) ? d->chroma_shift_h : 0 };
+
+    return (y >> shift_h) * pitch + static_cast<ptrdiff_t>(x >> shift_w) * d->src_comp_size;
+}
+
+// calls f with the model of the instance, in rife_server or in this process
+template <typename F>
+static AVS_FORCEINLINE void with_model(const RIFEData* const __restrict d, F&& f)
+{
+    if (d->remote)
+        f(*d->remote);
+    else
+        f(*d->rife);
+}
+
+// start and length of the span [start, end) aligned to align and grown to a multiple of padding with the samples around it,
+// inside [lo, hi)
+static std::pair<int, int> align_span(int start, int end, const int lo, const int hi, const int align, const int padding)
+{
+    start = start / align * align;
+    end = (end + align - 1) / align * align;
+
+    const int length{ (std::min)((end - start + padding - 1) / padding * padding, hi - lo) };
+    start = (std::max)(lo, start - (length - (end - start)) / 2 / align * align);
+
+    return { (std::min)(start, hi - length), length };
+}
+
+// the frame outside of area (borders of constant colour or static regions) is converted from src instead of being interpolated
+static void fill_outside(const AVS_VideoFrame* src, AVS_VideoFrame* dst, const kernels::Rect& area, const RIFEData* const __restrict d,
+    RIFETimings* timings)
+{
+    const int width{ d->fi->vi.width };
+    const int height{ d->fi->vi.height };
+    const int right{ area.left + area.width };
+    const int bottom{ area.top + area.height };
+    const size_t dst_stride{ g_avs_api->avs_get_pitch_p(dst, AVS_PLANAR_R) / sizeof(float) };
+
+    // x, y, width, height
+    const std::array<std::array<int, 4>, 4> strips{ {
+        { 0, 0, width, area.top },
+        { 0, bottom, width, height - bottom },
+        { 0, area.top, area.left, area.height },
+        { right, area.top, width - right, area.height } } };
+
+    for (const auto& [x, y, w, h] : strips)
+    {
+        if (w == 0 || h == 0)
+            continue;
+
+        ptrdiff_t stride[3];
+        const uint8_t* src_p[3];
+
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            stride[i] = g_avs_api->avs_get_pitch_p(src, d->planes[i]);
+            src_p[i] = g_avs_api->avs_get_read_ptr_p(src, d->planes[i]) + plane_offset(d, i, x, y, stride[i]);
+        }
+
+        const size_t offset{ y * dst_stride + x };
+        with_model(d, [&](const auto& rife) {
+            rife.process_copy(src_p, reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_R)) + offset,
+                reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_G)) + offset,
+                reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_B)) + offset, w, h, stride, dst_stride,
+                d->convert_threads.get(), timings);
+            });
+    }
+}
+
+// bounding box of the tiles of the luma that changed between the frames, grown by dirty_margin and aligned like the crop,
+// width == 0 when nothing changed
+static kernels::Rect dirty_area(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, const RIFEData* const __restrict d)
+{
+    trace::Scope scope{ "dirty tiles" };
+
+    const int plane{ d->motion_plane };
+    const ptrdiff_t pitch0{ g_avs_api->avs_get_pitch_p(src0, plane) / d->src_comp_size };
+    const ptrdiff_t pitch1{ g_avs_api->avs_get_pitch_p(src1, plane) / d->src_comp_size };
+    const uint8_t* src0_p{ g_avs_api->avs_get_read_ptr_p(src0, plane) };
+    const uint8_t* src1_p{ g_avs_api->avs_get_read_ptr_p(src1, plane) };
+    const double threshold{ d->sample_peak * (1.0 / 255.0) };
+
+    const kernels::Rect dirty{ [&]() {
+        switch (d->src_comp_size)
+        {
+            case 1: return kernels::dirty_rect(src0_p, pitch0, src1_p, pitch1, d->crop, d->dirty_tile, threshold);
+            case 2: return kernels::dirty_rect(reinterpret_cast<const uint16_t*>(src0_p), pitch0, reinterpret_cast<const uint16_t*>(src1_p),
+                pitch1, d->crop, d->dirty_tile, threshold);
+            default: return kernels::dirty_rect(reinterpret_cast<const float*>(src0_p), pitch0, reinterpret_cast<const float*>(src1_p),
+                pitch1, d->crop, d->dirty_tile, threshold);
+        }
+        }() };
+
+    if (dirty.width == 0)
+        return dirty;
+
+    const kernels::Rect& c{ d->crop };
+    const auto [left, width] { align_span((std::max)(c.left, dirty.left - d->dirty_margin),
+        (std::min)(c.left + c.width, dirty.left + dirty.width + d->dirty_margin), c.left, c.left + c.width, 1 << d->chroma_shift_w,
+        d->padding) };
+    const auto [top, height] { align_span((std::max)(c.top, dirty.top - d->dirty_margin),
+        (std::min)(c.top + c.height, dirty.top + dirty.height + d->dirty_margin), c.top, c.top + c.height, 1 << d->chroma_shift_h,
+        d->padding) };
+
+    return { left, top, width, height };
+}
+
+// active_area is the interpolated part of the frame, 0 when nothing changed and src0 was copied
+// returns non-zero when rife_server failed
+static int interpolate(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, AVS_VideoFrame* dst, const float timestep,
+    const RIFEData* const __restrict d, RIFEAnalysis* analysis, RIFETimings* timings, double& active_area) noexcept
 {
     const auto& vi{ d->fi->vi };
-    const auto width{ g_avs_api->avs_get_row_size_p(src0, AVS_DEFAULT_PLANE) / d->src_comp_size };
-    const auto height{ g_avs_api->avs_get_height_p(src0, AVS_DEFAULT_PLANE) };
+    const kernels::Rect area{ d->dirty_tile ? dirty_area(src0, src1, d) : d->crop };
+
+    if (area.width == 0)
+    {
+        fill_outside(src0, dst, area, d, timings);
+        active_area = 0.0;
+        return 0;
+    }
+
+    const auto width{ area.width };
+    const auto height{ area.height };
     const size_t dst_stride{ g_avs_api->avs_get_pitch_p(dst, AVS_DEFAULT_PLANE) / sizeof(float) };
 
     auto [src0_stride, src1_stride, src0_p, src1_p] {[&]() {
@@ -211,25 +466,112 @@ static void filter(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, AVS_V
             const auto& plane{ d->planes };
             res.src0_stride[i] = g_avs_api->avs_get_pitch_p(src0, plane[i]);
             res.src1_stride[i] = g_avs_api->avs_get_pitch_p(src1, plane[i]);
-            res.src0_p[i] = g_avs_api->avs_get_read_ptr_p(src0, plane[i]);
-            res.src1_p[i] = g_avs_api->avs_get_read_ptr_p(src1, plane[i]);
+            res.src0_p[i] = g_avs_api->avs_get_read_ptr_p(src0, plane[i]) +
+                plane_offset(d, i, area.left, area.top, res.src0_stride[i]);
+            res.src1_p[i] = g_avs_api->avs_get_read_ptr_p(src1, plane[i]) +
+                plane_offset(d, i, area.left, area.top, res.src1_stride[i]);
         }
 
         return res;
         }()
         };
 
-    auto dstR{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_R)) };
-    auto dstG{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_G)) };
-    auto dstB{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_B)) };
+    const size_t dst_offset{ area.top * dst_stride + area.left };
+    auto dstR{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_R)) + dst_offset };
+    auto dstG{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_G)) + dst_offset };
+    auto dstB{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_B)) + dst_offset };
+
+    const auto process{ [&](const auto& rife) {
+        return rife.process(src0_p, src1_p, dstR, dstG, dstB, width, height, src0_stride, src1_stride, dst_stride, timestep, analysis,
+            timings);
+        } };
 
-    if (g_global_semaphore)
-        g_global_semaphore->acquire();
+    // the server schedules the calls of all its clients
+    if (d->remote)
+    {
+        if (const int ret{ process(*d->remote) })
+            return ret;
+    }
+    else
+        d->scheduler->run(d, d->rife.get(), [&] { process(*d->rife); });
 
-    d->rife->process(src0_p, src1_p, dstR, dstG, dstB, width, height, src0_stride, src1_stride, dst_stride, timestep);
+    if (d->cropped || d->dirty_tile)
+        fill_outside(src0, dst, area, d, timings);
 
-    if (g_global_semaphore)
-        g_global_semaphore->release();
+    active_area = static_cast<double>(width) * height / (static_cast<double>(vi.width) * vi.height);
+    return 0;
+}
+
+// the source frames and the timestep, chained to the options of the instance (cache_seed)
+static uint64_t frame_key(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, const float timestep, const RIFEData* const __restrict d)
+{
+    trace::Scope scope{ "frame key" };
+    uint64_t h{ d->cache_seed };
+
+    for (const AVS_VideoFrame* frame : { src0, src1 })
+    {
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            const uint8_t* src_p{ g_avs_api->avs_get_read_ptr_p(frame, d->planes[i]) };
+            const ptrdiff_t pitch{ g_avs_api->avs_get_pitch_p(frame, d->planes[i]) };
+            const int row_size{ g_avs_api->avs_get_row_size_p(frame, d->planes[i]) };
+
+            for (int y{ 0 }; y < g_avs_api->avs_get_height_p(frame, d->planes[i]); ++y)
+                h = kernels::hash64(src_p + y * pitch, row_size, h);
+        }
+    }
+
+    return kernels::hash64(&timestep, sizeof(timestep), h);
+}
+
+// interpolate, with cache_dir the frame is looked up in and added to the disk cache, cached is set for a hit
+static int filter(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, AVS_VideoFrame* dst, const float timestep,
+    const RIFEData* const __restrict d, double& active_area, RIFEAnalysis* analysis = nullptr, RIFETimings* timings = nullptr,
+    bool* cached = nullptr) noexcept
+{
+    if (!d->frame_cache)
+        return interpolate(src0, src1, dst, timestep, d, analysis, timings, active_area);
+
+    const auto& vi{ d->fi->vi };
+    const uint64_t key{ frame_key(src0, src1, timestep, d) };
+    float* const planes[3]{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_R)),
+        reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_G)),
+        reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_B)) };
+    const ptrdiff_t stride{ g_avs_api->avs_get_pitch_p(dst, AVS_PLANAR_R) / static_cast<ptrdiff_t>(sizeof(float)) };
+
+    // the errors of the cache are misses
+    try
+    {
+        trace::Scope scope{ "frame cache get" };
+        if (d->frame_cache->get(key, planes, stride, vi.width, vi.height, active_area))
+        {
+            if (cached)
+                *cached = true;
+
+            return 0;
+        }
+    }
+    catch (...)
+    {
+    }
+
+    if (const int ret{ interpolate(src0, src1, dst, timestep, d, analysis, timings, active_area) })
+        return ret;
+
+    // the copies of static pairs are cheaper than the cache
+    if (active_area > 0.0)
+    {
+        try
+        {
+            trace::Scope scope{ "frame cache put" };
+            d->frame_cache->put(key, planes, stride, vi.width, vi.height, active_area);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    return 0;
 }
 
 /* multiplies and divides a rational number, such as a frame duration, in place and reduces the result */
@@ -260,31 +602,126 @@ static AVS_FORCEINLINE void muldivRational(unsigned* num, unsigned* den, int64_t
     *den /= static_cast<unsigned>(a);
 }
 
-// from avs_core/filters/conditional/conditional_functions.cpp
 static AVS_FORCEINLINE const double get_sad_c(const AVS_VideoFrame* src, const AVS_VideoFrame* src1)
 {
-    const size_t c_pitch{ g_avs_api->avs_get_pitch_p(src, AVS_DEFAULT_PLANE) / sizeof(float) };
-    const size_t t_pitch{ g_avs_api->avs_get_pitch_p(src1, AVS_DEFAULT_PLANE) / sizeof(float) };
-    const size_t width{ g_avs_api->avs_get_row_size_p(src, AVS_DEFAULT_PLANE) / sizeof(float) };
-    const int height{ g_avs_api->avs_get_height_p(src, AVS_DEFAULT_PLANE) };
-    const float* c_plane{ reinterpret_cast<const float*>(g_avs_api->avs_get_read_ptr_p(src, AVS_DEFAULT_PLANE)) };
-    const float* t_plane{ reinterpret_cast<const float*>(g_avs_api->avs_get_read_ptr_p(src1, AVS_DEFAULT_PLANE)) };
+    return kernels::sad_plane(reinterpret_cast<const float*>(g_avs_api->avs_get_read_ptr_p(src, AVS_DEFAULT_PLANE)),
+        g_avs_api->avs_get_pitch_p(src, AVS_DEFAULT_PLANE) / sizeof(float),
+        reinterpret_cast<const float*>(g_avs_api->avs_get_read_ptr_p(src1, AVS_DEFAULT_PLANE)),
+        g_avs_api->avs_get_pitch_p(src1, AVS_DEFAULT_PLANE) / sizeof(float),
+        g_avs_api->avs_get_row_size_p(src, AVS_DEFAULT_PLANE) / sizeof(float), g_avs_api->avs_get_height_p(src, AVS_DEFAULT_PLANE));
+}
+
+static double get_motion(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, const RIFEData* const __restrict d)
+{
+    const int plane{ d->motion_plane };
+    const int width{ g_avs_api->avs_get_row_size_p(src0, plane) / d->src_comp_size };
+    const int height{ g_avs_api->avs_get_height_p(src0, plane) };
+    const ptrdiff_t pitch0{ g_avs_api->avs_get_pitch_p(src0, plane) / d->src_comp_size };
+    const ptrdiff_t pitch1{ g_avs_api->avs_get_pitch_p(src1, plane) / d->src_comp_size };
+    const uint8_t* src0_p{ g_avs_api->avs_get_read_ptr_p(src0, plane) };
+    const uint8_t* src1_p{ g_avs_api->avs_get_read_ptr_p(src1, plane) };
+
+    switch (d->src_comp_size)
+    {
+        case 1: return kernels::block_motion(src0_p, pitch0, src1_p, pitch1, width, height, d->sample_peak);
+        case 2: return kernels::block_motion(reinterpret_cast<const uint16_t*>(src0_p), pitch0, reinterpret_cast<const uint16_t*>(src1_p),
+            pitch1, width, height, d->sample_peak);
+        default: return kernels::block_motion(reinterpret_cast<const float*>(src0_p), pitch0, reinterpret_cast<const float*>(src1_p),
+            pitch1, width, height, d->sample_peak);
+    }
+}
 
-    double accum{ 0.0 };
+// borders of constant colour, the smallest ones of 5 frames spread over the clip so that the active area doesn't change between
+// frames or scenes
+// the active area is aligned to the chroma subsampling and grown to a multiple of padding with the samples of the borders
+static void detect_crop(RIFEData* d, AVS_Clip* child, const int padding)
+{
+    const auto& vi{ d->fi->vi };
+    const int plane{ d->motion_plane };
+    const double tolerance{ d->sample_peak * (4.0 / 255.0) };
+    kernels::Borders crop{ vi.width, vi.height, vi.width, vi.height };
+    bool found{};
 
-    for (int y{ 0 }; y < height; ++y)
+    for (int i{ 0 }; i < 5; ++i)
     {
-        for (int x{ 0 }; x < width; ++x)
-            accum += std::abs(t_plane[x] - c_plane[x]);
+        const avs_helpers::avs_video_frame_ptr frame{ g_avs_api->avs_get_frame(child,
+            static_cast<int>(static_cast<int64_t>(d->oldNumFrames - 1) * i / 4)) };
+        if (!frame)
+            continue;
+
+        const uint8_t* src_p{ g_avs_api->avs_get_read_ptr_p(frame.get(), plane) };
+        const ptrdiff_t pitch{ g_avs_api->avs_get_pitch_p(frame.get(), plane) / d->src_comp_size };
+        const kernels::Borders b{ [&]() {
+            switch (d->src_comp_size)
+            {
+                case 1: return kernels::detect_borders(src_p, pitch, vi.width, vi.height, tolerance);
+                case 2: return kernels::detect_borders(reinterpret_cast<const uint16_t*>(src_p), pitch, vi.width, vi.height, tolerance);
+                default: return kernels::detect_borders(reinterpret_cast<const float*>(src_p), pitch, vi.width, vi.height, tolerance);
+            }
+            }() };
+
+        // flat frame, e.g. a fade to black
+        if (b.top == vi.height)
+            continue;
 
-        c_plane += c_pitch;
-        t_plane += t_pitch;
+        crop = { (std::min)(crop.left, b.left), (std::min)(crop.top, b.top), (std::min)(crop.right, b.right),
+            (std::min)(crop.bottom, b.bottom) };
+        found = true;
     }
 
-    return (accum / (height * width));
+    if (!found)
+        return;
+
+    const auto [left, width] { align_span(crop.left, vi.width - crop.right, 0, vi.width, 1 << d->chroma_shift_w, padding) };
+    const auto [top, height] { align_span(crop.top, vi.height - crop.bottom, 0, vi.height, 1 << d->chroma_shift_h, padding) };
+
+    if (width == vi.width && height == vi.height)
+        return;
+
+    d->cropped = true;
+    d->crop = { left, top, width, height };
 }
 
-static AVS_FORCEINLINE void copy_frame(const AVS_VideoFrame* src, AVS_VideoFrame* dst, const RIFEData* const __restrict d)
+// every row_step-th row of the luma (green for RGB) of frame
+static uint64_t luma_hash(const AVS_VideoFrame* frame, const RIFEData* const __restrict d, const int row_step, uint64_t h)
+{
+    const uint8_t* src_p{ g_avs_api->avs_get_read_ptr_p(frame, d->motion_plane) };
+    const int pitch{ g_avs_api->avs_get_pitch_p(frame, d->motion_plane) };
+    const int row_size{ g_avs_api->avs_get_row_size_p(frame, d->motion_plane) };
+
+    for (int y{ 0 }; y < g_avs_api->avs_get_height_p(frame, d->motion_plane); y += row_step)
+        h = AnalysisIndex::hash(src_p + y * static_cast<ptrdiff_t>(pitch), row_size, h);
+
+    return h;
+}
+
+// the properties of the clip and the luma of its first, middle and last frames
+static uint64_t source_hash(const RIFEData* const __restrict d, AVS_Clip* child)
+{
+    const auto& vi{ d->fi->vi };
+    const int64_t props[]{ vi.width, vi.height, vi.pixel_type, d->oldNumFrames };
+    uint64_t h{ AnalysisIndex::hash(props, sizeof(props)) };
+
+    for (const int n : { 0, (d->oldNumFrames - 1) / 2, d->oldNumFrames - 1 })
+    {
+        const avs_helpers::avs_video_frame_ptr frame{ g_avs_api->avs_get_frame(child, n) };
+        if (frame)
+            h = luma_hash(frame.get(), d, 1, h);
+    }
+
+    return h;
+}
+
+// the frames of an entry of analysis_file, 64 rows of the luma of both frames
+static uint64_t pair_hash(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, const RIFEData* const __restrict d)
+{
+    const int row_step{ (std::max)(d->fi->vi.height / 64, 1) };
+
+    return luma_hash(src1, d, row_step, luma_hash(src0, d, row_step, AnalysisIndex::hash(nullptr, 0)));
+}
+
+static AVS_FORCEINLINE void copy_frame(const AVS_VideoFrame* src, AVS_VideoFrame* dst, const RIFEData* const __restrict d,
+    RIFETimings* timings = nullptr)
 {
     auto [stride, src_p] {[&]() {
         struct result
@@ -312,55 +749,191 @@ static AVS_FORCEINLINE void copy_frame(const AVS_VideoFrame* src, AVS_VideoFrame
     const int height{ g_avs_api->avs_get_height_p(dst, AVS_PLANAR_R) };
     const size_t dst_stride{ g_avs_api->avs_get_pitch_p(dst, AVS_PLANAR_R) / sizeof(float) };
 
-    if (g_global_semaphore)
-        g_global_semaphore->acquire();
+    // no GPU work, the scheduler is not needed
+    with_model(d, [&](const auto& rife) {
+        rife.process_copy(src_p, dstR, dstG, dstB, width, height, stride, dst_stride, d->convert_threads.get(), timings);
+        });
+};
 
-    d->rife->process_copy(src_p, dstR, dstG, dstB, width, height, stride, dst_stride);
+// returns non-zero when rife_server failed
+static AVS_FORCEINLINE int avg_frame(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, AVS_VideoFrame* dst, const float weight,
+    const RIFEData* const __restrict d, RIFETimings* timings = nullptr)
+{
+    const auto width{ d->crop.width };
+    const auto height{ d->crop.height };
+    const size_t dst_stride{ g_avs_api->avs_get_pitch_p(dst, AVS_PLANAR_R) / sizeof(float) };
 
-    if (g_global_semaphore)
-        g_global_semaphore->release();
+    auto [src0_stride, src1_stride, src0_p, src1_p] {[&]() {
+        struct result
+        {
+            ptrdiff_t src0_stride[3];
+            ptrdiff_t src1_stride[3];
+            const uint8_t* src0_p[3];
+            const uint8_t* src1_p[3];
+        } res;
+
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            const auto& plane{ d->planes };
+            res.src0_stride[i] = g_avs_api->avs_get_pitch_p(src0, plane[i]);
+            res.src1_stride[i] = g_avs_api->avs_get_pitch_p(src1, plane[i]);
+            res.src0_p[i] = g_avs_api->avs_get_read_ptr_p(src0, plane[i]) +
+                plane_offset(d, i, d->crop.left, d->crop.top, res.src0_stride[i]);
+            res.src1_p[i] = g_avs_api->avs_get_read_ptr_p(src1, plane[i]) +
+                plane_offset(d, i, d->crop.left, d->crop.top, res.src1_stride[i]);
+        }
+
+        return res;
+        }()
+        };
+
+    const size_t dst_offset{ d->crop.top * dst_stride + d->crop.left };
+    auto dstR{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_R)) + dst_offset };
+    auto dstG{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_G)) + dst_offset };
+    auto dstB{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, AVS_PLANAR_B)) + dst_offset };
+
+    const auto process_blend{ [&](const auto& rife) {
+        return rife.process_blend(src0_p, src1_p, dstR, dstG, dstB, width, height, src0_stride, src1_stride, dst_stride, weight, timings);
+        } };
+
+    if (d->remote)
+    {
+        if (const int ret{ process_blend(*d->remote) })
+            return ret;
+    }
+    else
+        d->scheduler->run(d, d->rife.get(), [&] { process_blend(*d->rife); });
+
+    if (d->cropped)
+        fill_outside(src0, dst, d->crop, d, timings);
+
+    return 0;
 };
 
-static AVS_FORCEINLINE void avg_frame(const AVS_VideoFrame* src0, const AVS_VideoFrame* src1, AVS_VideoFrame* dst,
-    AVS_ScriptEnvironment* env, const RIFEData* const __restrict d)
+static AVS_FORCEINLINE AVS_VideoFrame* get_child_frame(AVS_Clip* child, const int n)
 {
-    const auto& vi{ d->fi->vi };
+    trace::Scope scope{ "child frame", n };
+    return g_avs_api->avs_get_frame(child, n);
+}
 
-    avs_helpers::avs_video_frame_ptr tmp0{ g_avs_api->avs_new_video_frame_p(env, &vi, dst) };
-    avs_helpers::avs_video_frame_ptr tmp1{ g_avs_api->avs_new_video_frame_p(env, &vi, dst) };
+static void lookahead_worker(RIFEData* d)
+{
+    LookaheadQueue& la{ *d->lookahead };
+    std::unique_lock lock(la.mutex);
 
-    copy_frame(src0, tmp0.get(), d);
-    copy_frame(src1, tmp1.get(), d);
+    while (true)
+    {
+        // the lowest frame first, it's requested first
+        auto it{ la.jobs.end() };
+        la.cv.wait(lock, [&] {
+            it = std::find_if(la.jobs.begin(), la.jobs.end(), [](const auto& item) { return !item.second.started; });
+            return la.stop || it != la.jobs.end();
+            });
+        if (la.stop)
+            return;
+
+        // a started job is not erased before it's done
+        LookaheadQueue::Job& job{ it->second };
+        job.started = true;
+
+        lock.unlock();
+        {
+            trace::Scope scope{ "lookahead frame", it->first };
+            job.ret = filter(job.src0.get(), job.src1.get(), job.dst.get(), job.timestep, d, job.active_area,
+                job.has_analysis ? &job.analysis : nullptr, d->profile ? &job.timings : nullptr, &job.cached);
+        }
+        lock.lock();
 
-    const size_t src_pitch0{ g_avs_api->avs_get_pitch_p(tmp0.get(), AVS_PLANAR_R) / sizeof(float) };
-    const size_t src_pitch1{ g_avs_api->avs_get_pitch_p(tmp1.get(), AVS_PLANAR_R) / sizeof(float) };
-    const size_t dst_pitch{ g_avs_api->avs_get_pitch_p(dst, AVS_PLANAR_R) / sizeof(float) };
-    const size_t width{ g_avs_api->avs_get_row_size_p(tmp0.get(), AVS_PLANAR_R) / sizeof(float) };
-    const int height{ g_avs_api->avs_get_height_p(tmp0.get(), AVS_PLANAR_R) };
+        job.done = true;
+        la.cv.notify_all();
+    }
+}
 
-    constexpr int planes[3]{ AVS_PLANAR_R, AVS_PLANAR_G, AVS_PLANAR_B };
+// drops the jobs that will not be requested and, when n follows the previous request, queues the interpolations of
+// n + 1 .. n + lookahead, analysis is the analysis of gpu_analysis (null without it)
+static void lookahead_schedule(AVS_FilterInfo* fi, RIFEData* d, const int n, const RIFEAnalysis* analysis)
+{
+    LookaheadQueue& la{ *d->lookahead };
+    std::vector<int> frames;
 
-    for (int i{ 0 }; i < 3; ++i)
     {
-        const float* srcp0{ reinterpret_cast<const float*>(g_avs_api->avs_get_read_ptr_p(tmp0.get(), planes[i])) };
-        const float* srcp1{ reinterpret_cast<const float*>(g_avs_api->avs_get_read_ptr_p(tmp1.get(), planes[i])) };
-        float* __restrict dstp{ reinterpret_cast<float*>(g_avs_api->avs_get_write_ptr_p(dst, planes[i])) };
+        std::lock_guard lock(la.mutex);
 
-        for (int y{ 0 }; y < height; ++y)
-        {
-            for (int x{ 0 }; x < width; ++x)
-                dstp[x] = (srcp0[x] + srcp1[x]) * 0.5f;
+        const bool sequential{ n == la.last_n + 1 };
+        la.last_n = n;
 
-            srcp0 += src_pitch0;
-            srcp1 += src_pitch1;
-            dstp += dst_pitch;
+        std::erase_if(la.jobs, [&](const auto& item) {
+            return (item.first < n || item.first > n + la.frames || !sequential) && (!item.second.started || item.second.done);
+            });
+
+        if (!sequential)
+            return;
+
+        for (int i{ n + 1 }; i <= n + la.frames && i < fi->vi.num_frames - d->factor; ++i)
+        {
+            if (i * d->factorDen % d->factorNum != 0 && !la.jobs.contains(i) && !(d->output_cache && d->output_cache->contains(i)))
+                frames.emplace_back(i);
         }
     }
-};
+
+    if (frames.empty())
+        return;
+
+    for (const int i : frames)
+    {
+        const int frameNum{ static_cast<int>(i * d->factorDen / d->factorNum) };
+
+        LookaheadQueue::Job job{};
+        job.src0.reset(get_child_frame(fi->child, frameNum));
+        job.src1.reset(get_child_frame(fi->child, frameNum + 1));
+        if (!job.src0 || !job.src1)
+            break;
+
+        job.dst.reset(g_avs_api->avs_new_video_frame_p(fi->env, &fi->vi, job.src0.get()));
+        job.timestep = static_cast<float>(i * d->factorDen % d->factorNum) / d->factorNum;
+        job.has_analysis = analysis != nullptr;
+        if (analysis)
+            job.analysis = *analysis;
+
+        std::lock_guard lock(la.mutex);
+        la.jobs.try_emplace(i, std::move(job));
+    }
+
+    la.cv.notify_all();
+}
+
+// the job of n when the worker started it, after it's done, nullopt otherwise (the frame is made by the caller)
+static std::optional<LookaheadQueue::Job> lookahead_take(RIFEData* d, const int n)
+{
+    LookaheadQueue& la{ *d->lookahead };
+    std::unique_lock lock(la.mutex);
+
+    const auto it{ la.jobs.find(n) };
+    if (it == la.jobs.end())
+        return std::nullopt;
+
+    if (!it->second.started)
+    {
+        la.jobs.erase(it);
+        return std::nullopt;
+    }
+
+    {
+        trace::Scope scope{ "lookahead wait", n };
+        la.cv.wait(lock, [&] { return it->second.done; });
+    }
+
+    std::optional<LookaheadQueue::Job> job{ std::move(it->second) };
+    la.jobs.erase(it);
+
+    return job;
+}
 
 template <bool sc, bool sc1, bool skip, bool denoise>
 static AVS_VideoFrame* AVSC_CC RIFE_get_frame(AVS_FilterInfo* fi, int n)
 {
+    trace::Scope scope{ "get_frame", n };
+    const auto start{ std::chrono::steady_clock::now() };
     RIFEData* d{ static_cast<RIFEData*>(fi->user_data) };
 
     auto frameNum{ (denoise) ? n : static_cast<int>(n * d->factorDen / d->factorNum) };
@@ -370,12 +943,19 @@ static AVS_VideoFrame* AVSC_CC RIFE_get_frame(AVS_FilterInfo* fi, int n)
     const auto& child{ fi->child };
     const auto& vi{ fi->vi };
 
-    const avs_helpers::avs_video_frame_ptr src0{ g_avs_api->avs_get_frame(child, (denoise) ? (std::max)(frameNum - d->bf, 0) : frameNum) };
+    const avs_helpers::avs_video_frame_ptr src0{ get_child_frame(child, (denoise) ? (std::max)(frameNum - d->bf, 0) : frameNum) };
     if (!src0)
         return nullptr;
 
     avs_helpers::avs_video_frame_ptr dst{ g_avs_api->avs_new_video_frame_p(env, &vi, src0.get()) };
 
+    RIFETimings timings{};
+    RIFETimings* const t{ d->profile ? &timings : nullptr };
+    FramePath path{ FramePath::copied };
+    double motion{ -1.0 };
+    double active_area{ -1.0 };
+    bool cached{};
+
     const auto set_error{ [&](std::string_view s) {
         fi->error = g_avs_api->avs_save_string(env, s.data(), static_cast<int>(s.size()));
 
@@ -384,105 +964,195 @@ static AVS_VideoFrame* AVSC_CC RIFE_get_frame(AVS_FilterInfo* fi, int n)
 
     if constexpr (!denoise)
     {
-        if (remainder != 0 && n < vi.num_frames - d->factor)
+        const RIFEAnalysis gpu_analysis{ sc || sc1, sc1, skip, static_cast<float>(d->sc_threshold), static_cast<float>(d->skipThreshold) };
+
+        if (d->lookahead)
+            lookahead_schedule(fi, d, n, d->gpu_analysis ? &gpu_analysis : nullptr);
+
+        // filter, or the frame that the lookahead worker interpolated
+        const auto interpolate_pair{ [&](const AVS_VideoFrame* src1, RIFEAnalysis* analysis) {
+            if (d->lookahead)
+            {
+                if (auto job{ lookahead_take(d, n) })
+                {
+                    dst = std::move(job->dst);
+                    active_area = job->active_area;
+                    cached = job->cached;
+                    timings = job->timings;
+                    if (analysis)
+                        *analysis = job->analysis;
+
+                    return job->ret;
+                }
+            }
+
+            return filter(src0.get(), src1, dst.get(), static_cast<float>(remainder) / d->factorNum, d, active_area, analysis, t, &cached);
+            } };
+
+        const bool interpolate{ remainder != 0 && n < vi.num_frames - d->factor };
+        const avs_helpers::avs_video_frame_ptr src1_motion{ (interpolate && d->motion_threshold > 0.0) ?
+            get_child_frame(child, frameNum + 1) : nullptr };
+
+        if (src1_motion)
+        {
+            trace::Scope scope{ "analysis motion", n };
+            motion = get_motion(src0.get(), src1_motion.get(), d);
+        }
+
+        if (src1_motion && motion < d->motion_threshold)
+        {
+            // the pair differs by less than the noise floor, no inference
+            const float timestep{ static_cast<float>(remainder) / d->factorNum };
+
+            if (d->motion_mode == 0)
+            {
+                if (avg_frame(src0.get(), src1_motion.get(), dst.get(), timestep, d, t))
+                    return set_error("RIFE: rife_server failed.");
+            }
+            else
+                copy_frame((timestep < 0.5f) ? src0.get() : src1_motion.get(), dst.get(), d, t);
+
+            path = FramePath::low_motion;
+        }
+        else if (interpolate && d->gpu_analysis)
+        {
+            // sc/sc1/skip are decided on the GPU together with the interpolation
+            RIFEAnalysis analysis{ gpu_analysis };
+
+            avs_helpers::avs_video_frame_ptr src1{ get_child_frame(child, frameNum + 1) };
+            if (interpolate_pair(src1.get(), &analysis))
+                return set_error("RIFE: rife_server failed.");
+
+            path = cached ? FramePath::cached : (active_area == 0.0) ? FramePath::skipped : (analysis.path == 0) ? FramePath::interpolated : (analysis.path == 1) ? FramePath::blended :
+                (analysis.skip && analysis.psnr >= analysis.skip_threshold) ? FramePath::skipped : FramePath::copied;
+        }
+        else if (interpolate)
         {
             bool sceneChange{};
             double psnrY{ -1.0 };
+            const avs_helpers::avs_video_frame_ptr src1{ get_child_frame(child, frameNum + 1) };
+            const uint64_t pair{ d->analysis_index ? pair_hash(src0.get(), src1.get(), d) : 0 };
 
             if constexpr (sc || sc1)
             {
-                AVS_Value cl;
-                g_avs_api->avs_set_to_clip(&cl, child);
-                avs_helpers::avs_value_guard cl_guard(cl);
-                AVS_Value args_[5]{ cl_guard.get(), avs_new_value_bool(false), avs_new_value_string("pc709"), avs_new_value_string("left"),
-                    avs_new_value_string("spline36") };
-                avs_helpers::avs_value_guard inv_guard{ g_avs_api->avs_invoke(env, "ConvertToYUV420", avs_new_value_array(args_, 5), 0) };
-                if (avs_is_error(inv_guard.get()))
-                    return set_error("RIFE: cannot convert to YUV420. (sc)");
-
-                if (d->src_comp_size != 4)
+                if (const auto cached{ d->analysis_index ? d->analysis_index->sad(frameNum, pair) : std::nullopt })
+                    sceneChange = *cached > d->sc_threshold;
+                else
                 {
-                    AVS_Value args1_[2]{ inv_guard.get(), avs_new_value_int(32) };
-                    inv_guard.reset(g_avs_api->avs_invoke(env, "ConvertBits", avs_new_value_array(args1_, 2), 0));
+                    trace::Scope scope{ "analysis sc", n };
+
+                    AVS_Value cl;
+                    g_avs_api->avs_set_to_clip(&cl, child);
+                    avs_helpers::avs_value_guard cl_guard(cl);
+                    AVS_Value args_[5]{ cl_guard.get(), avs_new_value_bool(false), avs_new_value_string("pc709"), avs_new_value_string("left"),
+                        avs_new_value_string("spline36") };
+                    avs_helpers::avs_value_guard inv_guard{ g_avs_api->avs_invoke(env, "ConvertToYUV420", avs_new_value_array(args_, 5), 0) };
                     if (avs_is_error(inv_guard.get()))
-                        return set_error("RIFE: cannot convert to YUV420 to 32-bit. (sc)");
-                }
+                        return set_error("RIFE: cannot convert to YUV420. (sc)");
 
-                avs_helpers::avs_clip_ptr abs{ g_avs_api->avs_take_clip(inv_guard.get(), env) };
+                    if (d->src_comp_size != 4)
+                    {
+                        AVS_Value args1_[2]{ inv_guard.get(), avs_new_value_int(32) };
+                        inv_guard.reset(g_avs_api->avs_invoke(env, "ConvertBits", avs_new_value_array(args1_, 2), 0));
+                        if (avs_is_error(inv_guard.get()))
+                            return set_error("RIFE: cannot convert to YUV420 to 32-bit. (sc)");
+                    }
 
-                avs_helpers::avs_video_frame_ptr abs_diff{ g_avs_api->avs_get_frame(abs.get(), frameNum) };
-                avs_helpers::avs_video_frame_ptr abs_diff1{ g_avs_api->avs_get_frame(abs.get(), frameNum + 1) };
-                sceneChange = get_sad_c(abs_diff.get(), abs_diff1.get()) > d->sc_threshold;
+                    avs_helpers::avs_clip_ptr abs{ g_avs_api->avs_take_clip(inv_guard.get(), env) };
+
+                    avs_helpers::avs_video_frame_ptr abs_diff{ g_avs_api->avs_get_frame(abs.get(), frameNum) };
+                    avs_helpers::avs_video_frame_ptr abs_diff1{ g_avs_api->avs_get_frame(abs.get(), frameNum + 1) };
+                    const double sad{ get_sad_c(abs_diff.get(), abs_diff1.get()) };
+                    if (d->analysis_index)
+                        d->analysis_index->set_sad(frameNum, pair, static_cast<float>(sad));
+
+                    sceneChange = sad > d->sc_threshold;
+                }
             }
 
             if constexpr (skip)
             {
-                // resized clip
-                AVS_Value cl;
-                g_avs_api->avs_set_to_clip(&cl, child);
-                avs_helpers::avs_value_guard cl_guard(cl);
-                AVS_Value args_[5]{ cl_guard.get(), avs_new_value_int((std::min)(vi.width, 512)),
-                    avs_new_value_int((std::min)(vi.height, 512)), avs_new_value_float(0.0), avs_new_value_float(0.5) };
-                avs_helpers::avs_value_guard inv_guard{ g_avs_api->avs_invoke(env, "BicubicResize", avs_new_value_array(args_, 5), 0) };
-                if (avs_is_error(inv_guard.get()))
-                    return set_error("RIFE: cannot resize. (skip)");
-
-                // yuv420
-                AVS_Value args1_[5]{ inv_guard.get(), avs_new_value_bool(false), avs_new_value_string("pc709"),
-                    avs_new_value_string("left"), avs_new_value_string("spline36") };
-                avs_helpers::avs_value_guard inv1_guard{ g_avs_api->avs_invoke(env, "ConvertToYUV420", avs_new_value_array(args1_, 5), 0) };
-                if (avs_is_error(inv1_guard.get()))
-                    return set_error("RIFE: cannot convert to YUV420. (skip)");
-
-                // 8-bit
-                AVS_Value args2_[7]{ inv1_guard.get(), avs_new_value_int(8), avs_new_value_bool(false), avs_new_value_int(-1),
-                    avs_new_value_int(8), avs_new_value_bool(true), avs_new_value_bool(false) };
-                avs_helpers::avs_value_guard src_8bit_guard{ g_avs_api->avs_invoke(env, "ConvertBits", avs_new_value_array(args2_, 7), 0) };
-                if (avs_is_error(src_8bit_guard.get()))
-                    return set_error("RIFE: cannot ConvertBits. (skip)");
-
-                // add frame at the end
-                AVS_Value args3_[2]{ src_8bit_guard.get(), avs_new_value_int(d->oldNumFrames - 1) };
-                inv_guard.reset(g_avs_api->avs_invoke(env, "DuplicateFrame", avs_new_value_array(args3_, 2), 0));
-                if (avs_is_error(inv_guard.get()))
-                    return set_error("RIFE: cannot DuplicateFrame. (skip)");
+                if (const auto cached{ d->analysis_index ? d->analysis_index->psnr(frameNum, pair) : std::nullopt })
+                    psnrY = *cached;
+                else
+                {
+                    trace::Scope scope{ "analysis skip", n };
+
+                    // resized clip
+                    AVS_Value cl;
+                    g_avs_api->avs_set_to_clip(&cl, child);
+                    avs_helpers::avs_value_guard cl_guard(cl);
+                    AVS_Value args_[5]{ cl_guard.get(), avs_new_value_int((std::min)(vi.width, 512)),
+                        avs_new_value_int((std::min)(vi.height, 512)), avs_new_value_float(0.0), avs_new_value_float(0.5) };
+                    avs_helpers::avs_value_guard inv_guard{ g_avs_api->avs_invoke(env, "BicubicResize", avs_new_value_array(args_, 5), 0) };
+                    if (avs_is_error(inv_guard.get()))
+                        return set_error("RIFE: cannot resize. (skip)");
+
+                    // yuv420
+                    AVS_Value args1_[5]{ inv_guard.get(), avs_new_value_bool(false), avs_new_value_string("pc709"),
+                        avs_new_value_string("left"), avs_new_value_string("spline36") };
+                    avs_helpers::avs_value_guard inv1_guard{ g_avs_api->avs_invoke(env, "ConvertToYUV420", avs_new_value_array(args1_, 5), 0) };
+                    if (avs_is_error(inv1_guard.get()))
+                        return set_error("RIFE: cannot convert to YUV420. (skip)");
+
+                    // 8-bit
+                    AVS_Value args2_[7]{ inv1_guard.get(), avs_new_value_int(8), avs_new_value_bool(false), avs_new_value_int(-1),
+                        avs_new_value_int(8), avs_new_value_bool(true), avs_new_value_bool(false) };
+                    avs_helpers::avs_value_guard src_8bit_guard{ g_avs_api->avs_invoke(env, "ConvertBits", avs_new_value_array(args2_, 7), 0) };
+                    if (avs_is_error(src_8bit_guard.get()))
+                        return set_error("RIFE: cannot ConvertBits. (skip)");
+
+                    // add frame at the end
+                    AVS_Value args3_[2]{ src_8bit_guard.get(), avs_new_value_int(d->oldNumFrames - 1) };
+                    inv_guard.reset(g_avs_api->avs_invoke(env, "DuplicateFrame", avs_new_value_array(args3_, 2), 0));
+                    if (avs_is_error(inv_guard.get()))
+                        return set_error("RIFE: cannot DuplicateFrame. (skip)");
 
-                // trim the first frme
-                AVS_Value args4_[3]{ inv_guard.get(), avs_new_value_int(1), avs_new_value_int(0) };
-                inv1_guard.reset(g_avs_api->avs_invoke(env, "Trim", avs_new_value_array(args4_, 3), 0));
-                if (avs_is_error(inv1_guard.get()))
-                    return set_error("RIFE: cannot Trim. (skip)");
+                    // trim the first frme
+                    AVS_Value args4_[3]{ inv_guard.get(), avs_new_value_int(1), avs_new_value_int(0) };
+                    inv1_guard.reset(g_avs_api->avs_invoke(env, "Trim", avs_new_value_array(args4_, 3), 0));
+                    if (avs_is_error(inv1_guard.get()))
+                        return set_error("RIFE: cannot Trim. (skip)");
 
-                // vmaf with n and n+1
-                AVS_Value args5_[3]{ src_8bit_guard.get(), inv1_guard.get(), avs_new_value_int(0) };
-                inv_guard.reset(g_avs_api->avs_invoke(env, "VMAF2", avs_new_value_array(args5_, 3), 0));
-                if (avs_is_error(inv_guard.get()))
-                    return set_error("VMAF2 is required. (skip)");
+                    // vmaf with n and n+1
+                    AVS_Value args5_[3]{ src_8bit_guard.get(), inv1_guard.get(), avs_new_value_int(0) };
+                    inv_guard.reset(g_avs_api->avs_invoke(env, "VMAF2", avs_new_value_array(args5_, 3), 0));
+                    if (avs_is_error(inv_guard.get()))
+                        return set_error("VMAF2 is required. (skip)");
 
-                avs_helpers::avs_clip_ptr psnr_clip{ g_avs_api->avs_take_clip(inv_guard.get(), env) };
+                    avs_helpers::avs_clip_ptr psnr_clip{ g_avs_api->avs_take_clip(inv_guard.get(), env) };
 
-                avs_helpers::avs_video_frame_ptr psnr{ g_avs_api->avs_get_frame(psnr_clip.get(), frameNum) };
-                psnrY = g_avs_api->avs_prop_get_float(env, g_avs_api->avs_get_frame_props_ro(env, psnr.get()), "psnr_y", 0, nullptr);
+                    avs_helpers::avs_video_frame_ptr psnr{ g_avs_api->avs_get_frame(psnr_clip.get(), frameNum) };
+                    psnrY = g_avs_api->avs_prop_get_float(env, g_avs_api->avs_get_frame_props_ro(env, psnr.get()), "psnr_y", 0,
+                        nullptr);
+                    if (d->analysis_index)
+                        d->analysis_index->set_psnr(frameNum, pair, static_cast<float>(psnrY));
+                }
             }
 
             if (sceneChange || psnrY >= d->skipThreshold)
             {
                 if constexpr (sc1)
                 {
-                    avs_helpers::avs_video_frame_ptr src1{ g_avs_api->avs_get_frame(child, frameNum + 1) };
-                    avg_frame(src0.get(), src1.get(), dst.get(), env, d);
+                    if (avg_frame(src0.get(), src1.get(), dst.get(), static_cast<float>(remainder) / d->factorNum, d, t))
+                        return set_error("RIFE: rife_server failed.");
+                    path = FramePath::blended;
                 }
                 else
-                    copy_frame(src0.get(), dst.get(), d);
+                {
+                    copy_frame(src0.get(), dst.get(), d, t);
+                    path = sceneChange ? FramePath::copied : FramePath::skipped;
+                }
             }
             else
             {
-                avs_helpers::avs_video_frame_ptr src1{ g_avs_api->avs_get_frame(child, frameNum + 1) };
-                filter(src0.get(), src1.get(), dst.get(), static_cast<float>(remainder) / d->factorNum, d);
+                if (interpolate_pair(src1.get(), nullptr))
+                    return set_error("RIFE: rife_server failed.");
+                path = cached ? FramePath::cached : (active_area == 0.0) ? FramePath::skipped : FramePath::interpolated;
             }
         }
         else
-            copy_frame(src0.get(), dst.get(), d);
+            copy_frame(src0.get(), dst.get(), d, t);
     }
     else
     {
@@ -492,6 +1162,8 @@ static AVS_VideoFrame* AVSC_CC RIFE_get_frame(AVS_FilterInfo* fi, int n)
 
         if constexpr (sc || sc1)
         {
+            trace::Scope scope{ "analysis sc", n };
+
             AVS_Value cl;
             g_avs_api->avs_set_to_clip(&cl, child);
             avs_helpers::avs_value_guard cl_guard(cl);
@@ -543,6 +1215,8 @@ static AVS_VideoFrame* AVSC_CC RIFE_get_frame(AVS_FilterInfo* fi, int n)
 
         if constexpr (skip)
         {
+            trace::Scope scope{ "analysis skip", n };
+
             // resized clip
             AVS_Value cl;
             g_avs_api->avs_set_to_clip(&cl, child);
@@ -676,18 +1350,26 @@ static AVS_VideoFrame* AVSC_CC RIFE_get_frame(AVS_FilterInfo* fi, int n)
         {
             if constexpr (sc1)
             {
-                avs_helpers::avs_video_frame_ptr src1{ g_avs_api->avs_get_frame(child, (std::min)(frameNum + d->ff,
+                avs_helpers::avs_video_frame_ptr src1{ get_child_frame(child, (std::min)(frameNum + d->ff,
                     (std::max)(vi.num_frames - 1, d->oldNumFrames - 1))) };
-                avg_frame(src0.get(), src1.get(), dst.get(), env, d);
+                if (avg_frame(src0.get(), src1.get(), dst.get(), d->denoise_timestep, d, t))
+                    return set_error("RIFE: rife_server failed.");
+                path = FramePath::blended;
             }
             else
-                copy_frame(g_avs_api->avs_get_frame(child, frameNum), dst.get(), d);
+            {
+                avs_helpers::avs_video_frame_ptr src{ get_child_frame(child, frameNum) };
+                copy_frame(src.get(), dst.get(), d, t);
+                path = sceneChange ? FramePath::copied : FramePath::skipped;
+            }
         }
         else
         {
-            avs_helpers::avs_video_frame_ptr src1{ g_avs_api->avs_get_frame(child, (std::min)(frameNum + d->ff,
+            avs_helpers::avs_video_frame_ptr src1{ get_child_frame(child, (std::min)(frameNum + d->ff,
                 (std::max)(vi.num_frames - 1, d->oldNumFrames - 1))) };
-            filter(src0.get(), src1.get(), dst.get(), d->denoise_timestep, d);
+            if (filter(src0.get(), src1.get(), dst.get(), d->denoise_timestep, d, active_area, nullptr, t, &cached))
+                return set_error("RIFE: rife_server failed.");
+            path = cached ? FramePath::cached : (active_area == 0.0) ? FramePath::skipped : FramePath::interpolated;
         }
     }
 
@@ -702,33 +1384,94 @@ static AVS_VideoFrame* AVSC_CC RIFE_get_frame(AVS_FilterInfo* fi, int n)
         g_avs_api->avs_prop_set_int(env, props, "_DurationDen", durationDen, 0);
     }
 
+    if (d->profile)
+    {
+        g_avs_api->avs_prop_set_float(env, props, "_RIFEUploadUs", timings.upload, 0);
+        g_avs_api->avs_prop_set_float(env, props, "_RIFEPreprocUs", timings.preproc, 0);
+        g_avs_api->avs_prop_set_float(env, props, "_RIFEInferUs", timings.infer, 0);
+        g_avs_api->avs_prop_set_float(env, props, "_RIFEPostprocUs", timings.postproc, 0);
+        g_avs_api->avs_prop_set_float(env, props, "_RIFEReadbackUs", timings.readback, 0);
+        g_avs_api->avs_prop_set_float(env, props, "_RIFEConvertUs", timings.convert, 0);
+        g_avs_api->avs_prop_set_int(env, props, "_RIFEPeakVRAM", static_cast<int64_t>(timings.peak_vram), 0);
+    }
+
+    if (d->profile || d->motion_threshold > 0.0)
+        g_avs_api->avs_prop_set_data(env, props, "_RIFEPath", frame_path_names[static_cast<int>(path)], -1, 0);
+    if (motion >= 0.0)
+        g_avs_api->avs_prop_set_float(env, props, "_RIFEMotion", motion, 0);
+    if (active_area >= 0.0 && (d->cropped || d->dirty_tile))
+        g_avs_api->avs_prop_set_float(env, props, "_RIFEActiveArea", active_area, 0);
+
+    const double elapsed{ std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() };
+    d->stats.add(path, elapsed);
+    g_frame_stats.add(path, elapsed);
+
     return dst.release();
 }
 
+static AVS_VideoFrame* AVSC_CC RIFE_get_frame_cached(AVS_FilterInfo* fi, int n)
+{
+    RIFEData* d{ static_cast<RIFEData*>(fi->user_data) };
+
+    avs_helpers::avs_video_frame_ptr frame{ d->output_cache->get(n) };
+    if (!frame)
+    {
+        frame.reset(d->compute(fi, n));
+
+        if (frame)
+            d->output_cache->put(n, frame.get());
+    }
+
+    return frame.release();
+}
+
 static void AVSC_CC free_RIFE(AVS_FilterInfo* fi)
 {
     auto d{ static_cast<RIFEData*>(fi->user_data) };
+    // the worker must be stopped before the model is released
+    d->lookahead.reset();
+
+    if (!d->stats_file.empty())
+    {
+        std::ofstream ofs{ d->stats_file };
+        ofs << d->stats.to_string();
+        if (d->rife)
+            ofs << d->rife->stats.to_string();
+        else if (d->remote)
+            ofs << d->remote->stats.to_string();
+    }
+
     delete d;
 
     if (--numGPUInstances == 0)
     {
+        trace::flush();
+
         std::lock_guard lock(g_global_mutex);
         g_model_cache.clear();
-        g_global_semaphore.reset();
         ncnn::destroy_gpu_instance();
     }
 }
 
 static int AVSC_CC RIFE_set_cache_hints(AVS_FilterInfo* fi, int cachehints, int frame_range)
 {
-    return cachehints == AVS_CACHE_GET_MTMODE ? 2 : 0;
+    switch (cachehints)
+    {
+        case AVS_CACHE_GET_MTMODE: return 2;
+        // the frames are kept by output_cache, the cache of AviSynth would only hold a second copy
+        case AVS_CACHE_DONT_CACHE_ME: return static_cast<RIFEData*>(fi->user_data)->output_cache != nullptr;
+        default: return 0;
+    }
 }
 
 static AVS_Value AVSC_CC Create_RIFE(AVS_ScriptEnvironment* env, AVS_Value args, void* param)
 {
     enum {
         Clip, Model, Factor_num, Factor_den, Fps_num, Fps_den, Model_path, Gpu_id, Gpu_thread, Tta, Uhd, Sc, Sc1, Sc_threshold, Skip,
-        Skip_threshold, List_gpu, Denoise, Denoise_tr, Matrinx_in, Full_range, Cache, Denoise_bf, Denoise_ff
+        Skip_threshold, List_gpu, Denoise, Denoise_tr, Matrinx_in, Full_range, Cache, Denoise_bf, Denoise_ff, Gpu_analysis,
+        Cpu_thread, Lookahead, Profile, Trace_file, Stats_file, Autotune, Autotune_file, Fusion, Tta_batch, Vram_cap, Tta_level,
+        Motion_threshold, Motion_mode, Crop_detect, Dirty_tile, Dirty_margin, Analysis_file,
+        Cache_dir, Cache_size, Output_cache, Gpu_batch, Server
     };
 
     auto d{ std::make_unique<RIFEData>() };
@@ -802,6 +1545,37 @@ static AVS_Value AVSC_CC Create_RIFE(AVS_ScriptEnvironment* env, AVS_Value args,
         const int skip{ avs_helpers::get_opt_arg<bool>(env, args, Skip).value_or(0) };
         d->skipThreshold = avs_helpers::get_opt_arg<float>(env, args, Skip_threshold).value_or(60.0);
 
+        const bool gpu_analysis{ avs_helpers::get_opt_arg<bool>(env, args, Gpu_analysis).value_or(false) };
+        d->cpu_threads = avs_helpers::get_opt_arg<int>(env, args, Cpu_thread).value_or(
+            (std::min)(4, (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()))));
+        const int lookahead{ avs_helpers::get_opt_arg<int>(env, args, Lookahead).value_or(0) };
+        d->profile = avs_helpers::get_opt_arg<bool>(env, args, Profile).value_or(false);
+        d->stats_file = avs_helpers::get_opt_arg<std::string>(env, args, Stats_file).value_or("");
+        const bool autotune{ avs_helpers::get_opt_arg<bool>(env, args, Autotune).value_or(false) };
+        std::string autotune_file{ avs_helpers::get_opt_arg<std::string>(env, args, Autotune_file).value_or("") };
+        const bool fusion{ avs_helpers::get_opt_arg<bool>(env, args, Fusion).value_or(true) };
+        const int tta_batch{ avs_helpers::get_opt_arg<int>(env, args, Tta_batch).value_or(8) };
+        const int vram_cap{ avs_helpers::get_opt_arg<int>(env, args, Vram_cap).value_or(0) };
+        const int tta_level{ avs_helpers::get_opt_arg<int>(env, args, Tta_level).value_or(tta ? 8 : 1) };
+        d->motion_threshold = avs_helpers::get_opt_arg<float>(env, args, Motion_threshold).value_or(0.0);
+        d->motion_mode = avs_helpers::get_opt_arg<int>(env, args, Motion_mode).value_or(0);
+        const bool crop_detect{ avs_helpers::get_opt_arg<bool>(env, args, Crop_detect).value_or(false) };
+        d->dirty_tile = avs_helpers::get_opt_arg<int>(env, args, Dirty_tile).value_or(0);
+        d->dirty_margin = avs_helpers::get_opt_arg<int>(env, args, Dirty_margin).value_or(64);
+        const std::string analysis_file{ avs_helpers::get_opt_arg<std::string>(env, args, Analysis_file).value_or("") };
+        const std::string cache_dir{ avs_helpers::get_opt_arg<std::string>(env, args, Cache_dir).value_or("") };
+        const int cache_size{ avs_helpers::get_opt_arg<int>(env, args, Cache_size).value_or(4096) };
+        const int output_cache{ avs_helpers::get_opt_arg<int>(env, args, Output_cache).value_or(0) };
+        const int gpu_batch{ avs_helpers::get_opt_arg<int>(env, args, Gpu_batch).value_or(1) };
+        std::string server{ avs_helpers::get_opt_arg<std::string>(env, args, Server).value_or("") };
+        if (const char* env_server{ std::getenv("RIFE_SERVER") }; server.empty() && env_server && *env_server)
+            server = env_server;
+
+        if (const auto trace_file{ avs_helpers::get_opt_arg<std::string>(env, args, Trace_file) }; trace_file && !trace_file->empty())
+            trace::start(*trace_file);
+        else if (const char* env_trace{ std::getenv("RIFE_TRACE") }; env_trace && *env_trace)
+            trace::start(env_trace);
+
         const int tr{ avs_helpers::get_opt_arg<int>(env, args, Denoise_tr).value_or(1) };
         d->bf = avs_helpers::get_opt_arg<int>(env, args, Denoise_bf).value_or(tr);
         d->ff = avs_helpers::get_opt_arg<int>(env, args, Denoise_ff).value_or(tr);
@@ -824,13 +1598,11 @@ static AVS_Value AVSC_CC Create_RIFE(AVS_ScriptEnvironment* env, AVS_Value args,
         if (auto queueCount{ ncnn::get_gpu_info(gpuId).compute_queue_count() }; gpuThread < 1 ||
             static_cast<uint32_t>(gpuThread) > queueCount)
             throw std::format("gpu_thread must be between 1 and {} (inclusive)", queueCount);
+        if (gpu_batch < 1 || gpu_batch > 64)
+            throw "gpu_batch must be between 1 and 64 (inclusive)";
 
-        {
-            std::lock_guard lock(g_global_mutex);
-            if (!g_global_semaphore) {
-                g_global_semaphore = std::make_unique<std::counting_semaphore<1024>>(gpuThread);
-            }
-        }
+        // the first instance of the device sets the slots and the batch size
+        d->scheduler = GpuScheduler::get(gpuId, gpuThread, gpu_batch);
 
         if (sceneChange && sceneChange1)
             throw ("both sc and sc1 cannot be  true in the same time");
@@ -848,11 +1620,44 @@ static AVS_Value AVSC_CC Create_RIFE(AVS_ScriptEnvironment* env, AVS_Value args,
             throw "denoise_bf must be at least 1";
         if (d->ff < 1)
             throw "denoise_ff must be at least 1";
+        if (tta_batch < 1 || tta_batch > 8)
+            throw "tta_batch must be between 1 and 8 (inclusive)";
+        if (vram_cap < 0)
+            throw "vram_cap must be greater than or equal to 0";
+        if (tta_level != 1 && tta_level != 2 && tta_level != 4 && tta_level != 8)
+            throw "tta_level must be 1, 2, 4 or 8";
+        if (d->motion_threshold < 0.0 || d->motion_threshold > 1.0)
+            throw "motion_threshold must be between 0.0 and 1.0 (inclusive)";
+        if (d->motion_mode < 0 || d->motion_mode > 1)
+            throw "motion_mode must be 0 or 1";
+        if (d->dirty_tile && (d->dirty_tile < 8 || d->dirty_tile > 512))
+            throw "dirty_tile must be 0 or between 8 and 512 (inclusive)";
+        if (d->dirty_margin < 0)
+            throw "dirty_margin must be greater than or equal to 0";
+        if (!analysis_file.empty() && (denoise || gpu_analysis))
+            throw "analysis_file cannot be used with denoise=true or gpu_analysis=true";
+        if (cache_size < 1)
+            throw "cache_size must be at least 1";
+        if (!cache_dir.empty() && gpu_analysis)
+            throw "cache_dir cannot be used with gpu_analysis=true";
+        if (output_cache < 0)
+            throw "output_cache must be at least 0";
+        if (gpu_analysis && denoise)
+            throw "gpu_analysis cannot be used with denoise=true";
+        if (d->cpu_threads < 1)
+            throw "cpu_thread must be at least 1";
+        if (lookahead < 0)
+            throw "lookahead must be at least 0";
+
+        d->gpu_analysis = gpu_analysis && (sceneChange || sceneChange1 || skip);
+        d->convert_threads = std::make_unique<ConvertThreads>(d->cpu_threads);
 
         d->denoise_timestep = static_cast<float>(d->bf) / (static_cast<float>(d->bf) + d->ff);
 
         d->planes = is_rgb ? decltype(d->planes){AVS_PLANAR_R, AVS_PLANAR_G, AVS_PLANAR_B}
         : decltype(d->planes){AVS_PLANAR_Y, AVS_PLANAR_U, AVS_PLANAR_V};
+        d->motion_plane = is_rgb ? AVS_PLANAR_G : AVS_PLANAR_Y;
+        d->crop = { 0, 0, vi.width, vi.height };
 
         if (fpsNum && fpsDen)
         {
@@ -892,18 +1697,24 @@ static AVS_Value AVSC_CC Create_RIFE(AVS_ScriptEnvironment* env, AVS_Value args,
             throw "failed to load model";
         ifs.close();
 
-        const bool rife_v2{ (modelPath.find("rife-v2") != std::string::npos) || (modelPath.find("rife-v3") != std::string::npos) };
-        const bool rife_v4{ (modelPath.find("rife-v4") != std::string::npos) || (modelPath.find("rife4") != std::string::npos) };
+        bool rife_v2{ (modelPath.find("rife-v2") != std::string::npos) || (modelPath.find("rife-v3") != std::string::npos) };
+        bool rife_v4{ (modelPath.find("rife-v4") != std::string::npos) || (modelPath.find("rife4") != std::string::npos) };
+        int padding{ (map_models.at(model)).second };
 
-        if (modelPath.find("rife") == std::string::npos)
+        // a pack written by rife_optimize knows the model generation and padding, the dir name can be anything
+        if (const auto pack{ find_model_pack(modelPath) })
+        {
+            rife_v2 = pack->generation == "v2";
+            rife_v4 = pack->generation == "v4";
+            padding = pack->padding;
+        }
+        else if (modelPath.find("rife") == std::string::npos)
             throw "unknown model dir type";
 
-        const int padding{ (map_models.at(model)).second };
-
         if (!rife_v4 && (d->factorNum != 2 || d->factorDen != 1))
             throw "only rife-v4 model supports custom frame rate";
 
-        if (rife_v4 && tta)
+        if (rife_v4 && tta_level > 1)
             throw "rife-v4 model does not support TTA mode";
 
         const bool is_yuv{ !is_rgb };
@@ -911,56 +1722,165 @@ static AVS_Value AVSC_CC Create_RIFE(AVS_ScriptEnvironment* env, AVS_Value args,
         const int m_in{ matrix_in ? *matrix_in : 1 };
         const int comp_size{ g_avs_api->avs_component_size(&vi) };
         const int bits{ g_avs_api->avs_bits_per_component(&vi) };
+        d->sample_peak = (comp_size == 4) ? 1.0 : static_cast<double>((1 << bits) - 1);
+        d->src_comp_size = comp_size;
+        d->chroma_shift_w = (chroma_subsampling == 1 || chroma_subsampling == 2) ? 1 : 0;
+        d->chroma_shift_h = (chroma_subsampling == 1) ? 1 : 0;
+
+        d->padding = padding;
 
-        if (const bool use_cache{ avs_helpers::get_opt_arg<bool>(env, args, Cache).value_or(true) })
+        if (!analysis_file.empty() && (sceneChange || sceneChange1 || skip))
         {
-            ModelKey key{ modelPath, gpuId, tta, uhd, rife_v2, rife_v4, padding, is_yuv, chroma_subsampling, m_in, comp_size,
-                static_cast<bool>(full_range), bits };
+            const AnalysisIndex::Source source{ source_hash(d.get(), fi->child), d->oldNumFrames, vi.width, vi.height, vi.pixel_type };
+            d->analysis_index = std::make_unique<AnalysisIndex>();
+            if (!d->analysis_index->open(analysis_file, source))
+                throw "cannot open analysis_file";
+        }
+
+        if (crop_detect)
+            detect_crop(d.get(), fi->child, padding);
+
+        if (!cache_dir.empty())
+        {
+            const int64_t options[]{ vi.width, vi.height, vi.pixel_type, tta_level, uhd, fusion, m_in, full_range, d->crop.left,
+                d->crop.top, d->crop.width, d->crop.height, d->dirty_tile, d->dirty_margin };
+            d->cache_seed = kernels::hash64(options, sizeof(options), kernels::hash64(modelPath.data(), modelPath.size(), 0));
+
+            std::lock_guard lock(g_global_mutex);
+            auto& weak_ref{ g_frame_caches[std::filesystem::absolute(cache_dir)] };
+            if (!(d->frame_cache = weak_ref.lock()))
+            {
+                d->frame_cache = std::make_shared<FrameCache>();
+                if (!d->frame_cache->open(cache_dir, static_cast<uint64_t>(cache_size) << 20))
+                    throw "cannot create cache_dir";
+
+                weak_ref = d->frame_cache;
+            }
+        }
+
+        if (autotune && autotune_file.empty())
+        {
+            const auto& info{ ncnn::get_gpu_info(gpuId) };
+            autotune_file = (get_current_module_path().parent_path() /
+                std::format("rife_autotune_{:04x}_{:04x}.txt", info.vendor_id(), info.device_id())).generic_string();
+        }
+
+        // only a new instance is tuned, a cached one keeps the local sizes of the first clip
+        const auto load_rife{ [&](RIFE& rife) {
+            if (rife.load(modelPath, fusion))
+                throw "failed to load model";
+            if (!autotune)
+                return;
+            if (const int ret{ rife.autotune(d->crop.width, d->crop.height, autotune_file) })
+                throw (ret > 0) ? "cannot write autotune_file" : "autotune failed";
+            } };
+
+        if (!server.empty())
+        {
+            if (server == "default")
+                server = remote::default_socket();
+
+            remote::Model remote_model{};
+            if (modelPath.size() >= sizeof(remote_model.path))
+                throw "model_path is too long for server";
+
+            std::copy(modelPath.begin(), modelPath.end(), remote_model.path);
+            remote_model.gpu_id = gpuId;
+            remote_model.tta_level = tta_level;
+            remote_model.padding = padding;
+            remote_model.chroma_subsampling = chroma_subsampling;
+            remote_model.matrix_in = m_in;
+            remote_model.bytes_per_comp = comp_size;
+            remote_model.bit_depth = bits;
+            remote_model.tta_batch = tta_batch;
+            remote_model.vram_cap = static_cast<uint64_t>(vram_cap) << 20;
+            remote_model.uhd = uhd;
+            remote_model.rife_v2 = rife_v2;
+            remote_model.rife_v4 = rife_v4;
+            remote_model.is_yuv = is_yuv;
+            remote_model.full_range = full_range;
+            remote_model.fusion = fusion;
+
+            // without a server the model is loaded in this process
+            d->remote = RemoteRIFE::connect(server, remote_model, vi.width, vi.height, gpuThread);
+        }
+
+        if (d->remote)
+        {
+            // the model is loaded by rife_server, autotune does not apply
+        }
+        else if (const bool use_cache{ avs_helpers::get_opt_arg<bool>(env, args, Cache).value_or(true) })
+        {
+            ModelKey key{ modelPath, gpuId, tta_level, uhd, rife_v2, rife_v4, padding, is_yuv, chroma_subsampling, m_in, comp_size,
+                static_cast<bool>(full_range), bits, fusion, tta_batch, vram_cap };
             {
+                trace::Scope scope{ "model cache" };
                 std::lock_guard lock(g_global_mutex);
                 auto& weak_ref{ g_model_cache[key] };
                 d->rife = weak_ref.lock();
                 if (!d->rife) {
-                    d->rife = std::make_shared<RIFE>(gpuId, tta, uhd, 1, rife_v2, rife_v4, padding, is_yuv, chroma_subsampling, m_in,
-                        comp_size, full_range, bits);
-                    d->rife->load(modelPath);
+                    d->rife = std::make_shared<RIFE>(gpuId, tta_level, uhd, 1, rife_v2, rife_v4, padding, is_yuv, chroma_subsampling, m_in,
+                        comp_size, full_range, bits, tta_batch, static_cast<uint64_t>(vram_cap) << 20);
+                    load_rife(*d->rife);
                     weak_ref = d->rife;
                 }
             }
         }
         else
         {
-            d->rife = std::make_shared<RIFE>(gpuId, tta, uhd, 1, rife_v2, rife_v4, padding, is_yuv, chroma_subsampling, m_in,
-                comp_size, full_range, bits);
-            d->rife->load(modelPath);
+            d->rife = std::make_shared<RIFE>(gpuId, tta_level, uhd, 1, rife_v2, rife_v4, padding, is_yuv, chroma_subsampling, m_in,
+                comp_size, full_range, bits, tta_batch, static_cast<uint64_t>(vram_cap) << 20);
+            load_rife(*d->rife);
         }
 
         if (sceneChange)
         {
             if (skip)
-                fi->get_frame = (denoise) ? RIFE_get_frame<true, false, true, true> : RIFE_get_frame<true, false, true, false>;
+                d->compute = (denoise) ? RIFE_get_frame<true, false, true, true> : RIFE_get_frame<true, false, true, false>;
             else
-                fi->get_frame = (denoise) ? RIFE_get_frame<true, false, false, true> : RIFE_get_frame<true, false, false, false>;
+                d->compute = (denoise) ? RIFE_get_frame<true, false, false, true> : RIFE_get_frame<true, false, false, false>;
         }
         else
         {
             if (sceneChange1)
             {
                 if (skip)
-                    fi->get_frame = (denoise) ? RIFE_get_frame<false, true, true, true> : RIFE_get_frame<false, true, true, false>;
+                    d->compute = (denoise) ? RIFE_get_frame<false, true, true, true> : RIFE_get_frame<false, true, true, false>;
                 else
-                    fi->get_frame = (denoise) ? RIFE_get_frame<false, true, false, true> : RIFE_get_frame<false, true, false, false>;
+                    d->compute = (denoise) ? RIFE_get_frame<false, true, false, true> : RIFE_get_frame<false, true, false, false>;
             }
             else
             {
                 if (skip)
-                    fi->get_frame = (denoise) ? RIFE_get_frame<false, false, true, true> : RIFE_get_frame<false, false, true, false>;
+                    d->compute = (denoise) ? RIFE_get_frame<false, false, true, true> : RIFE_get_frame<false, false, true, false>;
                 else
-                    fi->get_frame = (denoise) ? RIFE_get_frame<false, false, false, true> : RIFE_get_frame<false, false, false, false>;
+                    d->compute = (denoise) ? RIFE_get_frame<false, false, false, true> : RIFE_get_frame<false, false, false, false>;
             }
         }
 
-        d->src_comp_size = g_avs_api->avs_component_size(&vi);
+        if (output_cache > 0)
+        {
+            // RGBPS output
+            const uint64_t frame_size{ static_cast<uint64_t>(vi.width) * vi.height * 3 * sizeof(float) };
+
+            d->output_cache = std::make_unique<OutputCache>();
+            d->output_cache->capacity = (std::max)(static_cast<size_t>((static_cast<uint64_t>(output_cache) << 20) / frame_size), size_t{ 1 });
+        }
+
+        fi->get_frame = (d->output_cache) ? RIFE_get_frame_cached : d->compute;
+
+        if (lookahead > 0 && !denoise)
+        {
+            d->lookahead = std::make_unique<LookaheadQueue>();
+            d->lookahead->frames = lookahead;
+            d->lookahead->worker = std::thread(lookahead_worker, d.get());
+        }
+
+        // the source frames of an output frame stay in the cache of the child while its interpolated frames are made
+        // lookahead keeps also the source frames of the jobs of the next output frames
+        const int lookahead_sources{ static_cast<int>((static_cast<int64_t>(lookahead) * d->factorDen + d->factorNum - 1) / d->factorNum) };
+        g_avs_api->avs_set_cache_hints(fi->child, AVS_CACHE_WINDOW, ((denoise) ? d->bf + d->ff + 1 : 2) + lookahead_sources);
+
         vi.pixel_type = AVS_CS_RGBPS;
 
         g_avs_api->avs_set_to_clip(&v, clip.get());
@@ -983,6 +1903,32 @@ static AVS_Value AVSC_CC Create_RIFE(AVS_ScriptEnvironment* env, AVS_Value args,
     return v;
 }
 
+static AVS_Value AVSC_CC Create_RIFE_Stats(AVS_ScriptEnvironment* env, AVS_Value args, void* param)
+{
+    const bool reset{ avs_helpers::get_opt_arg<bool>(env, args, 0).value_or(false) };
+    std::string s{ g_frame_stats.to_string() };
+
+    {
+        std::lock_guard lock(g_global_mutex);
+        for (const auto& [key, weak_ref] : g_model_cache)
+        {
+            if (const auto rife{ weak_ref.lock() })
+            {
+                s += std::format("{} (gpu {}):\n", key.modelPath, key.gpuId) + rife->stats.to_string();
+                if (reset)
+                    rife->stats.reset();
+            }
+        }
+    }
+
+    s += GpuScheduler::all_to_string(reset);
+
+    if (reset)
+        g_frame_stats.reset();
+
+    return avs_new_value_string(g_avs_api->avs_save_string(env, s.c_str(), static_cast<int>(s.size())));
+}
+
 const char* AVSC_CC avisynth_c_plugin_init(AVS_ScriptEnvironment* env)
 {
     static constexpr int REQUIRED_INTERFACE_VERSION{ 9 };
@@ -1008,8 +1954,12 @@ const char* AVSC_CC avisynth_c_plugin_init(AVS_ScriptEnvironment* env)
         "avs_prop_set_int",
         "avs_prop_get_int",
         "avs_prop_get_float",
+        "avs_prop_set_float",
+        "avs_prop_set_data",
         "avs_new_video_frame_p",
-        "avs_get_frame_props_ro"
+        "avs_get_frame_props_ro",
+        "avs_copy_video_frame",
+        "avs_set_cache_hints"
     };
     static constexpr std::span<const std::string_view> required_functions{ required_functions_storage };
 
@@ -1043,7 +1993,31 @@ const char* AVSC_CC avisynth_c_plugin_init(AVS_ScriptEnvironment* env)
         "[full_range]b"
         "[cache]b"
         "[denoise_bf]i"
-        "[denoise_ff]i",
+        "[denoise_ff]i"
+        "[gpu_analysis]b"
+        "[cpu_thread]i"
+        "[lookahead]i"
+        "[profile]b"
+        "[trace_file]s"
+        "[stats_file]s"
+        "[autotune]b"
+        "[autotune_file]s"
+        "[fusion]b"
+        "[tta_batch]i"
+        "[vram_cap]i"
+        "[tta_level]i"
+        "[motion_threshold]f"
+        "[motion_mode]i"
+        "[crop_detect]b"
+        "[dirty_tile]i"
+        "[dirty_margin]i"
+        "[analysis_file]s"
+        "[cache_dir]s"
+        "[cache_size]i"
+        "[output_cache]i"
+        "[gpu_batch]i"
+        "[server]s",
         Create_RIFE, 0);
+    g_avs_api->avs_add_function(env, "RIFE_Stats", "[reset]b", Create_RIFE_Stats, 0);
     return "Real-Time Intermediate Flow Estimation for Video Frame Interpolation";
 }
@@ -0,0 +1,473 @@
+// SPDX-License-Identifier: MIT
+
+#include "remote.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <tuple>
+
+#include "convert.h"
+#include "trace.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE
+#endif
+#endif
+
+namespace remote
+{
+    static size_t align64(const size_t v) noexcept
+    {
+        return (v + 63) & ~size_t{ 63 };
+    }
+
+    static void plane_size(const int i, const int width, const int height, const int chroma_subsampling, int& w, int& h) noexcept
+    {
+        w = (i > 0 && (chroma_subsampling == 1 || chroma_subsampling == 2)) ? width / 2 : width;
+        h = (i > 0 && chroma_subsampling == 1) ? height / 2 : height;
+    }
+
+    Layout layout(const int width, const int height, const int bytes_per_comp, const int chroma_subsampling) noexcept
+    {
+        Layout l{};
+        size_t offset{ 0 };
+
+        for (auto* planes : { l.src0, l.src1 })
+        {
+            for (int i{ 0 }; i < 3; ++i)
+            {
+                int w, h;
+                plane_size(i, width, height, chroma_subsampling, w, h);
+                planes[i] = offset;
+                offset = align64(offset + static_cast<size_t>(w) * h * bytes_per_comp);
+            }
+        }
+
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            l.dst[i] = offset;
+            offset = align64(offset + static_cast<size_t>(width) * height * sizeof(float));
+        }
+
+        l.size = offset;
+        return l;
+    }
+
+    void src_strides(const int width, const int bytes_per_comp, const int chroma_subsampling, ptrdiff_t stride[3]) noexcept
+    {
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            int w, h;
+            plane_size(i, width, 1, chroma_subsampling, w, h);
+            stride[i] = static_cast<ptrdiff_t>(w) * bytes_per_comp;
+        }
+    }
+
+#ifndef _WIN32
+    bool send_all(const int fd, const void* data, const size_t size) noexcept
+    {
+        const auto* p{ static_cast<const unsigned char*>(data) };
+        for (size_t sent{ 0 }; sent < size;)
+        {
+            const ssize_t n{ ::send(fd, p + sent, size - sent, MSG_NOSIGNAL) };
+            if (n <= 0)
+                return false;
+
+            sent += n;
+        }
+
+        return true;
+    }
+
+    bool recv_all(const int fd, void* data, const size_t size) noexcept
+    {
+        auto* p{ static_cast<unsigned char*>(data) };
+        for (size_t received{ 0 }; received < size;)
+        {
+            const ssize_t n{ ::recv(fd, p + received, size - received, 0) };
+            if (n <= 0)
+                return false;
+
+            received += n;
+        }
+
+        return true;
+    }
+
+    bool send_with_fd(const int fd, const void* data, const size_t size, const int fd_to_send) noexcept
+    {
+        iovec iov{ const_cast<void*>(data), size };
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        cmsghdr* cmsg{ CMSG_FIRSTHDR(&msg) };
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd_to_send, sizeof(int));
+
+        return ::sendmsg(fd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(size);
+    }
+
+    int recv_with_fd(const int fd, void* data, const size_t size) noexcept
+    {
+        iovec iov{ data, size };
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (::recvmsg(fd, &msg, 0) != static_cast<ssize_t>(size))
+            return -1;
+
+        const cmsghdr* cmsg{ CMSG_FIRSTHDR(&msg) };
+        if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            return -1;
+
+        int received;
+        std::memcpy(&received, CMSG_DATA(cmsg), sizeof(int));
+        return received;
+    }
+
+    std::string default_socket()
+    {
+        if (const char* dir{ std::getenv("XDG_RUNTIME_DIR") }; dir && *dir)
+            return std::string{ dir } + "/rife.sock";
+
+        return std::format("/tmp/rife-{}.sock", ::getuid());
+    }
+#else
+    bool send_all(const int, const void*, const size_t) noexcept
+    {
+        return false;
+    }
+
+    bool recv_all(const int, void*, const size_t) noexcept
+    {
+        return false;
+    }
+
+    bool send_with_fd(const int, const void*, const size_t, const int) noexcept
+    {
+        return false;
+    }
+
+    int recv_with_fd(const int, void*, const size_t) noexcept
+    {
+        return -1;
+    }
+
+    std::string default_socket()
+    {
+        return {};
+    }
+#endif
+}
+
+#ifndef _WIN32
+std::unique_ptr<RemoteRIFE> RemoteRIFE::connect(const std::string& socket_path, const remote::Model& model, const int width,
+    const int height, const int connections)
+{
+    std::unique_ptr<RemoteRIFE> r{ new RemoteRIFE() };
+    r->socket_path = socket_path;
+    r->model = model;
+    r->width = width;
+    r->height = height;
+    r->buffer_layout = remote::layout(width, height, model.bytes_per_comp, model.chroma_subsampling);
+    r->connections.resize(connections);
+
+    // the other connections are opened when they are needed
+    remote::OpenReply reply{};
+    if (!r->open(r->connections[0], &reply))
+        return nullptr;
+
+    r->fp16_storage = reply.fp16_storage;
+    return r;
+}
+
+RemoteRIFE::~RemoteRIFE()
+{
+    for (auto& c : connections)
+        close(c);
+}
+
+bool RemoteRIFE::open(Connection& c, remote::OpenReply* open_reply) const
+{
+    trace::Scope scope{ "server connect" };
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        return false;
+
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+    c.fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (c.fd < 0)
+        return false;
+
+    ::fcntl(c.fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    const int on{ 1 };
+    ::setsockopt(c.fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    const timeval timeout{ remote::timeout_seconds, 0 };
+    ::setsockopt(c.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(c.fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if (::connect(c.fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)))
+    {
+        close(c);
+        return false;
+    }
+
+    // the name is removed right away, the server maps the descriptor
+    static std::atomic<uint32_t> counter{};
+    const std::string name{ std::format("/rife_{}_{}", ::getpid(), counter.fetch_add(1, std::memory_order_relaxed)) };
+    const int shm_fd{ ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600) };
+    if (shm_fd < 0)
+    {
+        close(c);
+        return false;
+    }
+
+    ::shm_unlink(name.c_str());
+
+    const remote::OpenRequest request{ remote::magic, remote::version, ::getpid(), model, width, height };
+    remote::OpenReply reply{};
+
+    const bool opened{ ::ftruncate(shm_fd, static_cast<off_t>(buffer_layout.size)) == 0 &&
+        (c.buffer = static_cast<unsigned char*>(::mmap(nullptr, buffer_layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0))) !=
+        MAP_FAILED &&
+        remote::send_with_fd(c.fd, &request, sizeof(request), shm_fd) && remote::recv_all(c.fd, &reply, sizeof(reply)) &&
+        reply.status == remote::ok };
+
+    ::close(shm_fd);
+
+    if (c.buffer == MAP_FAILED)
+        c.buffer = nullptr;
+
+    if (!opened)
+    {
+        close(c);
+        return false;
+    }
+
+    if (open_reply)
+        *open_reply = reply;
+
+    return true;
+}
+
+void RemoteRIFE::close(Connection& c) const noexcept
+{
+    if (c.buffer)
+        ::munmap(c.buffer, buffer_layout.size);
+    if (c.fd >= 0)
+        ::close(c.fd);
+
+    c.buffer = nullptr;
+    c.fd = -1;
+}
+
+int RemoteRIFE::call(const remote::Request& request, const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR,
+    float* dstG, float* dstB, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, RIFEAnalysis* analysis,
+    RIFETimings* timings) const
+{
+    if (request.width > width || request.height > height)
+        return -1;
+
+    Connection* c{};
+    {
+        trace::Scope scope{ "server connection wait" };
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&] {
+            for (auto& connection : connections)
+            {
+                if (!connection.busy)
+                {
+                    c = &connection;
+                    return true;
+                }
+            }
+
+            return false;
+            });
+
+        c->busy = true;
+    }
+
+    const auto start{ timings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{} };
+    remote::Reply reply{ remote::failed };
+
+    // a connection that was broken by a restart of the server is opened again once, not one that timed out
+    bool timed_out{};
+    for (int attempt{ 0 }; attempt < 2 && reply.status == remote::failed && !timed_out; ++attempt)
+    {
+        if (c->fd < 0 && !open(*c))
+            break;
+
+        {
+            trace::Scope scope{ "server upload" };
+
+            ptrdiff_t packed[3];
+            remote::src_strides(request.width, model.bytes_per_comp, model.chroma_subsampling, packed);
+
+            for (const auto& [src_p, stride, offsets] : { std::make_tuple(src0_p, stride0, buffer_layout.src0),
+                std::make_tuple(src1_p, stride1, buffer_layout.src1) })
+            {
+                for (int i{ 0 }; i < 3; ++i)
+                {
+                    const int h{ (i > 0 && model.chroma_subsampling == 1) ? request.height / 2 : request.height };
+                    for (int y{ 0 }; y < h; ++y)
+                        std::memcpy(c->buffer + offsets[i] + y * packed[i], src_p[i] + y * stride[i], packed[i]);
+                }
+            }
+        }
+
+        trace::Scope scope{ "server call" };
+        errno = 0;
+        if (!remote::send_all(c->fd, &request, sizeof(request)) || !remote::recv_all(c->fd, &reply, sizeof(reply)))
+        {
+            timed_out = errno == EAGAIN || errno == EWOULDBLOCK;
+            // a late reply cannot be told apart from the reply of the next call
+            close(*c);
+            reply.status = remote::failed;
+        }
+        else if (reply.status != remote::ok)
+            break;
+    }
+
+    if (reply.status == remote::ok)
+    {
+        trace::Scope scope{ "server readback" };
+
+        float* const dst[3]{ dstR, dstG, dstB };
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            const auto* src{ reinterpret_cast<const float*>(c->buffer + buffer_layout.dst[i]) };
+            for (int y{ 0 }; y < request.height; ++y)
+                std::memcpy(dst[i] + y * dst_stride, src + static_cast<size_t>(y) * request.width, request.width * sizeof(float));
+        }
+
+        if (analysis)
+        {
+            analysis->sad = reply.analysis.sad;
+            analysis->psnr = reply.analysis.psnr;
+            analysis->path = reply.analysis.path;
+        }
+
+        if (timings)
+        {
+            // the stages of the server, the transfer to the server is counted as upload
+            const double total{ std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() };
+            const double stages{ reply.timings.upload + reply.timings.preproc + reply.timings.infer + reply.timings.postproc +
+                reply.timings.readback };
+
+            timings->upload += reply.timings.upload + (std::max)(total - stages, 0.0);
+            timings->preproc += reply.timings.preproc;
+            timings->infer += reply.timings.infer;
+            timings->postproc += reply.timings.postproc;
+            timings->readback += reply.timings.readback;
+            timings->peak_vram = (std::max)(timings->peak_vram, reply.timings.peak_vram);
+        }
+
+        stats.update_peak_vram(reply.timings.peak_vram);
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        c->busy = false;
+    }
+
+    cv.notify_one();
+
+    return reply.status;
+}
+#else
+std::unique_ptr<RemoteRIFE> RemoteRIFE::connect(const std::string&, const remote::Model&, const int, const int, const int)
+{
+    return nullptr;
+}
+
+RemoteRIFE::~RemoteRIFE()
+{
+}
+
+bool RemoteRIFE::open(Connection&, remote::OpenReply*) const
+{
+    return false;
+}
+
+void RemoteRIFE::close(Connection&) const noexcept
+{
+}
+
+int RemoteRIFE::call(const remote::Request&, const uint8_t* const [3], const uint8_t* const [3], float*, float*, float*,
+    const ptrdiff_t [3], const ptrdiff_t [3], const ptrdiff_t, RIFEAnalysis*, RIFETimings*) const
+{
+    return remote::failed;
+}
+#endif
+
+int RemoteRIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB, const int w,
+    const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep,
+    RIFEAnalysis* analysis, RIFETimings* timings) const
+{
+    CallTimer call_timer{ stats.interpolate };
+
+    remote::Request request{ remote::op_process, w, h, timestep, analysis != nullptr, timings != nullptr };
+    if (analysis)
+        request.analysis = *analysis;
+
+    return call(request, src0_p, src1_p, dstR, dstG, dstB, stride0, stride1, dst_stride, analysis, timings);
+}
+
+int RemoteRIFE::process_copy(const uint8_t* const src_p[3], float* dstR, float* dstG, float* dstB, const int w, const int h,
+    const ptrdiff_t stride[3], const ptrdiff_t dst_stride, ConvertThreads* threads, RIFETimings* timings) const
+{
+    trace::Scope scope{ "convert" };
+    CallTimer call_timer{ stats.convert };
+    const auto start{ timings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{} };
+
+    const ConvertFormat fmt{ static_cast<bool>(model.is_yuv), model.chroma_subsampling, model.matrix_in, model.bytes_per_comp,
+        static_cast<bool>(model.full_range), model.bit_depth, fp16_storage };
+    convert_frame(fmt, src_p, stride, dstR, dstG, dstB, dst_stride, w, h, threads);
+
+    if (timings)
+        timings->convert += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    return 0;
+}
+
+int RemoteRIFE::process_blend(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB,
+    const int w, const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float weight,
+    RIFETimings* timings) const
+{
+    CallTimer call_timer{ stats.blend };
+
+    const remote::Request request{ remote::op_blend, w, h, weight, false, timings != nullptr };
+    return call(request, src0_p, src1_p, dstR, dstG, dstB, stride0, stride1, dst_stride, nullptr, timings);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+// rife_server protocol and client (server), POSIX only
+// every connection has a shared memory buffer that holds the source planes and the RGB output of one call, the socket carries
+// the fixed size messages and the descriptor of the buffer
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rife.h"
+
+namespace remote
+{
+    inline constexpr uint32_t magic{ 0x45464952 }; // "RIFE"
+    inline constexpr uint32_t version{ 1 };
+    // a send or receive of the client that takes longer means that the server hangs, the connection is closed like a broken one
+    inline constexpr int timeout_seconds{ 60 };
+
+    // the arguments of the RIFE constructor and load, the server shares the instances of the same model between its clients
+    struct Model
+    {
+        char path[1024];
+        int32_t gpu_id;
+        int32_t tta_level;
+        int32_t padding;
+        int32_t chroma_subsampling;
+        int32_t matrix_in;
+        int32_t bytes_per_comp;
+        int32_t bit_depth;
+        int32_t tta_batch;
+        uint64_t vram_cap;
+        uint8_t uhd;
+        uint8_t rife_v2;
+        uint8_t rife_v4;
+        uint8_t is_yuv;
+        uint8_t full_range;
+        uint8_t fusion;
+
+        auto operator<=>(const Model&) const = default;
+    };
+
+    enum Status : int32_t
+    {
+        ok,
+        bad_version = -1,
+        bad_model = -2, // cannot be loaded
+        busy = -3, // the server has max_clients connections
+        bad_buffer = -4,
+        failed = -5 // process* failed
+    };
+
+    // sent with the descriptor of the buffer
+    struct OpenRequest
+    {
+        uint32_t magic;
+        uint32_t version;
+        int64_t client; // process id, the GPU is shared evenly between the clients
+        Model model;
+        int32_t width; // largest frame of the calls
+        int32_t height;
+    };
+
+    struct OpenReply
+    {
+        int32_t status;
+        uint8_t fp16_storage; // for process_copy
+    };
+
+    enum Op : uint32_t
+    {
+        op_process,
+        op_blend
+    };
+
+    struct Request
+    {
+        uint32_t op;
+        int32_t width;
+        int32_t height;
+        float timestep; // weight of op_blend
+        uint8_t has_analysis;
+        uint8_t has_timings;
+        RIFEAnalysis analysis;
+    };
+
+    struct Reply
+    {
+        int32_t status;
+        RIFEAnalysis analysis;
+        RIFETimings timings;
+    };
+
+    // byte offsets of the planes in the buffer, the source planes are packed (stride = row size)
+    struct Layout
+    {
+        size_t src0[3];
+        size_t src1[3];
+        size_t dst[3]; // float R, G, B
+        size_t size;
+    };
+
+    Layout layout(const int width, const int height, const int bytes_per_comp, const int chroma_subsampling) noexcept;
+    // strides of the packed source planes of a width x h call
+    void src_strides(const int width, const int bytes_per_comp, const int chroma_subsampling, ptrdiff_t stride[3]) noexcept;
+
+    bool send_all(const int fd, const void* data, const size_t size) noexcept;
+    bool recv_all(const int fd, void* data, const size_t size) noexcept;
+    // the message carries the descriptor fd_to_send
+    bool send_with_fd(const int fd, const void* data, const size_t size, const int fd_to_send) noexcept;
+    // the received descriptor or -1
+    int recv_with_fd(const int fd, void* data, const size_t size) noexcept;
+
+    // $XDG_RUNTIME_DIR/rife.sock, /tmp/rife-<uid>.sock without it
+    std::string default_socket();
+}
+
+// the model runs in rife_server, same calls as RIFE
+class RemoteRIFE
+{
+public:
+    // null when the server is not running or cannot load the model
+    // connections is the number of calls that can be sent at the same time
+    static std::unique_ptr<RemoteRIFE> connect(const std::string& socket_path, const remote::Model& model, const int width,
+        const int height, const int connections);
+    ~RemoteRIFE();
+
+    int process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB, const int w,
+        const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep,
+        RIFEAnalysis* analysis = nullptr, RIFETimings* timings = nullptr) const;
+
+    // done on the CPU like RIFE::process_copy
+    int process_copy(const uint8_t* const src_p[3], float* dstR, float* dstG, float* dstB,
+        const int w, const int h, const ptrdiff_t stride[3], const ptrdiff_t dst_stride, ConvertThreads* threads = nullptr,
+        RIFETimings* timings = nullptr) const;
+
+    int process_blend(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB, const int w,
+        const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float weight,
+        RIFETimings* timings = nullptr) const;
+
+    // round trips of the calls
+    mutable ProcessStats stats;
+
+private:
+    struct Connection
+    {
+        int fd{ -1 };
+        unsigned char* buffer{};
+        bool busy{};
+    };
+
+    RemoteRIFE() = default;
+
+    // sends the open request on a new connection, reply (if not null) is the reply of the server
+    bool open(Connection& c, remote::OpenReply* reply = nullptr) const;
+    void close(Connection& c) const noexcept;
+    int call(const remote::Request& request, const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG,
+        float* dstB, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, RIFEAnalysis* analysis,
+        RIFETimings* timings) const;
+
+    std::string socket_path;
+    remote::Model model;
+    int width;
+    int height;
+    remote::Layout buffer_layout;
+    bool fp16_storage; // of the first connection
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable cv;
+    mutable std::vector<Connection> connections;
+};
@@ -3,41 +3,171 @@
 #include "rife.h"
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <optional>
 #include <vector>
 
 #include "benchmark.h"
+#include "datareader.h"
+
+#include "convert.h"
+#include "fusion.h"
+#include "kernels.h"
+#include "mapped_file.h"
+#include "model_pack.h"
+#include "trace.h"
 
 #include "rife_preproc.comp.hex.h"
 #include "rife_postproc.comp.hex.h"
-#include "rife_preproc_tta.comp.hex.h"
-#include "rife_postproc_tta.comp.hex.h"
-#include "rife_flow_tta_avg.comp.hex.h"
-#include "rife_v2_flow_tta_avg.comp.hex.h"
+#include "rife_tta.comp.hex.h"
 #include "rife_flow_tta_temporal_avg.comp.hex.h"
 #include "rife_v2_flow_tta_temporal_avg.comp.hex.h"
 #include "rife_out_tta_temporal_avg.comp.hex.h"
 #include "rife_v4_timestep.comp.hex.h"
+#include "rife_analysis.comp.hex.h"
+#include "rife_analysis_reduce.comp.hex.h"
+#include "rife_select.comp.hex.h"
+#include "rife_blend.comp.hex.h"
 
 #include "rife_ops.h"
 
 DEFINE_LAYER_CREATOR(Warp)
+DEFINE_LAYER_CREATOR(FusedWarp)
+
+// Without timings everything stays in one submission.
+class StageTimer
+{
+public:
+    StageTimer(ncnn::VkCompute& cmd, RIFETimings* timings) noexcept
+        : cmd(cmd), timings(timings), start(timings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{})
+    {
+    }
+
+    // submits the recorded work and adds the time since the previous stage
+    void submit(double RIFETimings::* stage)
+    {
+        if (!timings)
+            return;
+
+        {
+            trace::Scope scope{ "gpu" };
+            cmd.submit_and_wait();
+        }
+
+        cmd.reset();
+        mark(stage);
+    }
+
+    // host only stage
+    void mark(double RIFETimings::* stage) noexcept
+    {
+        if (!timings)
+            return;
+
+        const auto now{ std::chrono::steady_clock::now() };
+        timings->*stage += std::chrono::duration<double, std::micro>(now - start).count();
+        start = now;
+    }
 
-RIFE::RIFE(int gpuid, bool _tta_mode, bool _uhd_mode, int _num_threads, bool _rife_v2, bool _rife_v4, int _padding,
-    bool _is_yuv, int _chroma_subsampling, int _matrix_in, int _bytes_per_comp, bool _full_range, int _bit_depth)
-    : tta_mode(_tta_mode), uhd_mode(_uhd_mode), num_threads(_num_threads), rife_v2(_rife_v2), rife_v4(_rife_v4), padding(_padding),
+private:
+    ncnn::VkCompute& cmd;
+    RIFETimings* timings;
+    std::chrono::steady_clock::time_point start;
+};
+
+// forwards to the blob allocator of the device and counts the bytes of the buffers that are alive, the blobs of ncnn are buffers
+class PeakVkAllocator : public ncnn::VkAllocator
+{
+public:
+    explicit PeakVkAllocator(ncnn::VkAllocator* allocator) : ncnn::VkAllocator(allocator->vkdev), allocator(allocator)
+    {
+        buffer_memory_type_index = allocator->buffer_memory_type_index;
+        image_memory_type_index = allocator->image_memory_type_index;
+        reserved_type_index = allocator->reserved_type_index;
+        mappable = allocator->mappable;
+        coherent = allocator->coherent;
+    }
+
+    ncnn::VkBufferMemory* fastMalloc(size_t size) override
+    {
+        ncnn::VkBufferMemory* ptr{ allocator->fastMalloc(size) };
+        if (ptr)
+        {
+            in_use += ptr->capacity;
+            peak_bytes = (std::max)(peak_bytes, in_use);
+        }
+
+        return ptr;
+    }
+
+    void fastFree(ncnn::VkBufferMemory* ptr) override
+    {
+        if (ptr)
+            in_use -= ptr->capacity;
+
+        allocator->fastFree(ptr);
+    }
+
+    int flush(ncnn::VkBufferMemory* ptr) override
+    {
+        return allocator->flush(ptr);
+    }
+
+    int invalidate(ncnn::VkBufferMemory* ptr) override
+    {
+        return allocator->invalidate(ptr);
+    }
+
+    ncnn::VkImageMemory* fastMalloc(int w, int h, int c, size_t elemsize, int elempack) override
+    {
+        return allocator->fastMalloc(w, h, c, elemsize, elempack);
+    }
+
+    void fastFree(ncnn::VkImageMemory* ptr) override
+    {
+        allocator->fastFree(ptr);
+    }
+
+    uint64_t peak() const noexcept
+    {
+        return peak_bytes;
+    }
+
+private:
+    ncnn::VkAllocator* allocator;
+    uint64_t in_use{};
+    uint64_t peak_bytes{};
+};
+
+RIFE::RIFE(int gpuid, int _tta_level, bool _uhd_mode, int _num_threads, bool _rife_v2, bool _rife_v4, int _padding,
+    bool _is_yuv, int _chroma_subsampling, int _matrix_in, int _bytes_per_comp, bool _full_range, int _bit_depth, int _tta_batch,
+    uint64_t _vram_cap)
+    : tta_mode(_tta_level > 1), tta_level(_tta_level > 1 ? _tta_level : 1), uhd_mode(_uhd_mode), num_threads(_num_threads), rife_v2(_rife_v2), rife_v4(_rife_v4), padding(_padding),
     is_yuv(_is_yuv), chroma_subsampling(_chroma_subsampling), matrix_in(_matrix_in), bytes_per_comp(_bytes_per_comp),
     full_range(_full_range), bit_depth(_bit_depth),
     rife_preproc{},
     rife_postproc{},
-    rife_flow_tta_avg{},
+    rife_tta_image{},
+    rife_tta_flow{},
     rife_flow_tta_temporal_avg{},
     rife_out_tta_temporal_avg{},
     rife_v4_timestep{},
+    rife_analysis{},
+    rife_analysis_reduce{},
+    rife_select{},
+    rife_blend{},
     rife_uhd_downscale_image{},
     rife_uhd_upscale_flow{},
     rife_uhd_double_flow{},
     rife_v2_slice_flow{},
-    tta_temporal_mode{}
+    tta_temporal_mode{},
+    tta_batch(std::clamp(_tta_batch, 1, 8)),
+    vram_cap(_vram_cap)
 {
     vkdev = ncnn::get_gpu_device(gpuid);
 }
@@ -48,10 +178,15 @@ RIFE::~RIFE()
     {
         delete rife_preproc;
         delete rife_postproc;
-        delete rife_flow_tta_avg;
+        delete rife_tta_image;
+        delete rife_tta_flow;
         delete rife_flow_tta_temporal_avg;
         delete rife_out_tta_temporal_avg;
         delete rife_v4_timestep;
+        delete rife_analysis;
+        delete rife_analysis_reduce;
+        delete rife_select;
+        delete rife_blend;
     }
 
     if (uhd_mode)
@@ -73,53 +208,97 @@ RIFE::~RIFE()
     }
 }
 
-#if _WIN32
-static inline std::string path_conversion(const std::string& name, const unsigned CP) noexcept
+// modeldir is UTF-8, on Windows a path in the ANSI code page is accepted as well
+static std::filesystem::path model_dir_path(const std::string& modeldir)
 {
-    int num_chars{ MultiByteToWideChar(CP, 0, &name[0], static_cast<int>(name.size()), nullptr, 0) };
-    std::wstring wide_source(num_chars, 0);
-    MultiByteToWideChar(CP, 0, &name[0], static_cast<int>(name.size()), &wide_source[0], num_chars);
-
-    num_chars = WideCharToMultiByte(CP, 0, &wide_source[0], static_cast<int>(wide_source.size()), nullptr, 0, nullptr, nullptr);
-    std::string source(num_chars, 0);
-    WideCharToMultiByte(CP, 0, &wide_source[0], static_cast<int>(wide_source.size()), &source[0], num_chars, nullptr, nullptr);
+#if _WIN32
+    for (const unsigned CP : { CP_UTF8, CP_ACP })
+    {
+        const DWORD flags{ (CP == CP_UTF8) ? static_cast<DWORD>(MB_ERR_INVALID_CHARS) : 0 };
+        const int num_chars{ MultiByteToWideChar(CP, flags, modeldir.data(), static_cast<int>(modeldir.size()), nullptr, 0) };
+        if (num_chars <= 0)
+            continue;
+
+        std::wstring wide(num_chars, 0);
+        MultiByteToWideChar(CP, flags, modeldir.data(), static_cast<int>(modeldir.size()), wide.data(), num_chars);
+
+        std::filesystem::path path{ wide };
+        std::error_code ec;
+        if (CP == CP_ACP || std::filesystem::is_directory(path, ec))
+            return path;
+    }
 
-    return source;
-}
+    return std::filesystem::path{ modeldir };
+#else
+    return std::filesystem::path{ modeldir };
 #endif
+}
 
-static void load_param_model(ncnn::Net& net, const std::string& modeldir, const char* name)
+// DataReaderFromMemory bounded by the size of the mapping, a truncated .bin fails instead of being read past the end
+class DataReaderFromMapping : public ncnn::DataReader
 {
-    char parampath[256];
-    char modelpath[256];
-    sprintf(parampath, "%s/%s.param", modeldir.c_str(), name);
-    sprintf(modelpath, "%s/%s.bin", modeldir.c_str(), name);
-
-#ifdef _WIN32
-    std::string converted_parampath{ path_conversion(parampath, CP_ACP) };
-    std::string converted_modelpath{ path_conversion(modelpath, CP_ACP) };
+public:
+    DataReaderFromMapping(const unsigned char* mem, const size_t size) : mem(mem), left(size)
+    {
+    }
 
-    sprintf(parampath, "%s", converted_parampath.c_str());
-    sprintf(modelpath, "%s", converted_modelpath.c_str());
+    int scan(const char*, void*) const override
+    {
+        return 0;
+    }
 
-    if (net.load_param(parampath) || net.load_model(modelpath))
+    size_t read(void* buf, size_t size) const override
     {
-        converted_parampath = path_conversion(parampath, CP_UTF8);
-        converted_modelpath = path_conversion(modelpath, CP_UTF8);
+        if (size > left)
+            return 0;
 
-        sprintf(parampath, "%s", converted_parampath.c_str());
-        sprintf(modelpath, "%s", converted_modelpath.c_str());
+        std::copy_n(mem, size, static_cast<unsigned char*>(buf));
+        mem += size;
+        left -= size;
+        return size;
+    }
+
+    size_t reference(size_t size, const void** buf) const override
+    {
+        if (size > left)
+            return 0;
 
-        net.load_param(parampath);
-        net.load_model(modelpath);
+        *buf = mem;
+        mem += size;
+        left -= size;
+        return size;
     }
-#else
-    net.load_param(parampath);
-    net.load_model(modelpath);
-#endif // _WIN32
+
+private:
+    mutable const unsigned char* mem;
+    mutable size_t left;
+};
+
+// the param text is small and parsed from a copy (rewritten with fusion), the weights are read in place from the mapping,
+// the fp32 arrays are referenced by the layers without a copy until they are uploaded
+static int load_param_model(ncnn::Net& net, const std::filesystem::path& dir, const char* name, const bool fusion, MappedFile& model)
+{
+    std::ifstream ifs{ dir / (std::string{ name } + ".param"), std::ios::binary };
+    if (!ifs)
+        return -1;
+
+    std::string param{ std::istreambuf_iterator<char>{ ifs }, std::istreambuf_iterator<char>{} };
+    if (fusion)
+        param = fuse_warp(param);
+
+    if (net.load_param_mem(param.c_str()))
+        return -1;
+
+    model = MappedFile{ dir / (std::string{ name } + ".bin") };
+    if (!model.is_open())
+        return -1;
+
+    const DataReaderFromMapping dr{ model.data(), model.size() };
+
+    return net.load_model(dr) ? -1 : 0;
 }
 
-int RIFE::load(const std::string& modeldir)
+int RIFE::load(const std::string& modeldir, const bool fusion)
 {
     ncnn::Option opt;
     opt.num_threads = num_threads;
@@ -141,11 +320,21 @@ int RIFE::load(const std::string& modeldir)
     contextnet.register_custom_layer("rife.Warp", Warp_layer_creator);
     fusionnet.register_custom_layer("rife.Warp", Warp_layer_creator);
 
-    load_param_model(flownet, modeldir, "flownet");
+    flownet.register_custom_layer("rife.FusedWarp", FusedWarp_layer_creator);
+    contextnet.register_custom_layer("rife.FusedWarp", FusedWarp_layer_creator);
+    fusionnet.register_custom_layer("rife.FusedWarp", FusedWarp_layer_creator);
+
+    // a pack written by rife_optimize is preferred while it matches the files of modeldir
+    const std::filesystem::path dir{ model_dir_path(modeldir) };
+    const std::filesystem::path netdir{ find_model_pack(dir) ? dir / model_pack_dir : dir };
+
+    if (load_param_model(flownet, netdir, "flownet", fusion, flownet_model))
+        return -1;
     if (!rife_v4)
     {
-        load_param_model(contextnet, modeldir, "contextnet");
-        load_param_model(fusionnet, modeldir, "fusionnet");
+        if (load_param_model(contextnet, netdir, "contextnet", fusion, contextnet_model) ||
+            load_param_model(fusionnet, netdir, "fusionnet", fusion, fusionnet_model))
+            return -1;
     }
 
     // initialize preprocess and postprocess pipeline
@@ -159,24 +348,38 @@ int RIFE::load(const std::string& modeldir)
         preproc_specializations[5].i = bit_depth;
 
         {
-            std::vector<uint32_t> spirv;
+            std::vector<uint32_t>& spirv{ preproc_shader.spirv };
             static ncnn::Mutex lock;
             {
                 ncnn::MutexLockGuard guard(lock);
                 if (spirv.empty())
                 {
-                    if (tta_mode)
-                        compile_spirv_module(rife_preproc_tta_comp_data, sizeof(rife_preproc_tta_comp_data), opt, spirv);
-                    else
-                        compile_spirv_module(rife_preproc_comp_data, sizeof(rife_preproc_comp_data), opt, spirv);
+                    compile_spirv_module(rife_preproc_comp_data, sizeof(rife_preproc_comp_data), opt, spirv);
                 }
             }
 
+            preproc_shader.specializations = preproc_specializations;
+
             rife_preproc = new ncnn::Pipeline(vkdev);
             rife_preproc->set_optimal_local_size_xyz(8, 8, 3);
             rife_preproc->create(spirv.data(), spirv.size() * 4, preproc_specializations);
         }
 
+        // two frames converted by rife_preproc blended into the final output
+        {
+            std::vector<uint32_t>& spirv{ blend_shader.spirv };
+            static ncnn::Mutex lock;
+            {
+                ncnn::MutexLockGuard guard(lock);
+                if (spirv.empty())
+                    compile_spirv_module(rife_blend_comp_data, sizeof(rife_blend_comp_data), opt, spirv);
+            }
+
+            rife_blend = new ncnn::Pipeline(vkdev);
+            rife_blend->set_optimal_local_size_xyz(8, 8, 3);
+            rife_blend->create(spirv.data(), spirv.size() * 4, blend_shader.specializations);
+        }
+
         // Specializations for original postprocessor
         std::vector<ncnn::vk_specialization_type> postproc_specializations(1);
 #if _WIN32
@@ -186,45 +389,41 @@ int RIFE::load(const std::string& modeldir)
 #endif
 
         {
-            std::vector<uint32_t> spirv;
+            std::vector<uint32_t>& spirv{ postproc_shader.spirv };
             static ncnn::Mutex lock;
             {
                 ncnn::MutexLockGuard guard(lock);
                 if (spirv.empty())
-                {
-                    if (tta_mode)
-                        compile_spirv_module(rife_postproc_tta_comp_data, sizeof(rife_postproc_tta_comp_data), opt, spirv);
-                    else
-                        compile_spirv_module(rife_postproc_comp_data, sizeof(rife_postproc_comp_data), opt, spirv);
-                }
+                    compile_spirv_module(rife_postproc_comp_data, sizeof(rife_postproc_comp_data), opt, spirv);
             }
 
+            postproc_shader.specializations = postproc_specializations;
+
             rife_postproc = new ncnn::Pipeline(vkdev);
             rife_postproc->set_optimal_local_size_xyz(8, 8, 3);
             rife_postproc->create(spirv.data(), spirv.size() * 4, postproc_specializations);
         }
     }
 
+    // expands the identity augmentation and averages the augmentations of the images and flows
     if (tta_mode)
     {
         std::vector<uint32_t> spirv;
-        static ncnn::Mutex lock;
-        {
-            ncnn::MutexLockGuard guard(lock);
-            if (spirv.empty())
-            {
-                if (rife_v2)
-                    compile_spirv_module(rife_v2_flow_tta_avg_comp_data, sizeof(rife_v2_flow_tta_avg_comp_data), opt, spirv);
-                else
-                    compile_spirv_module(rife_flow_tta_avg_comp_data, sizeof(rife_flow_tta_avg_comp_data), opt, spirv);
-            }
-        }
+        compile_spirv_module(rife_tta_comp_data, sizeof(rife_tta_comp_data), opt, spirv);
 
-        std::vector<ncnn::vk_specialization_type> specializations(0);
+        std::vector<ncnn::vk_specialization_type> specializations(2);
+        specializations[0].i = 0;
+        specializations[1].i = tta_level;
+
+        rife_tta_image = new ncnn::Pipeline(vkdev);
+        rife_tta_image->set_optimal_local_size_xyz(8, 8, 1);
+        rife_tta_image->create(spirv.data(), spirv.size() * 4, specializations);
+
+        specializations[0].i = rife_v2 ? 2 : 1;
 
-        rife_flow_tta_avg = new ncnn::Pipeline(vkdev);
-        rife_flow_tta_avg->set_optimal_local_size_xyz(8, 8, 1);
-        rife_flow_tta_avg->create(spirv.data(), spirv.size() * 4, specializations);
+        rife_tta_flow = new ncnn::Pipeline(vkdev);
+        rife_tta_flow->set_optimal_local_size_xyz(8, 8, 1);
+        rife_tta_flow->create(spirv.data(), spirv.size() * 4, specializations);
     }
 
     if (tta_temporal_mode)
@@ -327,7 +526,7 @@ int RIFE::load(const std::string& modeldir)
 
     if (rife_v4)
     {
-        std::vector<uint32_t> spirv;
+        std::vector<uint32_t>& spirv{ timestep_shader.spirv };
         static ncnn::Mutex lock;
         {
             ncnn::MutexLockGuard guard(lock);
@@ -342,21 +541,325 @@ int RIFE::load(const std::string& modeldir)
         rife_v4_timestep->create(spirv.data(), spirv.size() * 4, specializations);
     }
 
+    // scene change/static analysis
+    {
+        std::vector<ncnn::vk_specialization_type> specializations;
+
+        {
+            std::vector<uint32_t> spirv;
+            static ncnn::Mutex lock;
+            {
+                ncnn::MutexLockGuard guard(lock);
+                if (spirv.empty())
+                    compile_spirv_module(rife_analysis_comp_data, sizeof(rife_analysis_comp_data), opt, spirv);
+            }
+
+            rife_analysis = new ncnn::Pipeline(vkdev);
+            rife_analysis->set_optimal_local_size_xyz(64, 1, 1);
+            rife_analysis->create(spirv.data(), spirv.size() * 4, specializations);
+        }
+        {
+            std::vector<uint32_t> spirv;
+            static ncnn::Mutex lock;
+            {
+                ncnn::MutexLockGuard guard(lock);
+                if (spirv.empty())
+                    compile_spirv_module(rife_analysis_reduce_comp_data, sizeof(rife_analysis_reduce_comp_data), opt, spirv);
+            }
+
+            rife_analysis_reduce = new ncnn::Pipeline(vkdev);
+            // the shared arrays of the shader hold 64 partial sums
+            rife_analysis_reduce->set_optimal_local_size_xyz(64, 1, 1);
+            rife_analysis_reduce->create(spirv.data(), spirv.size() * 4, specializations);
+        }
+        {
+            std::vector<uint32_t>& spirv{ select_shader.spirv };
+            static ncnn::Mutex lock;
+            {
+                ncnn::MutexLockGuard guard(lock);
+                if (spirv.empty())
+                    compile_spirv_module(rife_select_comp_data, sizeof(rife_select_comp_data), opt, spirv);
+            }
+
+            rife_select = new ncnn::Pipeline(vkdev);
+            rife_select->set_optimal_local_size_xyz(8, 8, 3);
+            rife_select->create(spirv.data(), spirv.size() * 4, specializations);
+        }
+    }
+
     return 0;
 }
 
+void RIFE::create_pipeline(ncnn::Pipeline*& pipeline, const Shader& shader, const LocalSize& local_size) const
+{
+    delete pipeline;
+
+    pipeline = new ncnn::Pipeline(vkdev);
+    pipeline->set_local_size_xyz(local_size.x, local_size.y, local_size.z);
+    pipeline->create(shader.spirv.data(), shader.spirv.size() * 4, shader.specializations);
+}
+
+int RIFE::autotune(const int w, const int h, const std::string& profile_path)
+{
+    const ncnn::GpuInfo& info{ vkdev->info };
+
+    // every group is measured by a separately submitted stage
+    struct Member
+    {
+        ncnn::Pipeline*& pipeline;
+        const Shader& shader;
+        bool single_channel;
+    };
+
+    struct Group
+    {
+        const char* name;
+        std::vector<Member> members;
+        std::optional<LocalSize> best;
+        double best_us;
+    };
+
+    std::array<Group, 3> groups{ {
+        { "preproc", { { rife_preproc, preproc_shader, false } } },
+        { "postproc", { { rife_postproc, postproc_shader, false }, { rife_select, select_shader, false } } },
+        { "blend", { { rife_blend, blend_shader, false } } } } };
+
+    if (rife_v4)
+        groups[0].members.push_back({ rife_v4_timestep, timestep_shader, true });
+
+    const auto fit{ [](LocalSize local_size, const bool single_channel) {
+        if (single_channel)
+            local_size.z = 1;
+        return local_size;
+        } };
+
+    const auto apply{ [&](const Group& group, const LocalSize& local_size) {
+        for (const auto& m : group.members)
+            create_pipeline(m.pipeline, m.shader, fit(local_size, m.single_channel));
+        } };
+
+    const auto key{ [&](const Group& group) {
+        return std::format("{:04x}:{:04x}:{:x}/{}x{}/tta{}/v4{}/yuv{}{}/{}b/{}", info.vendor_id(), info.device_id(), info.driver_version(),
+            w, h, tta_level, static_cast<int>(rife_v4), static_cast<int>(is_yuv), chroma_subsampling, bytes_per_comp,
+            group.name);
+        } };
+
+    LocalSizeProfile profile{ profile_path };
+
+    for (auto& group : groups)
+        group.best = profile.find(key(group));
+
+    if (std::all_of(groups.begin(), groups.end(), [](const Group& group) { return group.best.has_value(); }))
+    {
+        for (const auto& group : groups)
+            apply(group, *group.best);
+
+        return 0;
+    }
+
+    trace::Scope scope{ "autotune" };
+
+    const int w_chroma{ (chroma_subsampling == 1 || chroma_subsampling == 2) ? w / 2 : w };
+    const int h_chroma{ (chroma_subsampling == 1) ? h / 2 : h };
+
+    // the content does not change the time of these shaders
+    std::vector<uint8_t> luma(static_cast<size_t>(w) * h * bytes_per_comp);
+    std::vector<uint8_t> chroma(static_cast<size_t>(w_chroma) * h_chroma * bytes_per_comp);
+    const uint8_t* src[3]{ luma.data(), chroma.data(), chroma.data() };
+    const ptrdiff_t stride[3]{ w * bytes_per_comp, w_chroma * bytes_per_comp, w_chroma * bytes_per_comp };
+
+    std::vector<float> dst(static_cast<size_t>(w) * h * 3);
+    float* dstR{ dst.data() };
+    float* dstG{ dstR + static_cast<size_t>(w) * h };
+    float* dstB{ dstG + static_cast<size_t>(w) * h };
+
+    // select runs only with analysis
+    RIFEAnalysis analysis{};
+
+    for (auto& group : groups)
+        group.best.reset();
+
+    for (const LocalSize& candidate : local_size_candidates)
+    {
+        if (static_cast<uint32_t>(candidate.x * candidate.y * candidate.z) > info.max_workgroup_invocations() ||
+            static_cast<uint32_t>(candidate.x) > info.max_workgroup_size_x() ||
+            static_cast<uint32_t>(candidate.y) > info.max_workgroup_size_y() ||
+            static_cast<uint32_t>(candidate.z) > info.max_workgroup_size_z())
+            continue;
+
+        for (const auto& group : groups)
+            apply(group, candidate);
+
+        RIFETimings interp{};
+        RIFETimings blend{};
+
+        // the first round is not measured
+        for (int i{ 0 }; i < 4; ++i)
+        {
+            RIFETimings* t{ i ? &interp : nullptr };
+            RIFETimings* b{ i ? &blend : nullptr };
+
+            if (process(src, src, dstR, dstG, dstB, w, h, stride, stride, w, 0.5f, &analysis, t) ||
+                process_blend(src, src, dstR, dstG, dstB, w, h, stride, stride, w, 0.5f, b))
+                return -1;
+        }
+
+        const std::array<double, 3> us{ interp.preproc, interp.postproc, blend.preproc };
+
+        for (size_t i{ 0 }; i < groups.size(); ++i)
+        {
+            if (!groups[i].best || us[i] < groups[i].best_us)
+            {
+                groups[i].best = candidate;
+                groups[i].best_us = us[i];
+            }
+        }
+    }
+
+    for (const auto& group : groups)
+    {
+        apply(group, *group.best);
+        profile.set(key(group), *group.best);
+    }
+
+    // the tuning runs are not part of the run statistics
+    stats.reset();
+
+    return profile.save() ? 0 : 1;
+}
+
+void RIFE::record_analysis(ncnn::VkCompute& cmd, const ncnn::VkMat& in0_gpu_padded, const ncnn::VkMat& in1_gpu_padded, const int w,
+    const int h, const RIFEAnalysis& analysis, ncnn::VkMat& metrics_gpu, ncnn::VkAllocator* blob_vkallocator) const
+{
+    // per row sad/mse
+    ncnn::VkMat partial_gpu;
+    partial_gpu.create(h * 2, sizeof(float), blob_vkallocator);
+    {
+        std::vector<ncnn::VkMat> bindings(3);
+        bindings[0] = in0_gpu_padded;
+        bindings[1] = in1_gpu_padded;
+        bindings[2] = partial_gpu;
+
+        // the CPU analysis measures the Y plane of YUV input in its own range, the tensors are full range RGB
+        std::vector<ncnn::vk_constant_type> constants(5);
+        constants[0].i = w;
+        constants[1].i = h;
+        constants[2].i = in0_gpu_padded.w;
+        constants[3].i = in0_gpu_padded.cstep;
+        constants[4].f = (is_yuv && !full_range) ? 219.0f / 255.0f : 1.0f;
+
+        ncnn::VkMat dispatcher;
+        dispatcher.w = h;
+        dispatcher.h = 1;
+        dispatcher.c = 1;
+        cmd.record_pipeline(rife_analysis, bindings, constants, dispatcher);
+    }
+
+    // frame sad/psnr and the decision
+    metrics_gpu.create(4, sizeof(float), blob_vkallocator);
+    {
+        std::vector<ncnn::VkMat> bindings(2);
+        bindings[0] = partial_gpu;
+        bindings[1] = metrics_gpu;
+
+        std::vector<ncnn::vk_constant_type> constants(6);
+        constants[0].i = h;
+        constants[1].i = analysis.sc;
+        constants[2].i = analysis.sc1;
+        constants[3].i = analysis.skip;
+        constants[4].f = analysis.sc_threshold;
+        constants[5].f = analysis.skip_threshold;
+
+        // one workgroup
+        ncnn::VkMat dispatcher;
+        dispatcher.w = 64;
+        dispatcher.h = 1;
+        dispatcher.c = 1;
+        cmd.record_pipeline(rife_analysis_reduce, bindings, constants, dispatcher);
+    }
+}
+
+bool RIFE::read_analysis(ncnn::VkCompute& cmd, const ncnn::VkMat& metrics_gpu, RIFEAnalysis& analysis, const ncnn::Option& opt) const
+{
+    ncnn::Mat metrics;
+    cmd.record_clone(metrics_gpu, metrics, opt);
+
+    {
+        trace::Scope scope{ "gpu analysis" };
+        cmd.submit_and_wait();
+    }
+
+    cmd.reset();
+
+    const float* m{ static_cast<const float*>(metrics.data) };
+    analysis.sad = m[0];
+    analysis.psnr = m[1];
+    analysis.path = static_cast<int>(m[2]);
+
+    return analysis.path != 0;
+}
+
+void RIFE::record_select(ncnn::VkCompute& cmd, const ncnn::VkMat& metrics_gpu, const ncnn::VkMat& in0_gpu_padded,
+    const ncnn::VkMat& in1_gpu_padded, const ncnn::VkMat& out_gpu, const float weight) const
+{
+    std::vector<ncnn::VkMat> bindings(4);
+    bindings[0] = metrics_gpu;
+    bindings[1] = in0_gpu_padded;
+    bindings[2] = in1_gpu_padded;
+    bindings[3] = out_gpu;
+
+    std::vector<ncnn::vk_constant_type> constants(7);
+    constants[0].i = in0_gpu_padded.w;
+    constants[1].i = in0_gpu_padded.h;
+    constants[2].i = in0_gpu_padded.cstep;
+    constants[3].i = out_gpu.w;
+    constants[4].i = out_gpu.h;
+    constants[5].i = out_gpu.cstep;
+    constants[6].f = weight;
+
+    cmd.record_pipeline(rife_select, bindings, constants, out_gpu);
+}
+
+void RIFE::update_peak_vram(const uint64_t bytes, RIFETimings* timings) const
+{
+    stats.update_peak_vram(bytes);
+    if (timings)
+        timings->peak_vram = (std::max)(timings->peak_vram, bytes);
+
+    // the TTA augmentations are processed in smaller batches from the next frame
+    if (tta_mode && vram_cap && bytes > vram_cap)
+    {
+        int batch{ tta_batch.load(std::memory_order_relaxed) };
+        while (batch > 1 && !tta_batch.compare_exchange_weak(batch, batch / 2, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
 int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB, const int w,
-    const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep) const
+    const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep,
+    RIFEAnalysis* analysis, RIFETimings* timings) const
 {
     if (rife_v4)
-        return process_v4(src0_p, src1_p, dstR, dstG, dstB, w, h, stride0, stride1, dst_stride, timestep);
+        return process_v4(src0_p, src1_p, dstR, dstG, dstB, w, h, stride0, stride1, dst_stride, timestep, analysis, timings);
+
+    CallTimer call_timer{ stats.interpolate };
 
     const int channels = 3;//in0image.elempack;
 
     //     fprintf(stderr, "%d x %d\n", w, h);
 
-    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    ncnn::VkAllocator* device_blob_vkallocator;
+    ncnn::VkAllocator* staging_vkallocator;
+    {
+        trace::Scope scope{ "acquire allocators" };
+        device_blob_vkallocator = vkdev->acquire_blob_allocator();
+        staging_vkallocator = vkdev->acquire_staging_allocator();
+    }
+
+    // every blob of the call is allocated through it
+    PeakVkAllocator peak_vkallocator{ device_blob_vkallocator };
+    ncnn::VkAllocator* blob_vkallocator{ &peak_vkallocator };
 
     ncnn::Option opt = flownet.opt;
     opt.blob_vkallocator = blob_vkallocator;
@@ -371,6 +874,9 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
     int w_chroma = (chroma_subsampling == 1 || chroma_subsampling == 2) ? w / 2 : w;
     int h_chroma = (chroma_subsampling == 1) ? h / 2 : h;
 
+    ncnn::VkCompute cmd(vkdev);
+    StageTimer timer(cmd, timings);
+
     ncnn::Mat in0_m0(w, h, 1, (size_t)bytes_per_comp);
     ncnn::Mat in0_m1(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
     ncnn::Mat in0_m2(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
@@ -378,19 +884,17 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
     ncnn::Mat in1_m1(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
     ncnn::Mat in1_m2(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
 
-    for (int y = 0; y < h; y++) {
-        std::memcpy((uint8_t*)in0_m0.data + y * w * bytes_per_comp, src0_p[0] + y * stride0[0], w * bytes_per_comp);
-        std::memcpy((uint8_t*)in1_m0.data + y * w * bytes_per_comp, src1_p[0] + y * stride1[0], w * bytes_per_comp);
-    }
-    for (int y = 0; y < h_chroma; y++) {
-        std::memcpy((uint8_t*)in0_m1.data + y * w_chroma * bytes_per_comp, src0_p[1] + y * stride0[1], w_chroma * bytes_per_comp);
-        std::memcpy((uint8_t*)in0_m2.data + y * w_chroma * bytes_per_comp, src0_p[2] + y * stride0[2], w_chroma * bytes_per_comp);
-        std::memcpy((uint8_t*)in1_m1.data + y * w_chroma * bytes_per_comp, src1_p[1] + y * stride1[1], w_chroma * bytes_per_comp);
-        std::memcpy((uint8_t*)in1_m2.data + y * w_chroma * bytes_per_comp, src1_p[2] + y * stride1[2], w_chroma * bytes_per_comp);
+    {
+        trace::Scope scope{ "staging copy" };
+
+        kernels::pack_plane((uint8_t*)in0_m0.data, src0_p[0], stride0[0], w * bytes_per_comp, h);
+        kernels::pack_plane((uint8_t*)in1_m0.data, src1_p[0], stride1[0], w * bytes_per_comp, h);
+        kernels::pack_plane((uint8_t*)in0_m1.data, src0_p[1], stride0[1], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in0_m2.data, src0_p[2], stride0[2], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in1_m1.data, src1_p[1], stride1[1], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in1_m2.data, src1_p[2], stride1[2], w_chroma * bytes_per_comp, h_chroma);
     }
 
-    ncnn::VkCompute cmd(vkdev);
-
     // upload
     ncnn::VkMat in0_gpu0;
     ncnn::VkMat in0_gpu1;
@@ -407,35 +911,56 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
         cmd.record_clone(in1_m2, in1_gpu2, opt);
     }
 
+    timer.submit(&RIFETimings::upload);
+
     ncnn::VkMat out_gpu;
+    ncnn::VkMat metrics_gpu;
+
+    // postproc, download and the end of the call, also of the calls that do not run the network
+    const auto download{ [&]() {
+        timer.submit(&RIFETimings::postproc);
+
+        {
+            ncnn::Mat out;
+            cmd.record_clone(out_gpu, out, opt);
+
+            {
+                trace::Scope scope{ "gpu" };
+                cmd.submit_and_wait();
+            }
+
+            {
+                trace::Scope scope{ "readback" };
+                kernels::unscale_planes(out.channel(0), out.channel(1), out.channel(2), dstR, dstG, dstB, w, h, dst_stride);
+            }
+
+            timer.mark(&RIFETimings::readback);
+        }
+
+        {
+            trace::Scope scope{ "reclaim allocators" };
+            vkdev->reclaim_blob_allocator(device_blob_vkallocator);
+            vkdev->reclaim_staging_allocator(staging_vkallocator);
+        }
+
+        update_peak_vram(peak_vkallocator.peak(), timings);
+
+        return 0;
+        } };
 
     if (tta_mode)
     {
-        // preproc
-        ncnn::VkMat in0_gpu_padded[8];
-        ncnn::VkMat in1_gpu_padded[8];
+        // preproc of the identity augmentation, the other 7 are expanded from it when they are needed
+        ncnn::VkMat in0_gpu_padded;
+        ncnn::VkMat in1_gpu_padded;
         {
-            in0_gpu_padded[0].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[1].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[2].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[3].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[4].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[5].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[6].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[7].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-
-            std::vector<ncnn::VkMat> bindings(11);
+            in0_gpu_padded.create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+
+            std::vector<ncnn::VkMat> bindings(4);
             bindings[0] = in0_gpu0;
             bindings[1] = in0_gpu1;
             bindings[2] = in0_gpu2;
-            bindings[3] = in0_gpu_padded[0];
-            bindings[4] = in0_gpu_padded[1];
-            bindings[5] = in0_gpu_padded[2];
-            bindings[6] = in0_gpu_padded[3];
-            bindings[7] = in0_gpu_padded[4];
-            bindings[8] = in0_gpu_padded[5];
-            bindings[9] = in0_gpu_padded[6];
-            bindings[10] = in0_gpu_padded[7];
+            bindings[3] = in0_gpu_padded;
 
             std::vector<ncnn::vk_constant_type> constants(8);
             constants[0].i = w;
@@ -445,32 +970,18 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
             constants[4].i = w_chroma * bytes_per_comp;
             constants[5].i = w_padded;
             constants[6].i = h_padded;
-            constants[7].i = in0_gpu_padded[0].cstep;
+            constants[7].i = in0_gpu_padded.cstep;
 
-            cmd.record_pipeline(rife_preproc, bindings, constants, in0_gpu_padded[0]);
+            cmd.record_pipeline(rife_preproc, bindings, constants, in0_gpu_padded);
         }
         {
-            in1_gpu_padded[0].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[1].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[2].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[3].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[4].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[5].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[6].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[7].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-
-            std::vector<ncnn::VkMat> bindings(11);
+            in1_gpu_padded.create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+
+            std::vector<ncnn::VkMat> bindings(4);
             bindings[0] = in1_gpu0;
             bindings[1] = in1_gpu1;
             bindings[2] = in1_gpu2;
-            bindings[3] = in1_gpu_padded[0];
-            bindings[4] = in1_gpu_padded[1];
-            bindings[5] = in1_gpu_padded[2];
-            bindings[6] = in1_gpu_padded[3];
-            bindings[7] = in1_gpu_padded[4];
-            bindings[8] = in1_gpu_padded[5];
-            bindings[9] = in1_gpu_padded[6];
-            bindings[10] = in1_gpu_padded[7];
+            bindings[3] = in1_gpu_padded;
 
             std::vector<ncnn::vk_constant_type> constants(8);
             constants[0].i = w;
@@ -480,29 +991,91 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
             constants[4].i = w_chroma * bytes_per_comp;
             constants[5].i = w_padded;
             constants[6].i = h_padded;
-            constants[7].i = in1_gpu_padded[0].cstep;
+            constants[7].i = in1_gpu_padded.cstep;
 
-            cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_padded[0]);
+            cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_padded);
         }
 
-        ncnn::VkMat flow[8];
-        for (int ti = 0; ti < 8; ++ti)
+        // save some memory
+        in0_gpu0.release();
+        in0_gpu1.release();
+        in0_gpu2.release();
+        in1_gpu0.release();
+        in1_gpu1.release();
+        in1_gpu2.release();
+
+        if (analysis)
+            record_analysis(cmd, in0_gpu_padded, in1_gpu_padded, w, h, *analysis, metrics_gpu, blob_vkallocator);
+
+        timer.submit(&RIFETimings::preproc);
+
+        // the decision is read back before the network is recorded, the blended and copied frames do not run it
+        if (analysis && read_analysis(cmd, metrics_gpu, *analysis, opt))
         {
-            // flownet
+            out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
+            record_select(cmd, metrics_gpu, in0_gpu_padded, in1_gpu_padded, out_gpu, timestep);
+
+            return download();
+        }
+
+        // op 0 expands identity into the augmentation ti, op 1 adds the augmentation in the identity orientation to acc,
+        // op 2 writes acc / tta_level to identity
+        const auto record_tta{ [&](const ncnn::Pipeline* pipeline, const ncnn::VkMat& aug, const ncnn::VkMat& identity, const ncnn::VkMat& acc,
+            const int identity_w, const int identity_h, const int ti, const int op) {
+            std::vector<ncnn::VkMat> bindings(5);
+            bindings[0] = aug;
+            bindings[1] = aug;
+            bindings[2] = identity;
+            bindings[3] = identity;
+            bindings[4] = acc;
+
+            std::vector<ncnn::vk_constant_type> constants(7);
+            constants[0].i = identity_w;
+            constants[1].i = identity_h;
+            constants[2].i = (op == 2) ? identity.cstep : aug.cstep;
+            constants[3].i = acc.cstep;
+            constants[4].i = ti;
+            constants[5].i = op;
+            constants[6].i = (op == 1 && ti == 0);
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = identity_w;
+            dispatcher.h = identity_h;
+            dispatcher.c = 1;
+            cmd.record_pipeline(pipeline, bindings, constants, dispatcher);
+            } };
+
+        const auto expand_input{ [&](const ncnn::VkMat& identity, ncnn::VkMat& aug, const int ti) {
+            if (ti == 0)
+            {
+                aug = identity;
+                return;
+            }
+
+            if (ti < 4)
+                aug.create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            else
+                aug.create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+
+            record_tta(rife_tta_image, aug, identity, ncnn::VkMat{}, w_padded, h_padded, ti, 0);
+            } };
+
+        const auto run_flownet{ [&](const ncnn::VkMat& in0, const ncnn::VkMat& in1, ncnn::VkMat& flow) {
             ncnn::Extractor ex = flownet.create_extractor();
+            ex.set_light_mode(true);
             ex.set_blob_vkallocator(blob_vkallocator);
             ex.set_workspace_vkallocator(blob_vkallocator);
             ex.set_staging_vkallocator(staging_vkallocator);
 
             if (uhd_mode)
             {
-                ncnn::VkMat in0_gpu_padded_downscaled;
-                ncnn::VkMat in1_gpu_padded_downscaled;
-                rife_uhd_downscale_image->forward(in0_gpu_padded[ti], in0_gpu_padded_downscaled, cmd, opt);
-                rife_uhd_downscale_image->forward(in1_gpu_padded[ti], in1_gpu_padded_downscaled, cmd, opt);
+                ncnn::VkMat in0_downscaled;
+                ncnn::VkMat in1_downscaled;
+                rife_uhd_downscale_image->forward(in0, in0_downscaled, cmd, opt);
+                rife_uhd_downscale_image->forward(in1, in1_downscaled, cmd, opt);
 
-                ex.input("input0", in0_gpu_padded_downscaled);
-                ex.input("input1", in1_gpu_padded_downscaled);
+                ex.input("input0", in0_downscaled);
+                ex.input("input1", in1_downscaled);
 
                 ncnn::VkMat flow_downscaled;
                 ex.extract("flow", flow_downscaled, cmd);
@@ -510,324 +1083,310 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
                 ncnn::VkMat flow_half;
                 rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, cmd, opt);
 
-                rife_uhd_double_flow->forward(flow_half, flow[ti], cmd, opt);
+                rife_uhd_double_flow->forward(flow_half, flow, cmd, opt);
             }
             else
             {
-                ex.input("input0", in0_gpu_padded[ti]);
-                ex.input("input1", in1_gpu_padded[ti]);
-                ex.extract("flow", flow[ti], cmd);
+                ex.input("input0", in0);
+                ex.input("input1", in1);
+                ex.extract("flow", flow, cmd);
             }
-        }
+            } };
 
-        ncnn::VkMat flow_reversed[8];
-        if (tta_temporal_mode)
+        // with fewer than tta_level augmentations per batch the expanded inputs are released after each batch and expanded
+        // again for contextnet/fusionnet, otherwise they are kept
+        const int batch{ (std::min)(tta_batch.load(std::memory_order_relaxed), tta_level) };
+        const bool keep_inputs{ batch >= tta_level };
+
+        ncnn::VkMat in0_aug[8];
+        ncnn::VkMat in1_aug[8];
+
+        // flownet of every augmentation, the flows are averaged in the identity orientation
+        ncnn::VkMat flow;
+        ncnn::VkMat flow_reversed;
         {
-            for (int ti = 0; ti < 8; ++ti)
+            ncnn::VkMat flow_acc;
+            ncnn::VkMat flow_reversed_acc;
+            int flow_w{};
+            int flow_h{};
+
+            for (int first = 0; first < tta_level; first += batch)
             {
-                // flownet
-                ncnn::Extractor ex = flownet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
+                const int last{ (std::min)(first + batch, tta_level) };
+
+                for (int ti = first; ti < last; ++ti)
+                {
+                    expand_input(in0_gpu_padded, in0_aug[ti], ti);
+                    expand_input(in1_gpu_padded, in1_aug[ti], ti);
+                }
 
-                if (uhd_mode)
+                for (int ti = first; ti < last; ++ti)
                 {
-                    ncnn::VkMat in0_gpu_padded_downscaled;
-                    ncnn::VkMat in1_gpu_padded_downscaled;
-                    rife_uhd_downscale_image->forward(in0_gpu_padded[ti], in0_gpu_padded_downscaled, cmd, opt);
-                    rife_uhd_downscale_image->forward(in1_gpu_padded[ti], in1_gpu_padded_downscaled, cmd, opt);
+                    ncnn::VkMat flow_aug;
+                    run_flownet(in0_aug[ti], in1_aug[ti], flow_aug);
+
+                    if (ti == 0)
+                    {
+                        flow_w = flow_aug.w;
+                        flow_h = flow_aug.h;
+                        flow_acc.create(flow_w, flow_h, flow_aug.c * flow_aug.elempack, 4u, 1, blob_vkallocator);
+                        flow.create(flow_w, flow_h, flow_aug.c, flow_aug.elemsize, flow_aug.elempack, blob_vkallocator);
+                    }
 
-                    ex.input("input0", in1_gpu_padded_downscaled);
-                    ex.input("input1", in0_gpu_padded_downscaled);
+                    record_tta(rife_tta_flow, flow_aug, ncnn::VkMat{}, flow_acc, flow_w, flow_h, ti, 1);
 
-                    ncnn::VkMat flow_downscaled;
-                    ex.extract("flow", flow_downscaled, cmd);
+                    if (tta_temporal_mode)
+                    {
+                        ncnn::VkMat flow_reversed_aug;
+                        run_flownet(in1_aug[ti], in0_aug[ti], flow_reversed_aug);
 
-                    ncnn::VkMat flow_half;
-                    rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, cmd, opt);
+                        if (ti == 0)
+                        {
+                            flow_reversed_acc.create_like(flow_acc, blob_vkallocator);
+                            flow_reversed.create_like(flow, blob_vkallocator);
+                        }
 
-                    rife_uhd_double_flow->forward(flow_half, flow_reversed[ti], cmd, opt);
+                        record_tta(rife_tta_flow, flow_reversed_aug, ncnn::VkMat{}, flow_reversed_acc, flow_w, flow_h, ti, 1);
+                    }
                 }
-                else
+
+                if (!keep_inputs)
                 {
-                    ex.input("input0", in1_gpu_padded[ti]);
-                    ex.input("input1", in0_gpu_padded[ti]);
-                    ex.extract("flow", flow_reversed[ti], cmd);
+                    for (int ti = first; ti < last; ++ti)
+                    {
+                        in0_aug[ti].release();
+                        in1_aug[ti].release();
+                    }
                 }
             }
-        }
 
-        // avg flow
-        ncnn::VkMat flow0[8];
-        ncnn::VkMat flow1[8];
-        {
-            std::vector<ncnn::VkMat> bindings(8);
-            bindings[0] = flow[0];
-            bindings[1] = flow[1];
-            bindings[2] = flow[2];
-            bindings[3] = flow[3];
-            bindings[4] = flow[4];
-            bindings[5] = flow[5];
-            bindings[6] = flow[6];
-            bindings[7] = flow[7];
-
-            std::vector<ncnn::vk_constant_type> constants(3);
-            constants[0].i = flow[0].w;
-            constants[1].i = flow[0].h;
-            constants[2].i = flow[0].cstep;
-
-            ncnn::VkMat dispatcher;
-            dispatcher.w = flow[0].w;
-            dispatcher.h = flow[0].h;
-            dispatcher.c = 1;
-            cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
-        }
-
-        if (tta_temporal_mode)
-        {
-            std::vector<ncnn::VkMat> bindings(8);
-            bindings[0] = flow_reversed[0];
-            bindings[1] = flow_reversed[1];
-            bindings[2] = flow_reversed[2];
-            bindings[3] = flow_reversed[3];
-            bindings[4] = flow_reversed[4];
-            bindings[5] = flow_reversed[5];
-            bindings[6] = flow_reversed[6];
-            bindings[7] = flow_reversed[7];
-
-            std::vector<ncnn::vk_constant_type> constants(3);
-            constants[0].i = flow_reversed[0].w;
-            constants[1].i = flow_reversed[0].h;
-            constants[2].i = flow_reversed[0].cstep;
-
-            ncnn::VkMat dispatcher;
-            dispatcher.w = flow_reversed[0].w;
-            dispatcher.h = flow_reversed[0].h;
-            dispatcher.c = 1;
-            cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
+            record_tta(rife_tta_flow, ncnn::VkMat{}, flow, flow_acc, flow_w, flow_h, 0, 2);
 
-            // merge flow and flow_reversed
-            for (int ti = 0; ti < 8; ++ti)
+            if (tta_temporal_mode)
             {
+                record_tta(rife_tta_flow, ncnn::VkMat{}, flow_reversed, flow_reversed_acc, flow_w, flow_h, 0, 2);
+
+                // merge flow and flow_reversed, the merge is per pixel so it's done once in the identity orientation
                 std::vector<ncnn::VkMat> bindings(2);
-                bindings[0] = flow[ti];
-                bindings[1] = flow_reversed[ti];
+                bindings[0] = flow;
+                bindings[1] = flow_reversed;
 
                 std::vector<ncnn::vk_constant_type> constants(3);
-                constants[0].i = flow[ti].w;
-                constants[1].i = flow[ti].h;
-                constants[2].i = flow[ti].cstep;
+                constants[0].i = flow.w;
+                constants[1].i = flow.h;
+                constants[2].i = flow.cstep;
 
                 ncnn::VkMat dispatcher;
-                dispatcher.w = flow[ti].w;
-                dispatcher.h = flow[ti].h;
+                dispatcher.w = flow.w;
+                dispatcher.h = flow.h;
                 dispatcher.c = 1;
 
                 cmd.record_pipeline(rife_flow_tta_temporal_avg, bindings, constants, dispatcher);
             }
         }
 
-        if (rife_v2)
+        // contextnet and fusionnet of every augmentation, the outputs are averaged in the identity orientation
+        ncnn::VkMat out_acc;
+        out_acc.create(w_padded, h_padded, 3, 4u, 1, blob_vkallocator);
+
+        for (int first = 0; first < tta_level; first += batch)
         {
-            for (int ti = 0; ti < 8; ++ti)
+            const int last{ (std::min)(first + batch, tta_level) };
+
+            if (!keep_inputs)
             {
-                std::vector<ncnn::VkMat> inputs(1);
-                inputs[0] = flow[ti];
-                std::vector<ncnn::VkMat> outputs(2);
-                rife_v2_slice_flow->forward(inputs, outputs, cmd, opt);
-                flow0[ti] = outputs[0];
-                flow1[ti] = outputs[1];
+                for (int ti = first; ti < last; ++ti)
+                {
+                    expand_input(in0_gpu_padded, in0_aug[ti], ti);
+                    expand_input(in1_gpu_padded, in1_aug[ti], ti);
+                }
             }
-        }
 
-        ncnn::VkMat out_gpu_padded[8];
-        for (int ti = 0; ti < 8; ++ti)
-        {
-            // contextnet
-            ncnn::VkMat ctx0[4];
-            ncnn::VkMat ctx1[4];
+            for (int ti = first; ti < last; ++ti)
             {
-                ncnn::Extractor ex = contextnet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
-
-                ex.input("input.1", in0_gpu_padded[ti]);
-                if (rife_v2)
+                ncnn::VkMat flow_aug;
+                ncnn::VkMat flow_reversed_aug;
+                if (ti == 0)
                 {
-                    ex.input("flow.0", flow0[ti]);
+                    flow_aug = flow;
+                    flow_reversed_aug = flow_reversed;
                 }
                 else
                 {
-                    ex.input("flow.0", flow[ti]);
+                    const int aug_w{ (ti < 4) ? flow.w : flow.h };
+                    const int aug_h{ (ti < 4) ? flow.h : flow.w };
+
+                    flow_aug.create(aug_w, aug_h, flow.c, flow.elemsize, flow.elempack, blob_vkallocator);
+                    record_tta(rife_tta_flow, flow_aug, flow, ncnn::VkMat{}, flow.w, flow.h, ti, 0);
+
+                    if (tta_temporal_mode)
+                    {
+                        flow_reversed_aug.create(aug_w, aug_h, flow.c, flow.elemsize, flow.elempack, blob_vkallocator);
+                        record_tta(rife_tta_flow, flow_reversed_aug, flow_reversed, ncnn::VkMat{}, flow.w, flow.h, ti, 0);
+                    }
                 }
-                ex.extract("f1", ctx0[0], cmd);
-                ex.extract("f2", ctx0[1], cmd);
-                ex.extract("f3", ctx0[2], cmd);
-                ex.extract("f4", ctx0[3], cmd);
-            }
-            {
-                ncnn::Extractor ex = contextnet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
 
-                ex.input("input.1", in1_gpu_padded[ti]);
+                ncnn::VkMat flow0;
+                ncnn::VkMat flow1;
                 if (rife_v2)
                 {
-                    ex.input("flow.0", flow1[ti]);
+                    std::vector<ncnn::VkMat> inputs(1);
+                    inputs[0] = flow_aug;
+                    std::vector<ncnn::VkMat> outputs(2);
+                    rife_v2_slice_flow->forward(inputs, outputs, cmd, opt);
+                    flow0 = outputs[0];
+                    flow1 = outputs[1];
                 }
-                else
-                {
-                    ex.input("flow.1", flow[ti]);
-                }
-                ex.extract("f1", ctx1[0], cmd);
-                ex.extract("f2", ctx1[1], cmd);
-                ex.extract("f3", ctx1[2], cmd);
-                ex.extract("f4", ctx1[3], cmd);
-            }
-
-            // fusionnet
-            {
-                ncnn::Extractor ex = fusionnet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
 
-                ex.input("img0", in0_gpu_padded[ti]);
-                ex.input("img1", in1_gpu_padded[ti]);
-                ex.input("flow", flow[ti]);
-                ex.input("3", ctx0[0]);
-                ex.input("4", ctx0[1]);
-                ex.input("5", ctx0[2]);
-                ex.input("6", ctx0[3]);
-                ex.input("7", ctx1[0]);
-                ex.input("8", ctx1[1]);
-                ex.input("9", ctx1[2]);
-                ex.input("10", ctx1[3]);
+                // contextnet
+                ncnn::VkMat ctx0[4];
+                ncnn::VkMat ctx1[4];
+                {
+                    ncnn::Extractor ex = contextnet.create_extractor();
+                    ex.set_light_mode(true);
+                    ex.set_blob_vkallocator(blob_vkallocator);
+                    ex.set_workspace_vkallocator(blob_vkallocator);
+                    ex.set_staging_vkallocator(staging_vkallocator);
 
-                // save some memory
-                if (!tta_temporal_mode)
+                    ex.input("input.1", in0_aug[ti]);
+                    if (rife_v2)
+                    {
+                        ex.input("flow.0", flow0);
+                    }
+                    else
+                    {
+                        ex.input("flow.0", flow_aug);
+                    }
+                    ex.extract("f1", ctx0[0], cmd);
+                    ex.extract("f2", ctx0[1], cmd);
+                    ex.extract("f3", ctx0[2], cmd);
+                    ex.extract("f4", ctx0[3], cmd);
+                }
                 {
-                    if (ti == 0)
+                    ncnn::Extractor ex = contextnet.create_extractor();
+                    ex.set_light_mode(true);
+                    ex.set_blob_vkallocator(blob_vkallocator);
+                    ex.set_workspace_vkallocator(blob_vkallocator);
+                    ex.set_staging_vkallocator(staging_vkallocator);
+
+                    ex.input("input.1", in1_aug[ti]);
+                    if (rife_v2)
                     {
-                        in0_gpu0.release();
-                        in0_gpu1.release();
-                        in0_gpu2.release();
-                        in1_gpu0.release();
-                        in1_gpu1.release();
-                        in1_gpu2.release();
+                        ex.input("flow.0", flow1);
                     }
                     else
                     {
-                        in0_gpu_padded[ti - 1].release();
-                        in1_gpu_padded[ti - 1].release();
+                        ex.input("flow.1", flow_aug);
                     }
-                    ctx0[0].release();
-                    ctx0[1].release();
-                    ctx0[2].release();
-                    ctx0[3].release();
-                    ctx1[0].release();
-                    ctx1[1].release();
-                    ctx1[2].release();
-                    ctx1[3].release();
+                    ex.extract("f1", ctx1[0], cmd);
+                    ex.extract("f2", ctx1[1], cmd);
+                    ex.extract("f3", ctx1[2], cmd);
+                    ex.extract("f4", ctx1[3], cmd);
                 }
-                if (ti != 0)
-                    flow[ti - 1].release();
 
-                ex.extract("output", out_gpu_padded[ti], cmd);
-            }
+                flow0.release();
+                flow1.release();
 
-            if (tta_temporal_mode)
-            {
                 // fusionnet
-                ncnn::VkMat out_gpu_padded_reversed;
+                ncnn::VkMat out_aug;
                 {
                     ncnn::Extractor ex = fusionnet.create_extractor();
+                    ex.set_light_mode(true);
                     ex.set_blob_vkallocator(blob_vkallocator);
                     ex.set_workspace_vkallocator(blob_vkallocator);
                     ex.set_staging_vkallocator(staging_vkallocator);
 
-                    ex.input("img0", in1_gpu_padded[ti]);
-                    ex.input("img1", in0_gpu_padded[ti]);
-                    ex.input("flow", flow_reversed[ti]);
-                    ex.input("3", ctx1[0]);
-                    ex.input("4", ctx1[1]);
-                    ex.input("5", ctx1[2]);
-                    ex.input("6", ctx1[3]);
-                    ex.input("7", ctx0[0]);
-                    ex.input("8", ctx0[1]);
-                    ex.input("9", ctx0[2]);
-                    ex.input("10", ctx0[3]);
-
-                    // save some memory
-                    if (ti == 0)
+                    ex.input("img0", in0_aug[ti]);
+                    ex.input("img1", in1_aug[ti]);
+                    ex.input("flow", flow_aug);
+                    ex.input("3", ctx0[0]);
+                    ex.input("4", ctx0[1]);
+                    ex.input("5", ctx0[2]);
+                    ex.input("6", ctx0[3]);
+                    ex.input("7", ctx1[0]);
+                    ex.input("8", ctx1[1]);
+                    ex.input("9", ctx1[2]);
+                    ex.input("10", ctx1[3]);
+                    ex.extract("output", out_aug, cmd);
+                }
+
+                if (tta_temporal_mode)
+                {
+                    // fusionnet
+                    ncnn::VkMat out_reversed_aug;
                     {
-                        in0_gpu0.release();
-                        in0_gpu1.release();
-                        in0_gpu2.release();
-                        in1_gpu0.release();
-                        in1_gpu1.release();
-                        in1_gpu2.release();
+                        ncnn::Extractor ex = fusionnet.create_extractor();
+                        ex.set_light_mode(true);
+                        ex.set_blob_vkallocator(blob_vkallocator);
+                        ex.set_workspace_vkallocator(blob_vkallocator);
+                        ex.set_staging_vkallocator(staging_vkallocator);
+
+                        ex.input("img0", in1_aug[ti]);
+                        ex.input("img1", in0_aug[ti]);
+                        ex.input("flow", flow_reversed_aug);
+                        ex.input("3", ctx1[0]);
+                        ex.input("4", ctx1[1]);
+                        ex.input("5", ctx1[2]);
+                        ex.input("6", ctx1[3]);
+                        ex.input("7", ctx0[0]);
+                        ex.input("8", ctx0[1]);
+                        ex.input("9", ctx0[2]);
+                        ex.input("10", ctx0[3]);
+                        ex.extract("output", out_reversed_aug, cmd);
                     }
-                    else
+
+                    // merge output
                     {
-                        in0_gpu_padded[ti - 1].release();
-                        in1_gpu_padded[ti - 1].release();
-                        flow_reversed[ti - 1].release();
+                        std::vector<ncnn::VkMat> bindings(2);
+                        bindings[0] = out_aug;
+                        bindings[1] = out_reversed_aug;
+
+                        std::vector<ncnn::vk_constant_type> constants(3);
+                        constants[0].i = out_aug.w;
+                        constants[1].i = out_aug.h;
+                        constants[2].i = out_aug.cstep;
+
+                        ncnn::VkMat dispatcher;
+                        dispatcher.w = out_aug.w;
+                        dispatcher.h = out_aug.h;
+                        dispatcher.c = 3;
+                        cmd.record_pipeline(rife_out_tta_temporal_avg, bindings, constants, dispatcher);
                     }
-                    ctx0[0].release();
-                    ctx0[1].release();
-                    ctx0[2].release();
-                    ctx0[3].release();
-                    ctx1[0].release();
-                    ctx1[1].release();
-                    ctx1[2].release();
-                    ctx1[3].release();
-
-                    ex.extract("output", out_gpu_padded_reversed, cmd);
                 }
 
-                // merge output
+                record_tta(rife_tta_image, out_aug, ncnn::VkMat{}, out_acc, w_padded, h_padded, ti, 1);
+
+                // the identity inputs are kept for the select pass
+                if (ti != 0)
                 {
-                    std::vector<ncnn::VkMat> bindings(2);
-                    bindings[0] = out_gpu_padded[ti];
-                    bindings[1] = out_gpu_padded_reversed;
-
-                    std::vector<ncnn::vk_constant_type> constants(3);
-                    constants[0].i = out_gpu_padded[ti].w;
-                    constants[1].i = out_gpu_padded[ti].h;
-                    constants[2].i = out_gpu_padded[ti].cstep;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = out_gpu_padded[ti].w;
-                    dispatcher.h = out_gpu_padded[ti].h;
-                    dispatcher.c = 3;
-                    cmd.record_pipeline(rife_out_tta_temporal_avg, bindings, constants, dispatcher);
+                    in0_aug[ti].release();
+                    in1_aug[ti].release();
                 }
             }
         }
 
+        flow.release();
+        flow_reversed.release();
+
+        ncnn::VkMat out_gpu_padded;
+        out_gpu_padded.create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+        record_tta(rife_tta_image, ncnn::VkMat{}, out_gpu_padded, out_acc, w_padded, h_padded, 0, 2);
+        out_acc.release();
+
+        timer.submit(&RIFETimings::infer);
+
         out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
 
         // postproc
         {
-            std::vector<ncnn::VkMat> bindings(9);
-            bindings[0] = out_gpu_padded[0];
-            bindings[1] = out_gpu_padded[1];
-            bindings[2] = out_gpu_padded[2];
-            bindings[3] = out_gpu_padded[3];
-            bindings[4] = out_gpu_padded[4];
-            bindings[5] = out_gpu_padded[5];
-            bindings[6] = out_gpu_padded[6];
-            bindings[7] = out_gpu_padded[7];
-            bindings[8] = out_gpu;
+            std::vector<ncnn::VkMat> bindings(2);
+            bindings[0] = out_gpu_padded;
+            bindings[1] = out_gpu;
 
             std::vector<ncnn::vk_constant_type> constants(6);
-            constants[0].i = out_gpu_padded[0].w;
-            constants[1].i = out_gpu_padded[0].h;
-            constants[2].i = out_gpu_padded[0].cstep;
+            constants[0].i = out_gpu_padded.w;
+            constants[1].i = out_gpu_padded.h;
+            constants[2].i = out_gpu_padded.cstep;
             constants[3].i = out_gpu.w;
             constants[4].i = out_gpu.h;
             constants[5].i = out_gpu.cstep;
@@ -883,6 +1442,20 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
             cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_padded);
         }
 
+        if (analysis)
+            record_analysis(cmd, in0_gpu_padded, in1_gpu_padded, w, h, *analysis, metrics_gpu, blob_vkallocator);
+
+        timer.submit(&RIFETimings::preproc);
+
+        // the decision is read back before the network is recorded, the blended and copied frames do not run it
+        if (analysis && read_analysis(cmd, metrics_gpu, *analysis, opt))
+        {
+            out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
+            record_select(cmd, metrics_gpu, in0_gpu_padded, in1_gpu_padded, out_gpu, timestep);
+
+            return download();
+        }
+
         // flownet
         ncnn::VkMat flow;
         ncnn::VkMat flow0;
@@ -1131,6 +1704,8 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
             }
         }
 
+        timer.submit(&RIFETimings::infer);
+
         out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
 
         // postproc
@@ -1151,43 +1726,30 @@ int RIFE::process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3]
         }
     }
 
-    // download
-    {
-        ncnn::Mat out;
-
-        cmd.record_clone(out_gpu, out, opt);
-
-        cmd.submit_and_wait();
-
-        const float* outR{ out.channel(0) };
-        const float* outG{ out.channel(1) };
-        const float* outB{ out.channel(2) };
-        for (auto y{ 0 }; y < h; ++y)
-        {
-            for (auto x{ 0 }; x < w; ++x)
-            {
-                dstR[dst_stride * y + x] = outR[w * y + x] * (1 / 255.0f);
-                dstG[dst_stride * y + x] = outG[w * y + x] * (1 / 255.0f);
-                dstB[dst_stride * y + x] = outB[w * y + x] * (1 / 255.0f);
-            }
-        }
-    }
-
-    vkdev->reclaim_blob_allocator(blob_vkallocator);
-    vkdev->reclaim_staging_allocator(staging_vkallocator);
-
-    return 0;
+    return download();
 }
 
 int RIFE::process_v4(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB,	const int w,
-    const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep) const
+    const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep,
+    RIFEAnalysis* analysis, RIFETimings* timings) const
 {
+    CallTimer call_timer{ stats.interpolate };
+
     const int channels = 3;//in0image.elempack;
 
     //     fprintf(stderr, "%d x %d\n", w, h);
 
-    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    ncnn::VkAllocator* device_blob_vkallocator;
+    ncnn::VkAllocator* staging_vkallocator;
+    {
+        trace::Scope scope{ "acquire allocators" };
+        device_blob_vkallocator = vkdev->acquire_blob_allocator();
+        staging_vkallocator = vkdev->acquire_staging_allocator();
+    }
+
+    // every blob of the call is allocated through it
+    PeakVkAllocator peak_vkallocator{ device_blob_vkallocator };
+    ncnn::VkAllocator* blob_vkallocator{ &peak_vkallocator };
 
     ncnn::Option opt = flownet.opt;
     opt.blob_vkallocator = blob_vkallocator;
@@ -1202,6 +1764,9 @@ int RIFE::process_v4(const uint8_t* const src0_p[3], const uint8_t* const src1_p
     int w_chroma = (chroma_subsampling == 1 || chroma_subsampling == 2) ? w / 2 : w;
     int h_chroma = (chroma_subsampling == 1) ? h / 2 : h;
 
+    ncnn::VkCompute cmd(vkdev);
+    StageTimer timer(cmd, timings);
+
     ncnn::Mat in0_m0(w, h, 1, (size_t)bytes_per_comp);
     ncnn::Mat in0_m1(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
     ncnn::Mat in0_m2(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
@@ -1209,19 +1774,17 @@ int RIFE::process_v4(const uint8_t* const src0_p[3], const uint8_t* const src1_p
     ncnn::Mat in1_m1(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
     ncnn::Mat in1_m2(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
 
-    for (int y = 0; y < h; y++) {
-        std::memcpy((uint8_t*)in0_m0.data + y * w * bytes_per_comp, src0_p[0] + y * stride0[0], w * bytes_per_comp);
-        std::memcpy((uint8_t*)in1_m0.data + y * w * bytes_per_comp, src1_p[0] + y * stride1[0], w * bytes_per_comp);
-    }
-    for (int y = 0; y < h_chroma; y++) {
-        std::memcpy((uint8_t*)in0_m1.data + y * w_chroma * bytes_per_comp, src0_p[1] + y * stride0[1], w_chroma * bytes_per_comp);
-        std::memcpy((uint8_t*)in0_m2.data + y * w_chroma * bytes_per_comp, src0_p[2] + y * stride0[2], w_chroma * bytes_per_comp);
-        std::memcpy((uint8_t*)in1_m1.data + y * w_chroma * bytes_per_comp, src1_p[1] + y * stride1[1], w_chroma * bytes_per_comp);
-        std::memcpy((uint8_t*)in1_m2.data + y * w_chroma * bytes_per_comp, src1_p[2] + y * stride1[2], w_chroma * bytes_per_comp);
+    {
+        trace::Scope scope{ "staging copy" };
+
+        kernels::pack_plane((uint8_t*)in0_m0.data, src0_p[0], stride0[0], w * bytes_per_comp, h);
+        kernels::pack_plane((uint8_t*)in1_m0.data, src1_p[0], stride1[0], w * bytes_per_comp, h);
+        kernels::pack_plane((uint8_t*)in0_m1.data, src0_p[1], stride0[1], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in0_m2.data, src0_p[2], stride0[2], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in1_m1.data, src1_p[1], stride1[1], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in1_m2.data, src1_p[2], stride1[2], w_chroma * bytes_per_comp, h_chroma);
     }
 
-    ncnn::VkCompute cmd(vkdev);
-
     // upload
     ncnn::VkMat in0_gpu0;
     ncnn::VkMat in0_gpu1;
@@ -1238,7 +1801,42 @@ int RIFE::process_v4(const uint8_t* const src0_p[3], const uint8_t* const src1_p
         cmd.record_clone(in1_m2, in1_gpu2, opt);
     }
 
+    timer.submit(&RIFETimings::upload);
+
     ncnn::VkMat out_gpu;
+    ncnn::VkMat metrics_gpu;
+
+    // postproc, download and the end of the call, also of the calls that do not run the network
+    const auto download{ [&]() {
+        timer.submit(&RIFETimings::postproc);
+
+        {
+            ncnn::Mat out;
+            cmd.record_clone(out_gpu, out, opt);
+
+            {
+                trace::Scope scope{ "gpu" };
+                cmd.submit_and_wait();
+            }
+
+            {
+                trace::Scope scope{ "readback" };
+                kernels::unscale_planes(out.channel(0), out.channel(1), out.channel(2), dstR, dstG, dstB, w, h, dst_stride);
+            }
+
+            timer.mark(&RIFETimings::readback);
+        }
+
+        {
+            trace::Scope scope{ "reclaim allocators" };
+            vkdev->reclaim_blob_allocator(device_blob_vkallocator);
+            vkdev->reclaim_staging_allocator(staging_vkallocator);
+        }
+
+        update_peak_vram(peak_vkallocator.peak(), timings);
+
+        return 0;
+        } };
 
     {
         // preproc
@@ -1302,6 +1900,20 @@ int RIFE::process_v4(const uint8_t* const src0_p[3], const uint8_t* const src1_p
             cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded);
         }
 
+        if (analysis)
+            record_analysis(cmd, in0_gpu_padded, in1_gpu_padded, w, h, *analysis, metrics_gpu, blob_vkallocator);
+
+        timer.submit(&RIFETimings::preproc);
+
+        // the decision is read back before the network is recorded, the blended and copied frames do not run it
+        if (analysis && read_analysis(cmd, metrics_gpu, *analysis, opt))
+        {
+            out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
+            record_select(cmd, metrics_gpu, in0_gpu_padded, in1_gpu_padded, out_gpu, timestep);
+
+            return download();
+        }
+
         // flownet
         ncnn::VkMat out_gpu_padded;
         {
@@ -1324,6 +1936,8 @@ int RIFE::process_v4(const uint8_t* const src0_p[3], const uint8_t* const src1_p
             ex.extract("out0", out_gpu_padded, cmd);
         }
 
+        timer.submit(&RIFETimings::infer);
+
         out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
 
         // postproc
@@ -1344,39 +1958,38 @@ int RIFE::process_v4(const uint8_t* const src0_p[3], const uint8_t* const src1_p
         }
     }
 
-    // download
-    {
-        ncnn::Mat out;
+    return download();
+}
 
-        cmd.record_clone(out_gpu, out, opt);
+int RIFE::process_copy(const uint8_t* const src_p[3], float* dstR, float* dstG, float* dstB, const int w, const int h,
+    const ptrdiff_t stride[3], const ptrdiff_t dst_stride, ConvertThreads* threads, RIFETimings* timings) const
+{
+    trace::Scope scope{ "convert" };
+    CallTimer call_timer{ stats.convert };
+    const auto start{ timings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{} };
 
-        cmd.submit_and_wait();
+    const ConvertFormat fmt{ is_yuv, chroma_subsampling, matrix_in, bytes_per_comp, full_range, bit_depth, flownet.opt.use_fp16_storage };
+    convert_frame(fmt, src_p, stride, dstR, dstG, dstB, dst_stride, w, h, threads);
 
-        const float* outR{ out.channel(0) };
-        const float* outG{ out.channel(1) };
-        const float* outB{ out.channel(2) };
-        for (auto y{ 0 }; y < h; ++y)
-        {
-            for (auto x{ 0 }; x < w; ++x)
-            {
-                dstR[dst_stride * y + x] = outR[w * y + x] * (1 / 255.0f);
-                dstG[dst_stride * y + x] = outG[w * y + x] * (1 / 255.0f);
-                dstB[dst_stride * y + x] = outB[w * y + x] * (1 / 255.0f);
-            }
-        }
-    }
-
-    vkdev->reclaim_blob_allocator(blob_vkallocator);
-    vkdev->reclaim_staging_allocator(staging_vkallocator);
+    if (timings)
+        timings->convert += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
 
     return 0;
 }
 
-int RIFE::process_copy(const uint8_t* const src_p[3], float* dstR, float* dstG, float* dstB, const int w, const int h,
-    const ptrdiff_t stride[3], const ptrdiff_t dst_stride) const
+int RIFE::process_blend(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB, const int w,
+    const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float weight,
+    RIFETimings* timings) const
 {
-    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    CallTimer call_timer{ stats.blend };
+
+    ncnn::VkAllocator* blob_vkallocator;
+    ncnn::VkAllocator* staging_vkallocator;
+    {
+        trace::Scope scope{ "acquire allocators" };
+        blob_vkallocator = vkdev->acquire_blob_allocator();
+        staging_vkallocator = vkdev->acquire_staging_allocator();
+    }
 
     ncnn::Option opt = flownet.opt;
     opt.blob_vkallocator = blob_vkallocator;
@@ -1386,86 +1999,131 @@ int RIFE::process_copy(const uint8_t* const src_p[3], float* dstR, float* dstG,
     int w_chroma = (chroma_subsampling == 1 || chroma_subsampling == 2) ? w / 2 : w;
     int h_chroma = (chroma_subsampling == 1) ? h / 2 : h;
 
-    ncnn::Mat in_m0(w, h, 1, (size_t)bytes_per_comp);
-    ncnn::Mat in_m1(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
-    ncnn::Mat in_m2(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
+    ncnn::VkCompute cmd(vkdev);
+    StageTimer timer(cmd, timings);
 
-    for (int y = 0; y < h; y++) {
-        std::memcpy((uint8_t*)in_m0.data + y * w * bytes_per_comp, src_p[0] + y * stride[0], w * bytes_per_comp);
-    }
-    for (int y = 0; y < h_chroma; y++) {
-        std::memcpy((uint8_t*)in_m1.data + y * w_chroma * bytes_per_comp, src_p[1] + y * stride[1], w_chroma * bytes_per_comp);
-        std::memcpy((uint8_t*)in_m2.data + y * w_chroma * bytes_per_comp, src_p[2] + y * stride[2], w_chroma * bytes_per_comp);
+    ncnn::Mat in0_m0(w, h, 1, (size_t)bytes_per_comp);
+    ncnn::Mat in0_m1(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
+    ncnn::Mat in0_m2(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
+    ncnn::Mat in1_m0(w, h, 1, (size_t)bytes_per_comp);
+    ncnn::Mat in1_m1(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
+    ncnn::Mat in1_m2(w_chroma, h_chroma, 1, (size_t)bytes_per_comp);
+
+    {
+        trace::Scope scope{ "staging copy" };
+
+        kernels::pack_plane((uint8_t*)in0_m0.data, src0_p[0], stride0[0], w * bytes_per_comp, h);
+        kernels::pack_plane((uint8_t*)in1_m0.data, src1_p[0], stride1[0], w * bytes_per_comp, h);
+        kernels::pack_plane((uint8_t*)in0_m1.data, src0_p[1], stride0[1], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in0_m2.data, src0_p[2], stride0[2], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in1_m1.data, src1_p[1], stride1[1], w_chroma * bytes_per_comp, h_chroma);
+        kernels::pack_plane((uint8_t*)in1_m2.data, src1_p[2], stride1[2], w_chroma * bytes_per_comp, h_chroma);
     }
 
-    ncnn::VkCompute cmd(vkdev);
+    ncnn::VkMat in0_gpu0;
+    ncnn::VkMat in0_gpu1;
+    ncnn::VkMat in0_gpu2;
+    ncnn::VkMat in1_gpu0;
+    ncnn::VkMat in1_gpu1;
+    ncnn::VkMat in1_gpu2;
+    cmd.record_clone(in0_m0, in0_gpu0, opt);
+    cmd.record_clone(in0_m1, in0_gpu1, opt);
+    cmd.record_clone(in0_m2, in0_gpu2, opt);
+    cmd.record_clone(in1_m0, in1_gpu0, opt);
+    cmd.record_clone(in1_m1, in1_gpu1, opt);
+    cmd.record_clone(in1_m2, in1_gpu2, opt);
 
-    ncnn::VkMat in_gpu0;
-    ncnn::VkMat in_gpu1;
-    ncnn::VkMat in_gpu2;
-    cmd.record_clone(in_m0, in_gpu0, opt);
-    cmd.record_clone(in_m1, in_gpu1, opt);
-    cmd.record_clone(in_m2, in_gpu2, opt);
+    timer.submit(&RIFETimings::upload);
 
-    const int w_padded = (w + (padding - 1)) / padding * padding;
-    const int h_padded = (h + (padding - 1)) / padding * padding;
+    // the frames are converted like the input of the network (fp16 with fp16 storage, as process_copy rounds them), without padding
     const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
 
-    ncnn::VkMat in_gpu_padded;
-    in_gpu_padded.create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-
-    std::vector<ncnn::VkMat> bindings(4);
-    bindings[0] = in_gpu0;
-    bindings[1] = in_gpu1;
-    bindings[2] = in_gpu2;
-    bindings[3] = in_gpu_padded;
-
-    std::vector<ncnn::vk_constant_type> constants(8);
-    constants[0].i = w;
-    constants[1].i = h;
-    constants[2].i = w * bytes_per_comp;
-    constants[3].i = w_chroma * bytes_per_comp;
-    constants[4].i = w_chroma * bytes_per_comp;
-    constants[5].i = w_padded;
-    constants[6].i = h_padded;
-    constants[7].i = in_gpu_padded.cstep;
-
-    cmd.record_pipeline(rife_preproc, bindings, constants, in_gpu_padded);
+    ncnn::VkMat in0_gpu_rgb;
+    ncnn::VkMat in1_gpu_rgb;
+    {
+        in0_gpu_rgb.create(w, h, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+
+        std::vector<ncnn::VkMat> bindings(4);
+        bindings[0] = in0_gpu0;
+        bindings[1] = in0_gpu1;
+        bindings[2] = in0_gpu2;
+        bindings[3] = in0_gpu_rgb;
+
+        std::vector<ncnn::vk_constant_type> constants(8);
+        constants[0].i = w;
+        constants[1].i = h;
+        constants[2].i = w * bytes_per_comp;
+        constants[3].i = w_chroma * bytes_per_comp;
+        constants[4].i = w_chroma * bytes_per_comp;
+        constants[5].i = w;
+        constants[6].i = h;
+        constants[7].i = in0_gpu_rgb.cstep;
+
+        cmd.record_pipeline(rife_preproc, bindings, constants, in0_gpu_rgb);
+    }
+    {
+        in1_gpu_rgb.create(w, h, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+
+        std::vector<ncnn::VkMat> bindings(4);
+        bindings[0] = in1_gpu0;
+        bindings[1] = in1_gpu1;
+        bindings[2] = in1_gpu2;
+        bindings[3] = in1_gpu_rgb;
+
+        std::vector<ncnn::vk_constant_type> constants(8);
+        constants[0].i = w;
+        constants[1].i = h;
+        constants[2].i = w * bytes_per_comp;
+        constants[3].i = w_chroma * bytes_per_comp;
+        constants[4].i = w_chroma * bytes_per_comp;
+        constants[5].i = w;
+        constants[6].i = h;
+        constants[7].i = in1_gpu_rgb.cstep;
+
+        cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_rgb);
+    }
 
     ncnn::VkMat out_gpu;
     out_gpu.create(w, h, 3, sizeof(float), 1, blob_vkallocator);
+    {
+        std::vector<ncnn::VkMat> bindings(3);
+        bindings[0] = in0_gpu_rgb;
+        bindings[1] = in1_gpu_rgb;
+        bindings[2] = out_gpu;
+
+        std::vector<ncnn::vk_constant_type> constants(7);
+        constants[0].i = in0_gpu_rgb.w;
+        constants[1].i = in0_gpu_rgb.h;
+        constants[2].i = in0_gpu_rgb.cstep;
+        constants[3].i = out_gpu.w;
+        constants[4].i = out_gpu.h;
+        constants[5].i = out_gpu.cstep;
+        constants[6].f = weight;
+
+        cmd.record_pipeline(rife_blend, bindings, constants, out_gpu);
+    }
 
-    std::vector<ncnn::VkMat> post_bindings(2);
-    post_bindings[0] = in_gpu_padded;
-    post_bindings[1] = out_gpu;
-
-    std::vector<ncnn::vk_constant_type> post_constants(6);
-    post_constants[0].i = in_gpu_padded.w;
-    post_constants[1].i = in_gpu_padded.h;
-    post_constants[2].i = in_gpu_padded.cstep;
-    post_constants[3].i = out_gpu.w;
-    post_constants[4].i = out_gpu.h;
-    post_constants[5].i = out_gpu.cstep;
-
-    cmd.record_pipeline(rife_postproc, post_bindings, post_constants, out_gpu);
+    timer.submit(&RIFETimings::preproc);
 
     ncnn::Mat out;
     cmd.record_clone(out_gpu, out, opt);
-    cmd.submit_and_wait();
-
-    const float* outR = out.channel(0);
-    const float* outG = out.channel(1);
-    const float* outB = out.channel(2);
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            dstR[dst_stride * y + x] = outR[w * y + x] * (1 / 255.0f);
-            dstG[dst_stride * y + x] = outG[w * y + x] * (1 / 255.0f);
-            dstB[dst_stride * y + x] = outB[w * y + x] * (1 / 255.0f);
-        }
+    {
+        trace::Scope scope{ "gpu" };
+        cmd.submit_and_wait();
+    }
+
+    {
+        trace::Scope scope{ "readback" };
+        kernels::unscale_planes(out.channel(0), out.channel(1), out.channel(2), dstR, dstG, dstB, w, h, dst_stride);
     }
 
-    vkdev->reclaim_blob_allocator(blob_vkallocator);
-    vkdev->reclaim_staging_allocator(staging_vkallocator);
+    timer.mark(&RIFETimings::readback);
+
+    {
+        trace::Scope scope{ "reclaim allocators" };
+        vkdev->reclaim_blob_allocator(blob_vkallocator);
+        vkdev->reclaim_staging_allocator(staging_vkallocator);
+    }
 
     return 0;
 }
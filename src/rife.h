@@ -2,28 +2,88 @@
 
 // rife implemented with ncnn library
 
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 // ncnn
 #include "net.h"
 
+#include "autotune.h"
+#include "mapped_file.h"
+#include "stats.h"
+
+class ConvertThreads;
+
+// scene change/static detection done on the GPU from the preprocessed frames
+struct RIFEAnalysis
+{
+    bool sc; // sc or sc1
+    bool sc1;
+    bool skip;
+    float sc_threshold;
+    float skip_threshold;
+
+    // results
+    float sad;
+    float psnr;
+    int path; // 0=interpolated, 1=blended, 2=copied
+};
+
+// host wall time of the stages in microseconds, the stages are submitted separately when this is requested
+struct RIFETimings
+{
+    double upload; // staging copy and transfer to the device
+    double preproc; // rife_preproc, timestep and analysis passes, the blend pass of process_blend
+    double infer; // flownet, contextnet, fusionnet
+    double postproc; // rife_postproc and rife_select
+    double readback; // transfer to the host and copy to the destination
+    double convert; // process_copy
+
+    uint64_t peak_vram; // bytes of the blobs alive at the same time
+};
+
 class RIFE
 {
 public:
-    RIFE(int gpuid, bool tta_mode, bool uhd_mode, int num_threads, bool rife_v2, bool rife_v4, int padding, bool is_yuv,
-        int chroma_subsampling, int matrix_in, int bytes_per_comp, bool full_range, int bit_depth);
+    // tta_level is the number of TTA augmentations (1, 2, 4 or 8)
+    // tta_batch is the number of TTA augmentations whose inputs are alive at the same time (1-8), with vram_cap (bytes, 0=no cap)
+    // it's halved for the next frames while the peak of a frame is above the cap
+    RIFE(int gpuid, int tta_level, bool uhd_mode, int num_threads, bool rife_v2, bool rife_v4, int padding, bool is_yuv,
+        int chroma_subsampling, int matrix_in, int bytes_per_comp, bool full_range, int bit_depth, int tta_batch = 8, uint64_t vram_cap = 0);
     ~RIFE();
 
-    int load(const std::string& modeldir);
+    // fusion replaces the Interp -> BinaryOp -> Warp chains of the networks with FusedWarp
+    int load(const std::string& modeldir, const bool fusion = true);
+
+    // benchmarks the local sizes of the pre/postprocess shaders at this clip size and keeps the fastest ones,
+    // the winners are stored in profile_path and reused by the next call with the same device and settings
+    int autotune(const int w, const int h, const std::string& profile_path);
 
     int process(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB, const int w,
-        const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep) const;
+        const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep,
+        RIFEAnalysis* analysis = nullptr, RIFETimings* timings = nullptr) const;
 
     int process_v4(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB, const int w,
-        const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep) const;
+        const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float timestep,
+        RIFEAnalysis* analysis = nullptr, RIFETimings* timings = nullptr) const;
 
+    // format conversion only, done on the CPU
     int process_copy(const uint8_t* const src_p[3], float* dstR, float* dstG, float* dstB,
-        const int w, const int h, const ptrdiff_t stride[3], const ptrdiff_t dst_stride) const;
+        const int w, const int h, const ptrdiff_t stride[3], const ptrdiff_t dst_stride, ConvertThreads* threads = nullptr,
+        RIFETimings* timings = nullptr) const;
+
+    // weight is the weight of the second frame
+    int process_blend(const uint8_t* const src0_p[3], const uint8_t* const src1_p[3], float* dstR, float* dstG, float* dstB, const int w,
+        const int h, const ptrdiff_t stride0[3], const ptrdiff_t stride1[3], const ptrdiff_t dst_stride, const float weight,
+        RIFETimings* timings = nullptr) const;
+
+    // the padded tensors are fp16, process_copy rounds like them
+    bool fp16_storage() const noexcept
+    {
+        return flownet.opt.use_fp16_storage;
+    }
 
     bool is_yuv;
     int chroma_subsampling; // 0=4:4:4, 1=4:2:0, 2=4:2:2
@@ -32,23 +92,60 @@ public:
     bool full_range; // 0=limited, 1=full
     int bit_depth;
 
+    // updated by every process* call
+    mutable ProcessStats stats;
+
 private:
+    // kept after load so that autotune can recreate the pipeline with another local size
+    struct Shader
+    {
+        std::vector<uint32_t> spirv;
+        std::vector<ncnn::vk_specialization_type> specializations;
+    };
+
+    // the frame peak goes to the stats and timings, and lowers tta_batch when it's above vram_cap
+    void update_peak_vram(const uint64_t bytes, RIFETimings* timings) const;
+    void create_pipeline(ncnn::Pipeline*& pipeline, const Shader& shader, const LocalSize& local_size) const;
+    void record_analysis(ncnn::VkCompute& cmd, const ncnn::VkMat& in0_gpu_padded, const ncnn::VkMat& in1_gpu_padded, const int w, const int h,
+        const RIFEAnalysis& analysis, ncnn::VkMat& metrics_gpu, ncnn::VkAllocator* blob_vkallocator) const;
+    // submits the recorded work and reads the metrics of record_analysis, true when the frame is blended or copied
+    bool read_analysis(ncnn::VkCompute& cmd, const ncnn::VkMat& metrics_gpu, RIFEAnalysis& analysis, const ncnn::Option& opt) const;
+    void record_select(ncnn::VkCompute& cmd, const ncnn::VkMat& metrics_gpu, const ncnn::VkMat& in0_gpu_padded,
+        const ncnn::VkMat& in1_gpu_padded, const ncnn::VkMat& out_gpu, const float weight) const;
+
     ncnn::VulkanDevice* vkdev;
+    // declared before the networks, the layers can reference the weights until they are destroyed
+    MappedFile flownet_model;
+    MappedFile contextnet_model;
+    MappedFile fusionnet_model;
     ncnn::Net flownet;
     ncnn::Net contextnet;
     ncnn::Net fusionnet;
     ncnn::Pipeline* rife_preproc;
     ncnn::Pipeline* rife_postproc;
-    ncnn::Pipeline* rife_flow_tta_avg;
+    ncnn::Pipeline* rife_tta_image;
+    ncnn::Pipeline* rife_tta_flow;
     ncnn::Pipeline* rife_flow_tta_temporal_avg;
     ncnn::Pipeline* rife_out_tta_temporal_avg;
     ncnn::Pipeline* rife_v4_timestep;
+    ncnn::Pipeline* rife_analysis;
+    ncnn::Pipeline* rife_analysis_reduce;
+    ncnn::Pipeline* rife_select;
+    ncnn::Pipeline* rife_blend;
+    Shader preproc_shader;
+    Shader postproc_shader;
+    Shader blend_shader;
+    Shader select_shader;
+    Shader timestep_shader;
     ncnn::Layer* rife_uhd_downscale_image;
     ncnn::Layer* rife_uhd_upscale_flow;
     ncnn::Layer* rife_uhd_double_flow;
     ncnn::Layer* rife_v2_slice_flow;
     bool tta_mode;
+    int tta_level; // augmentations, 1=no TTA, 2=identity and horizontal flip, 4=flips, 8=flips and transposes
     bool tta_temporal_mode;
+    mutable std::atomic<int> tta_batch;
+    uint64_t vram_cap;
     bool uhd_mode;
     int num_threads;
     bool rife_v2;
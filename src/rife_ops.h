@@ -20,4 +20,26 @@ public:
 private:
 	ncnn::Pipeline* pipeline_warp;
 	ncnn::Pipeline* pipeline_warp_pack4;
+	ncnn::Pipeline* pipeline_warp_pack8;
+	// pack1, one invocation per pixel for all channels
+	ncnn::Pipeline* pipeline_warp_channels;
+};
+
+// Interp (bilinear) -> BinaryOp (flow scale) -> Warp in one pass, created by fuse_warp
+class FusedWarp : public ncnn::Layer
+{
+public:
+	FusedWarp();
+	virtual int load_param(const ncnn::ParamDict& pd);
+	virtual int create_pipeline(const ncnn::Option& opt);
+	virtual int destroy_pipeline(const ncnn::Option& opt);
+	virtual int forward(const std::vector<ncnn::VkMat>& bottom_blobs, std::vector<ncnn::VkMat>& top_blobs, ncnn::VkCompute& cmd,
+		const ncnn::Option& opt) const;
+
+private:
+	int align_corner;
+	float flow_scale;
+
+	ncnn::Pipeline* pipeline_fused_warp;
+	ncnn::Pipeline* pipeline_fused_warp_pack4;
 };
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: MIT
+
+#include "stats.h"
+
+#include <algorithm>
+#include <bit>
+#include <format>
+
+void LatencyHistogram::add(const double us) noexcept
+{
+    const uint64_t v{ static_cast<uint64_t>((std::max)(us, 0.0)) };
+    const int bucket{ (std::min)(static_cast<int>(std::bit_width(v | 1)) - 1, num_buckets - 1) };
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    samples.fetch_add(1, std::memory_order_relaxed);
+    total_us.fetch_add(v, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() noexcept
+{
+    for (auto& b : buckets)
+        b.store(0, std::memory_order_relaxed);
+
+    samples.store(0, std::memory_order_relaxed);
+    total_us.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean_ms() const noexcept
+{
+    const uint64_t n{ count() };
+    return n ? total_us.load(std::memory_order_relaxed) / 1000.0 / n : 0.0;
+}
+
+double LatencyHistogram::percentile_ms(const double p) const noexcept
+{
+    std::array<uint64_t, num_buckets> snapshot;
+    uint64_t n{ 0 };
+
+    for (int i{ 0 }; i < num_buckets; ++i)
+    {
+        snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+        n += snapshot[i];
+    }
+
+    if (!n)
+        return 0.0;
+
+    const uint64_t rank{ static_cast<uint64_t>(p / 100.0 * (n - 1)) + 1 };
+    uint64_t seen{ 0 };
+
+    for (int i{ 0 }; i < num_buckets; ++i)
+    {
+        seen += snapshot[i];
+        if (seen >= rank)
+            return static_cast<double>(uint64_t{ 1 } << (i + 1)) / 1000.0;
+    }
+
+    return static_cast<double>(uint64_t{ 1 } << num_buckets) / 1000.0;
+}
+
+static std::string line(const char* name, const LatencyHistogram& h)
+{
+    return std::format("{}: {} (mean {:.2f} ms, p50 < {:.2f} ms, p95 < {:.2f} ms, p99 < {:.2f} ms)\n", name, h.count(), h.mean_ms(),
+        h.percentile_ms(50.0), h.percentile_ms(95.0), h.percentile_ms(99.0));
+}
+
+void FrameStats::reset() noexcept
+{
+    for (auto& h : paths)
+        h.reset();
+}
+
+std::string FrameStats::to_string() const
+{
+    uint64_t frames{ 0 };
+    for (const auto& h : paths)
+        frames += h.count();
+
+    std::string s{ std::format("frames: {}\n", frames) };
+    for (size_t i{ 0 }; i < paths.size(); ++i)
+        s += line(frame_path_names[i], paths[i]);
+
+    return s;
+}
+
+void ProcessStats::reset() noexcept
+{
+    interpolate.reset();
+    blend.reset();
+    convert.reset();
+    peak_vram.store(0, std::memory_order_relaxed);
+}
+
+std::string ProcessStats::to_string() const
+{
+    return line("process", interpolate) + line("process_blend", blend) + line("process_copy", convert) +
+        std::format("peak vram: {:.1f} MiB\n", peak_vram.load(std::memory_order_relaxed) / 1048576.0);
+}
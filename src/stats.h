@@ -0,0 +1,97 @@
+#pragma once
+
+// run statistics, updated lock-free from the frame threads
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// bucket i counts the samples of [2^i, 2^(i+1)) microseconds
+class LatencyHistogram
+{
+public:
+    static constexpr int num_buckets{ 32 };
+
+    void add(const double us) noexcept;
+    void reset() noexcept;
+
+    uint64_t count() const noexcept
+    {
+        return samples.load(std::memory_order_relaxed);
+    }
+
+    double mean_ms() const noexcept;
+    // upper bound of the bucket that contains the percentile
+    double percentile_ms(const double p) const noexcept;
+
+private:
+    std::array<std::atomic<uint64_t>, num_buckets> buckets{};
+    std::atomic<uint64_t> samples{};
+    std::atomic<uint64_t> total_us{};
+};
+
+// adds the duration of the call to a histogram
+class CallTimer
+{
+public:
+    explicit CallTimer(LatencyHistogram& histogram) noexcept : histogram(histogram), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~CallTimer()
+    {
+        histogram.add(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    LatencyHistogram& histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+enum class FramePath
+{
+    interpolated,
+    blended,
+    copied, // original frame or scene change
+    skipped, // static frame
+    low_motion, // motion_threshold, blended or nearest frame
+    cached // cache_dir
+};
+
+inline constexpr std::array<const char*, 6> frame_path_names{ "interpolated", "blended", "copied", "skipped", "low_motion", "cached" };
+
+// get_frame time of every path
+struct FrameStats
+{
+    std::array<LatencyHistogram, 6> paths;
+
+    void add(const FramePath path, const double us) noexcept
+    {
+        paths[static_cast<int>(path)].add(us);
+    }
+
+    void reset() noexcept;
+    std::string to_string() const;
+};
+
+// calls of the shared RIFE instance
+struct ProcessStats
+{
+    LatencyHistogram interpolate;
+    LatencyHistogram blend;
+    LatencyHistogram convert;
+    std::atomic<uint64_t> peak_vram{}; // bytes, the highest of all calls
+
+    void update_peak_vram(const uint64_t bytes) noexcept
+    {
+        uint64_t peak{ peak_vram.load(std::memory_order_relaxed) };
+        while (bytes > peak && !peak_vram.compare_exchange_weak(peak, bytes, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void reset() noexcept;
+    std::string to_string() const;
+};
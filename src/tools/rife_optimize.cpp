@@ -0,0 +1,566 @@
+// SPDX-License-Identifier: MIT
+
+// rife_optimize, writes a pre-optimized copy of a model dir that RIFE::load prefers over the original files
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../kernels.h"
+#include "../model_pack.h"
+#include "../param_graph.h"
+
+namespace
+{
+    // the blobs that RIFE::process* feeds and extracts, they are never removed or renamed
+    const std::set<std::string> io_blobs{ "in0", "in1", "in2", "input0", "input1", "input.1", "img0", "img1", "flow", "flow.0", "flow.1",
+        "3", "4", "5", "6", "7", "8", "9", "10", "f1", "f2", "f3", "f4", "out0", "output" };
+
+    constexpr uint32_t fp16_tag{ 0x01306B47 };
+    constexpr uint32_t int8_tag{ 0x000D4B38 };
+    constexpr uint32_t raw_scaled_tag{ 0x0002C056 };
+
+    struct Weight
+    {
+        bool flagged; // type 0 of ModelBin::load, otherwise raw float32
+        std::vector<float> data;
+    };
+
+    // the arrays that Layer::load_model reads, in order
+    std::vector<std::pair<bool, size_t>> weight_layout(const ParamLayer& layer)
+    {
+        static const std::set<std::string> weightless{ "Input", "Split", "Concat", "Crop", "Slice", "Interp", "BinaryOp", "UnaryOp", "ReLU",
+            "Sigmoid", "Eltwise", "Pooling", "Padding", "Reshape", "Permute", "PixelShuffle", "Noop", "Dropout", "Clip", "Flatten",
+            "Softmax", "Swish", "TanH", "HardSigmoid", "HardSwish", "Mish", "GELU", "ELU", "Exp", "Log", "Power", "Tile", "Reduction",
+            "ExpandDims", "Squeeze", "Cast", "rife.Warp", "rife.FusedWarp" };
+
+        const auto& type{ layer.type };
+
+        if (weightless.contains(type))
+            return {};
+
+        if (type == "Convolution" || type == "ConvolutionDepthWise" || type == "Deconvolution" || type == "DeconvolutionDepthWise")
+        {
+            if (layer.param_int(8, 0))
+                throw std::runtime_error(std::format("{}: int8 layers are not supported", layer.name));
+            if ((type.starts_with("Convolution") && layer.param_int(19, 0)) || (type.starts_with("Deconvolution") && layer.param_int(28, 0)))
+                return {};
+
+            std::vector<std::pair<bool, size_t>> layout{ { true, layer.param_int(6, 0) } };
+            if (layer.param_int(5, 0))
+                layout.emplace_back(false, layer.param_int(0, 0));
+
+            return layout;
+        }
+
+        if (type == "InnerProduct")
+        {
+            if (layer.param_int(8, 0))
+                throw std::runtime_error(std::format("{}: int8 layers are not supported", layer.name));
+
+            std::vector<std::pair<bool, size_t>> layout{ { true, layer.param_int(2, 0) } };
+            if (layer.param_int(1, 0))
+                layout.emplace_back(false, layer.param_int(0, 0));
+
+            return layout;
+        }
+
+        if (type == "PReLU")
+            return { { false, layer.param_int(0, 0) } };
+
+        if (type == "MemoryData")
+        {
+            size_t size{ 1 };
+            for (const int key : { 0, 1, 11, 2 })
+                size *= (std::max)(layer.param_int(key, 0), 1);
+
+            return { { false, size } };
+        }
+
+        if (type == "BatchNorm")
+        {
+            const size_t channels{ static_cast<size_t>(layer.param_int(0, 0)) };
+            return { { false, channels }, { false, channels }, { false, channels }, { false, channels } };
+        }
+
+        if (type == "Scale")
+        {
+            const int size{ layer.param_int(0, 0) };
+            if (size == -233)
+                return {};
+
+            std::vector<std::pair<bool, size_t>> layout{ { false, size } };
+            if (layer.param_int(1, 0))
+                layout.emplace_back(false, size);
+
+            return layout;
+        }
+
+        throw std::runtime_error(std::format("{}: unsupported layer type {}", layer.name, type));
+    }
+
+    class BinReader
+    {
+    public:
+        explicit BinReader(std::vector<uint8_t> data) : data(std::move(data)), pos(0)
+        {
+        }
+
+        Weight read(const bool flagged, const size_t count)
+        {
+            Weight w{ flagged, std::vector<float>(count) };
+
+            if (!flagged)
+            {
+                copy(w.data.data(), count * sizeof(float));
+                return w;
+            }
+
+            uint32_t tag;
+            copy(&tag, sizeof(tag));
+
+            if (tag == fp16_tag)
+            {
+                std::vector<uint16_t> half(count);
+                copy(half.data(), count * sizeof(uint16_t));
+                skip(align4(count * sizeof(uint16_t)) - count * sizeof(uint16_t));
+                std::transform(half.begin(), half.end(), w.data.begin(), kernels::half_to_float);
+            }
+            else if (tag == int8_tag)
+                throw std::runtime_error("int8 weights are not supported");
+            else if (tag == raw_scaled_tag || tag == 0)
+                copy(w.data.data(), count * sizeof(float));
+            else
+            {
+                // quantized, 256 entry table
+                float table[256];
+                copy(table, sizeof(table));
+                std::vector<uint8_t> index(count);
+                copy(index.data(), count);
+                skip(align4(count) - count);
+                std::transform(index.begin(), index.end(), w.data.begin(), [&](const uint8_t i) { return table[i]; });
+            }
+
+            return w;
+        }
+
+        bool at_end() const noexcept
+        {
+            return pos == data.size();
+        }
+
+    private:
+        static size_t align4(const size_t n) noexcept
+        {
+            return (n + 3) & ~size_t{ 3 };
+        }
+
+        void copy(void* dst, const size_t n)
+        {
+            if (pos + n > data.size())
+                throw std::runtime_error("model file is shorter than the param file describes");
+
+            std::memcpy(dst, data.data() + pos, n);
+            pos += n;
+        }
+
+        void skip(const size_t n)
+        {
+            if (pos + n > data.size())
+                throw std::runtime_error("model file is shorter than the param file describes");
+
+            pos += n;
+        }
+
+        std::vector<uint8_t> data;
+        size_t pos;
+    };
+
+    struct Net
+    {
+        std::vector<ParamLayer> layers;
+        std::vector<std::vector<Weight>> weights; // per layer
+    };
+
+    std::vector<uint8_t> read_file(const std::filesystem::path& path)
+    {
+        std::ifstream ifs{ path, std::ios::binary };
+        if (!ifs)
+            throw std::runtime_error("cannot read " + path.string());
+
+        return { std::istreambuf_iterator<char>{ ifs }, std::istreambuf_iterator<char>{} };
+    }
+
+    Net load_net(const std::filesystem::path& param_path, const std::filesystem::path& bin_path)
+    {
+        const std::vector<uint8_t> param_data{ read_file(param_path) };
+
+        Net net;
+        if (!parse_param(std::string{ param_data.begin(), param_data.end() }, net.layers))
+            throw std::runtime_error("invalid param file " + param_path.string());
+
+        BinReader bin{ read_file(bin_path) };
+        for (const auto& layer : net.layers)
+        {
+            auto& weights{ net.weights.emplace_back() };
+            for (const auto& [flagged, count] : weight_layout(layer))
+                weights.emplace_back(bin.read(flagged, count));
+        }
+
+        if (!bin.at_end())
+            throw std::runtime_error("model file is longer than the param file describes " + bin_path.string());
+
+        return net;
+    }
+
+    // all uses of a blob are renamed, the producer is kept
+    void rename_uses(Net& net, const std::string& from, const std::string& to)
+    {
+        for (auto& layer : net.layers)
+        {
+            if (layer.removed)
+                continue;
+
+            std::replace(layer.inputs.begin(), layer.inputs.end(), from, to);
+        }
+    }
+
+    bool is_scalar_op(const ParamLayer& layer)
+    {
+        return layer.type == "BinaryOp" && layer.inputs.size() == 1 && layer.outputs.size() == 1 && layer.param_int(1, 0) == 1;
+    }
+
+    // conv/deconv/innerproduct without activation followed by a scalar add/sub/mul/div, the op is folded into the weights and bias
+    int fold_scalar_ops(Net& net)
+    {
+        int folded{ 0 };
+        const auto consumers{ param_consumers(net.layers) };
+
+        for (size_t i{ 0 }; i < net.layers.size(); ++i)
+        {
+            ParamLayer& layer{ net.layers[i] };
+            const bool is_conv{ layer.type.starts_with("Convolution") || layer.type.starts_with("Deconvolution") };
+            const bool is_fc{ layer.type == "InnerProduct" };
+
+            if (layer.removed || !(is_conv || is_fc) || layer.outputs.size() != 1 || layer.param_int(9, 0) != 0 ||
+                net.weights[i].empty() || io_blobs.contains(layer.outputs[0]))
+                continue;
+
+            const auto it{ consumers.find(layer.outputs[0]) };
+            if (it == consumers.end() || it->second.size() != 1)
+                continue;
+
+            ParamLayer& op{ net.layers[it->second.front().first] };
+            const int op_type{ op.param_int(0, 0) };
+            const float b{ op.param_float(2, 0.0f) };
+
+            if (op.removed || !is_scalar_op(op) || op_type > 3 || (op_type == 3 && b == 0.0f))
+                continue;
+
+            const int bias_key{ is_conv ? 5 : 1 };
+            const size_t num_output{ static_cast<size_t>(layer.param_int(0, 0)) };
+            auto& weights{ net.weights[i] };
+
+            if (op_type >= 2)
+            {
+                const float scale{ (op_type == 2) ? b : 1.0f / b };
+                for (auto& w : weights)
+                {
+                    for (auto& v : w.data)
+                        v *= scale;
+                }
+            }
+            else
+            {
+                if (!layer.param_int(bias_key, 0))
+                {
+                    layer.set_param(bias_key, "1");
+                    weights.push_back({ false, std::vector<float>(num_output, 0.0f) });
+                }
+
+                for (auto& v : weights[1].data)
+                    v += (op_type == 0) ? b : -b;
+            }
+
+            layer.outputs[0] = op.outputs[0];
+            op.removed = true;
+            ++folded;
+        }
+
+        return folded;
+    }
+
+    // scalar ops that do nothing, Noop, Dropout with scale 1
+    int remove_identities(Net& net)
+    {
+        int removed{ 0 };
+        const auto consumers{ param_consumers(net.layers) };
+
+        for (auto& layer : net.layers)
+        {
+            if (layer.removed || layer.inputs.size() != 1 || layer.outputs.size() != 1 || io_blobs.contains(layer.outputs[0]))
+                continue;
+
+            bool identity{ layer.type == "Noop" || (layer.type == "Dropout" && layer.param_float(0, 1.0f) == 1.0f) };
+            if (is_scalar_op(layer))
+            {
+                const int op_type{ layer.param_int(0, 0) };
+                const float b{ layer.param_float(2, 0.0f) };
+                identity = ((op_type == 0 || op_type == 1) && b == 0.0f) || ((op_type == 2 || op_type == 3) && b == 1.0f);
+            }
+
+            // a single consumer keeps the input single consumer as well
+            const auto it{ consumers.find(layer.outputs[0]) };
+            if (!identity || (it != consumers.end() && it->second.size() > 1))
+                continue;
+
+            layer.removed = true;
+            rename_uses(net, layer.outputs[0], layer.inputs[0]);
+            ++removed;
+        }
+
+        return removed;
+    }
+
+    // layers whose outputs are not used, Split outputs that are not used
+    int remove_dead(Net& net)
+    {
+        int removed{ 0 };
+        const auto consumers{ param_consumers(net.layers) };
+        const auto used{ [&](const std::string& blob) { return io_blobs.contains(blob) || consumers.contains(blob); } };
+
+        for (auto& layer : net.layers)
+        {
+            if (layer.removed || layer.type == "Input")
+                continue;
+
+            if (layer.type == "Split")
+            {
+                const size_t before{ layer.outputs.size() };
+                std::erase_if(layer.outputs, [&](const std::string& blob) { return !used(blob); });
+                removed += static_cast<int>(before - layer.outputs.size());
+
+                if (layer.outputs.size() == 1 && !io_blobs.contains(layer.outputs[0]))
+                {
+                    layer.removed = true;
+                    rename_uses(net, layer.outputs[0], layer.inputs[0]);
+                    ++removed;
+                }
+            }
+
+            if (std::none_of(layer.outputs.begin(), layer.outputs.end(), used) && !layer.removed)
+            {
+                layer.removed = true;
+                ++removed;
+            }
+        }
+
+        return removed;
+    }
+
+    void write_net(const Net& net, const std::filesystem::path& param_path, const std::filesystem::path& bin_path, const bool fp16,
+        const std::string& name, std::vector<ModelPackManifest::Lifetime>& lifetimes)
+    {
+        {
+            std::ofstream ofs{ param_path, std::ios::binary | std::ios::trunc };
+            ofs << write_param(net.layers);
+            if (!ofs)
+                throw std::runtime_error("cannot write " + param_path.string());
+        }
+
+        std::ofstream ofs{ bin_path, std::ios::binary | std::ios::trunc };
+        std::map<std::string, std::pair<int, int>> blob_lifetimes;
+        int index{ 0 };
+
+        for (size_t i{ 0 }; i < net.layers.size(); ++i)
+        {
+            const ParamLayer& layer{ net.layers[i] };
+            if (layer.removed)
+                continue;
+
+            for (const auto& input : layer.inputs)
+                blob_lifetimes[input].second = index;
+            for (const auto& output : layer.outputs)
+                blob_lifetimes[output] = { index, index };
+            ++index;
+
+            for (const Weight& w : net.weights[i])
+            {
+                if (w.flagged && fp16)
+                {
+                    std::vector<uint16_t> half(w.data.size());
+                    std::transform(w.data.begin(), w.data.end(), half.begin(), kernels::float_to_half);
+                    half.resize((half.size() + 1) & ~size_t{ 1 });
+
+                    ofs.write(reinterpret_cast<const char*>(&fp16_tag), sizeof(fp16_tag));
+                    ofs.write(reinterpret_cast<const char*>(half.data()), half.size() * sizeof(uint16_t));
+                    continue;
+                }
+
+                if (w.flagged)
+                {
+                    constexpr uint32_t raw_tag{ 0 };
+                    ofs.write(reinterpret_cast<const char*>(&raw_tag), sizeof(raw_tag));
+                }
+
+                ofs.write(reinterpret_cast<const char*>(w.data.data()), w.data.size() * sizeof(float));
+            }
+        }
+
+        if (!ofs)
+            throw std::runtime_error("cannot write " + bin_path.string());
+
+        for (const auto& [blob, lifetime] : blob_lifetimes)
+            lifetimes.push_back({ name, blob, lifetime.first, lifetime.second });
+    }
+
+    // same as the models table of the plugin
+    int model_padding(const std::string& name)
+    {
+        if (name.find("rife-v4.25-lite") != std::string::npos)
+            return 128;
+        if (name.find("rife-v4.25") != std::string::npos || name.find("rife-v4.26") != std::string::npos)
+            return 64;
+
+        return 32;
+    }
+
+    // same as the dir name checks of the plugin
+    std::string model_generation(const std::string& name)
+    {
+        if (name.find("rife-v4") != std::string::npos || name.find("rife4") != std::string::npos)
+            return "v4";
+        if (name.find("rife-v2") != std::string::npos || name.find("rife-v3") != std::string::npos)
+            return "v2";
+
+        return "v1";
+    }
+
+    void usage()
+    {
+        std::cerr <<
+            "usage: rife_optimize [options] <model dir>\n"
+            "  --output <dir>        output dir (default <model dir>/optimized)\n"
+            "  --padding <n>         padding of the model (default from the dir name)\n"
+            "  --generation <g>      v1|v2|v4, v2 includes rife-v3 (default from the dir name)\n"
+            "  --fp32                keep the weights in fp32\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        std::optional<std::filesystem::path> modeldir;
+        std::optional<std::filesystem::path> output;
+        std::optional<int> padding;
+        std::optional<std::string> generation;
+        bool fp16{ true };
+
+        for (int i{ 1 }; i < argc; ++i)
+        {
+            const std::string arg{ argv[i] };
+            const auto next{ [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("missing value of " + arg);
+                return argv[++i];
+                } };
+
+            if (arg == "--output")
+                output = next();
+            else if (arg == "--padding")
+                padding = std::stoi(next());
+            else if (arg == "--generation")
+                generation = next();
+            else if (arg == "--fp32")
+                fp16 = false;
+            else if (!arg.starts_with("--") && !modeldir)
+                modeldir = arg;
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+
+        if (!modeldir)
+        {
+            usage();
+            return 1;
+        }
+
+        const std::string dir_name{ std::filesystem::absolute(*modeldir).lexically_normal().filename().string() };
+
+        ModelPackManifest manifest;
+        manifest.generation = generation.value_or(model_generation(dir_name));
+        manifest.padding = padding.value_or(model_padding(dir_name));
+        manifest.fp16_weights = fp16;
+
+        if (manifest.generation != "v1" && manifest.generation != "v2" && manifest.generation != "v4")
+            throw std::runtime_error("generation must be v1, v2 or v4");
+        if (manifest.padding < 1)
+            throw std::runtime_error("padding must be at least 1");
+
+        const std::filesystem::path out_dir{ output.value_or(*modeldir / model_pack_dir) };
+        std::filesystem::create_directories(out_dir);
+
+        const std::vector<std::string> nets{ (manifest.generation == "v4") ? std::vector<std::string>{ "flownet" } :
+            std::vector<std::string>{ "flownet", "contextnet", "fusionnet" } };
+
+        for (const auto& name : nets)
+        {
+            const std::filesystem::path param_path{ *modeldir / (name + ".param") };
+            const std::filesystem::path bin_path{ *modeldir / (name + ".bin") };
+
+            for (const auto& path : { param_path, bin_path })
+            {
+                const auto source{ model_pack_source(path) };
+                if (!source)
+                    throw std::runtime_error("cannot read " + path.string());
+                manifest.sources.push_back(*source);
+            }
+
+            Net net{ load_net(param_path, bin_path) };
+            const size_t layers_before{ net.layers.size() };
+
+            int folded{ 0 };
+            int removed{ 0 };
+            for (bool changed{ true }; changed;)
+            {
+                const int f{ fold_scalar_ops(net) };
+                const int r{ remove_identities(net) + remove_dead(net) };
+                folded += f;
+                removed += r;
+                changed = f || r;
+            }
+
+            write_net(net, out_dir / (name + ".param"), out_dir / (name + ".bin"), fp16, name, manifest.lifetimes);
+
+            const size_t layers_after{ static_cast<size_t>(std::count_if(net.layers.begin(), net.layers.end(),
+                [](const ParamLayer& layer) { return !layer.removed; })) };
+            std::cerr << std::format("{}: {} -> {} layers, {} folded, {} removed\n", name, layers_before, layers_after, folded, removed);
+        }
+
+        // last, a partially written pack is not used
+        if (!manifest.write(out_dir / model_pack_manifest))
+            throw std::runtime_error("cannot write the manifest");
+
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "rife_optimize: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: MIT
+
+// rife_server, runs the models of the RIFE instances of several processes on one GPU context (server parameter of RIFE)
+// the clients of the same model share one RIFE instance, the GPU work of all clients goes through the GpuScheduler of the device
+
+#include <atomic>
+#include <csignal>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ncnn
+#include "gpu.h"
+
+#include "../gpu_scheduler.h"
+#include "../remote.h"
+#include "../rife.h"
+
+namespace
+{
+    std::atomic<bool> g_stop{};
+
+    struct Options
+    {
+        std::string socket_path;
+        int gpu_thread;
+        int gpu_batch;
+        int max_clients;
+    };
+
+    class Server
+    {
+    public:
+        explicit Server(const Options& options) : options(options)
+        {
+        }
+
+        // serves the connection on a new thread
+        void accept(const int fd);
+        // unblocks the connections and waits for them
+        void stop();
+        std::string stats() const;
+
+    private:
+        // null if the model cannot be loaded
+        std::shared_ptr<RIFE> model(const remote::Model& m);
+        // the connection of a client, returns when the client disconnects or the server stops
+        void serve(const int fd);
+
+        const Options& options;
+        mutable std::mutex mutex;
+        std::map<remote::Model, std::shared_ptr<RIFE>> models; // loaded until the server stops
+        std::set<int> clients; // admitted
+        std::set<int> connections; // of the serve calls, admitted or not
+        std::condition_variable cv;
+    };
+
+    std::shared_ptr<RIFE> Server::model(const remote::Model& m)
+    {
+        std::lock_guard lock(mutex);
+
+        auto& rife{ models[m] };
+        if (!rife)
+        {
+            std::cerr << std::format("loading {} (gpu {})\n", m.path, m.gpu_id);
+
+            rife = std::make_shared<RIFE>(m.gpu_id, m.tta_level, m.uhd, 1, m.rife_v2, m.rife_v4, m.padding, m.is_yuv,
+                m.chroma_subsampling, m.matrix_in, m.bytes_per_comp, m.full_range, m.bit_depth, m.tta_batch, m.vram_cap);
+            if (rife->load(m.path, m.fusion))
+            {
+                models.erase(m);
+                return nullptr;
+            }
+        }
+
+        return rife;
+    }
+
+    void Server::accept(const int fd)
+    {
+        {
+            std::lock_guard lock(mutex);
+            connections.emplace(fd);
+        }
+
+        std::thread(&Server::serve, this, fd).detach();
+    }
+
+    void Server::serve(const int fd)
+    {
+        remote::OpenRequest request{};
+        const int shm_fd{ remote::recv_with_fd(fd, &request, sizeof(request)) };
+
+        remote::OpenReply reply{ remote::ok };
+        request.model.path[sizeof(request.model.path) - 1] = '\0';
+
+        const bool valid{ request.width > 0 && request.height > 0 && request.model.chroma_subsampling >= 0 &&
+            request.model.chroma_subsampling <= 2 && (request.model.bytes_per_comp == 1 || request.model.bytes_per_comp == 2 ||
+                request.model.bytes_per_comp == 4) };
+        const remote::Layout layout{ valid ? remote::layout(request.width, request.height, request.model.bytes_per_comp,
+            request.model.chroma_subsampling) : remote::Layout{} };
+        struct stat st{};
+        unsigned char* buffer{};
+
+        if (shm_fd < 0 || request.magic != remote::magic || request.version != remote::version)
+            reply.status = remote::bad_version;
+        else if (!valid || ::fstat(shm_fd, &st) || static_cast<size_t>(st.st_size) < layout.size ||
+            (buffer = static_cast<unsigned char*>(::mmap(nullptr, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0))) ==
+            MAP_FAILED)
+            reply.status = remote::bad_buffer;
+
+        if (shm_fd >= 0)
+            ::close(shm_fd);
+        if (buffer == MAP_FAILED)
+            buffer = nullptr;
+
+        bool admitted{};
+        if (reply.status == remote::ok)
+        {
+            std::lock_guard lock(mutex);
+            admitted = static_cast<int>(clients.size()) < options.max_clients;
+            if (admitted)
+                clients.emplace(fd);
+            else
+                reply.status = remote::busy;
+        }
+
+        std::shared_ptr<RIFE> rife;
+        std::shared_ptr<GpuScheduler> scheduler;
+        if (reply.status == remote::ok)
+        {
+            if (request.model.gpu_id < 0 || request.model.gpu_id >= ncnn::get_gpu_count() || !(rife = model(request.model)))
+                reply.status = remote::bad_model;
+            else
+            {
+                scheduler = GpuScheduler::get(request.model.gpu_id, options.gpu_thread, options.gpu_batch);
+                reply.fp16_storage = rife->fp16_storage();
+            }
+        }
+
+        // the processes get the GPU in turn
+        const void* client{ reinterpret_cast<const void*>(static_cast<uintptr_t>(request.client)) };
+
+        for (bool open{ remote::send_all(fd, &reply, sizeof(reply)) && reply.status == remote::ok }; open && !g_stop;)
+        {
+            remote::Request call{};
+            if (!remote::recv_all(fd, &call, sizeof(call)))
+                break;
+
+            remote::Reply result{ remote::failed };
+
+            if (call.width > 0 && call.height > 0 && call.width <= request.width && call.height <= request.height)
+            {
+                ptrdiff_t stride[3];
+                remote::src_strides(call.width, request.model.bytes_per_comp, request.model.chroma_subsampling, stride);
+
+                const uint8_t* const src0_p[3]{ buffer + layout.src0[0], buffer + layout.src0[1], buffer + layout.src0[2] };
+                const uint8_t* const src1_p[3]{ buffer + layout.src1[0], buffer + layout.src1[1], buffer + layout.src1[2] };
+                float* const dst[3]{ reinterpret_cast<float*>(buffer + layout.dst[0]), reinterpret_cast<float*>(buffer + layout.dst[1]),
+                    reinterpret_cast<float*>(buffer + layout.dst[2]) };
+
+                RIFEAnalysis* const analysis{ call.has_analysis ? &call.analysis : nullptr };
+                RIFETimings* const timings{ call.has_timings ? &result.timings : nullptr };
+                int ret{ -1 };
+
+                try
+                {
+                    scheduler->run(client, rife.get(), [&] {
+                        ret = (call.op == remote::op_process) ?
+                            rife->process(src0_p, src1_p, dst[0], dst[1], dst[2], call.width, call.height, stride, stride, call.width,
+                                call.timestep, analysis, timings) :
+                            rife->process_blend(src0_p, src1_p, dst[0], dst[1], dst[2], call.width, call.height, stride, stride,
+                                call.width, call.timestep, timings);
+                        });
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << std::format("process failed: {}\n", e.what());
+                }
+
+                if (!ret)
+                {
+                    result.status = remote::ok;
+                    result.analysis = call.analysis;
+                }
+            }
+
+            open = remote::send_all(fd, &result, sizeof(result));
+        }
+
+        if (buffer)
+            ::munmap(buffer, layout.size);
+
+        rife.reset();
+        scheduler.reset();
+
+        std::unique_lock lock(mutex);
+        if (admitted)
+            clients.erase(fd);
+        connections.erase(fd);
+        ::close(fd);
+
+        // stop() returns (and the server is destroyed) only after this thread is done with it
+        std::notify_all_at_thread_exit(cv, std::move(lock));
+    }
+
+    void Server::stop()
+    {
+        std::unique_lock lock(mutex);
+        // also the connections that have not sent the open request yet
+        for (const int fd : connections)
+            ::shutdown(fd, SHUT_RDWR);
+
+        cv.wait(lock, [&] { return connections.empty(); });
+    }
+
+    std::string Server::stats() const
+    {
+        std::string s{ GpuScheduler::all_to_string(false) };
+
+        std::lock_guard lock(mutex);
+        for (const auto& [m, rife] : models)
+            s += std::format("{} (gpu {}):\n", m.path, m.gpu_id) + rife->stats.to_string();
+
+        return s;
+    }
+
+    void usage()
+    {
+        std::cerr <<
+            "usage: rife_server [options]\n"
+            "  --socket <path>       socket of the server (default $XDG_RUNTIME_DIR/rife.sock, /tmp/rife-<uid>.sock without it)\n"
+            "  --gpu-thread <n>      GPU slots of every device (default 2)\n"
+            "  --gpu-batch <n>       calls of the same model run on a slot before it's given to the next call (default 1)\n"
+            "  --max-clients <n>     connections, the next clients run the model in their process (default 64)\n"
+            "  --list-gpu            lists the GPUs and exits\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Options options{ remote::default_socket(), 2, 1, 64 };
+        bool list_gpu{};
+
+        for (int i{ 1 }; i < argc; ++i)
+        {
+            const std::string arg{ argv[i] };
+            const auto next{ [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("missing value of " + arg);
+                return argv[++i];
+                } };
+
+            if (arg == "--socket")
+                options.socket_path = next();
+            else if (arg == "--gpu-thread")
+                options.gpu_thread = std::stoi(next());
+            else if (arg == "--gpu-batch")
+                options.gpu_batch = std::stoi(next());
+            else if (arg == "--max-clients")
+                options.max_clients = std::stoi(next());
+            else if (arg == "--list-gpu")
+                list_gpu = true;
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+
+        if (options.gpu_thread < 1)
+            throw std::runtime_error("gpu-thread must be at least 1");
+        if (options.gpu_batch < 1 || options.gpu_batch > 64)
+            throw std::runtime_error("gpu-batch must be between 1 and 64 (inclusive)");
+        if (options.max_clients < 1)
+            throw std::runtime_error("max-clients must be at least 1");
+
+        if (ncnn::create_gpu_instance())
+            throw std::runtime_error("failed to create GPU instance");
+
+        // destroyed after the server (and its models) and on the errors below
+        struct GpuInstance
+        {
+            ~GpuInstance()
+            {
+                ncnn::destroy_gpu_instance();
+            }
+        } gpu_instance;
+
+        if (list_gpu)
+        {
+            for (int i{ 0 }; i < ncnn::get_gpu_count(); ++i)
+                std::cout << std::format("{}: {}\n", i, ncnn::get_gpu_info(i).device_name());
+
+            return 0;
+        }
+
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (options.socket_path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("socket path is too long");
+
+        std::memcpy(addr.sun_path, options.socket_path.c_str(), options.socket_path.size());
+
+        const int listen_fd{ ::socket(AF_UNIX, SOCK_STREAM, 0) };
+        if (listen_fd < 0)
+            throw std::runtime_error("cannot create the socket");
+
+        // a socket file without a server is left by a server that crashed
+        if (const int probe{ ::socket(AF_UNIX, SOCK_STREAM, 0) }; probe >= 0)
+        {
+            const bool running{ ::connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0 };
+            ::close(probe);
+            if (running)
+                throw std::runtime_error(options.socket_path + " is used by another server");
+
+            ::unlink(options.socket_path.c_str());
+        }
+
+        if (::bind(listen_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) || ::chmod(options.socket_path.c_str(), 0600) ||
+            ::listen(listen_fd, 64))
+            throw std::runtime_error("cannot listen on " + options.socket_path);
+
+        std::signal(SIGINT, [](int) { g_stop = true; });
+        std::signal(SIGTERM, [](int) { g_stop = true; });
+        std::signal(SIGPIPE, SIG_IGN);
+
+        std::cerr << std::format("listening on {}\n", options.socket_path);
+
+        Server server{ options };
+
+        while (!g_stop)
+        {
+            pollfd p{ listen_fd, POLLIN };
+            if (::poll(&p, 1, 500) <= 0)
+                continue;
+
+            if (const int fd{ ::accept(listen_fd, nullptr, nullptr) }; fd >= 0)
+            {
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+                const int on{ 1 };
+                ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+                server.accept(fd);
+            }
+        }
+
+        ::close(listen_fd);
+        ::unlink(options.socket_path.c_str());
+
+        server.stop();
+
+        std::cerr << server.stats();
+
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "rife_server: " << e.what() << "\n";
+        return 1;
+    }
+}
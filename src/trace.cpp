@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: MIT
+
+#include "trace.h"
+
+#include <array>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace
+{
+    std::atomic<bool> g_enabled{};
+
+    namespace
+    {
+        struct Event
+        {
+            const char* name;
+            int64_t start;
+            int64_t duration;
+            int frame;
+        };
+
+        // ring buffer of one thread, the oldest events are overwritten
+        // the lock is only contended by flush, which takes the events while the thread can still record
+        struct ThreadBuffer
+        {
+            static constexpr size_t capacity{ 1 << 16 };
+
+            std::mutex mutex;
+            std::array<Event, capacity> events;
+            uint64_t head{};
+            int tid;
+        };
+
+        std::mutex g_mutex;
+        std::string g_path;
+        std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+        const auto g_epoch{ std::chrono::steady_clock::now() };
+
+        // the buffers are kept until flush so the events of the finished threads are not lost
+        ThreadBuffer* thread_buffer()
+        {
+            thread_local ThreadBuffer* buffer{};
+
+            if (!buffer)
+            {
+                std::lock_guard lock(g_mutex);
+                g_buffers.emplace_back(std::make_unique<ThreadBuffer>());
+                buffer = g_buffers.back().get();
+                buffer->tid = static_cast<int>(g_buffers.size());
+            }
+
+            return buffer;
+        }
+
+        std::string escape(const char* s)
+        {
+            std::string out;
+            for (; *s; ++s)
+            {
+                if (*s == '"' || *s == '\\')
+                    out += '\\';
+                out += *s;
+            }
+
+            return out;
+        }
+    }
+
+    void start(const std::string& path)
+    {
+        std::lock_guard lock(g_mutex);
+        if (g_path.empty())
+            g_path = path;
+
+        g_enabled.store(!g_path.empty(), std::memory_order_relaxed);
+    }
+
+    int64_t now_us() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+    }
+
+    void record(const char* name, const int64_t start_us, const int64_t end_us, const int frame) noexcept
+    {
+        ThreadBuffer* buffer{ thread_buffer() };
+
+        std::lock_guard lock(buffer->mutex);
+        buffer->events[buffer->head++ % ThreadBuffer::capacity] = Event{ name, start_us, end_us - start_us, frame };
+    }
+
+    void flush()
+    {
+        g_enabled.store(false, std::memory_order_relaxed);
+
+        std::lock_guard lock(g_mutex);
+        if (g_path.empty())
+            return;
+
+        std::ofstream ofs{ g_path };
+        if (ofs)
+        {
+            ofs << "{\"traceEvents\":[\n";
+            bool first{ true };
+            std::vector<Event> events;
+
+            for (const auto& buffer : g_buffers)
+            {
+                // the events are copied out, the file is written without blocking the thread
+                {
+                    std::lock_guard buffer_lock(buffer->mutex);
+                    const uint64_t begin{ (buffer->head > ThreadBuffer::capacity) ? buffer->head - ThreadBuffer::capacity : 0 };
+
+                    events.clear();
+                    for (uint64_t i{ begin }; i < buffer->head; ++i)
+                        events.emplace_back(buffer->events[i % ThreadBuffer::capacity]);
+
+                    buffer->head = 0;
+                }
+
+                for (const Event& e : events)
+                {
+                    ofs << (first ? "" : ",\n") << "{\"name\":\"" << escape(e.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid <<
+                        ",\"ts\":" << e.start << ",\"dur\":" << e.duration;
+                    if (e.frame >= 0)
+                        ofs << ",\"args\":{\"frame\":" << e.frame << "}";
+                    ofs << "}";
+
+                    first = false;
+                }
+            }
+
+            ofs << "\n]}\n";
+        }
+
+        g_path.clear();
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// Chrome/Perfetto trace of the frame pipeline.
+// Every thread writes complete events to its own ring buffer, the buffers are written to the file by flush().
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace trace
+{
+    extern std::atomic<bool> g_enabled;
+
+    inline bool enabled() noexcept
+    {
+        return g_enabled.load(std::memory_order_relaxed);
+    }
+
+    // enables the recording, the first path wins
+    void start(const std::string& path);
+    // writes the recorded events and disables the recording
+    void flush();
+
+    int64_t now_us() noexcept;
+    void record(const char* name, const int64_t start_us, const int64_t end_us, const int frame) noexcept;
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name, const int frame = -1) noexcept
+            : name(name), frame(frame), start(enabled() ? now_us() : -1)
+        {
+        }
+
+        ~Scope()
+        {
+            if (start >= 0)
+                record(name, start, now_us(), frame);
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name; // must be a literal
+        int frame;
+        int64_t start;
+    };
+}
@@ -2,54 +2,89 @@
 
 #include "rife_ops.h"
 
+#include "fused_warp.comp.hex.h"
+#include "fused_warp_pack4.comp.hex.h"
 #include "warp.comp.hex.h"
+#include "warp_channels.comp.hex.h"
 #include "warp_pack4.comp.hex.h"
+#include "warp_pack8.comp.hex.h"
 
 using namespace ncnn;
 
+// below this many pixels per channel the per channel dispatch has more parallelism than the channel loop
+static constexpr int warp_channels_min_pixels{ 256 * 256 };
+
 Warp::Warp()
 {
     support_vulkan = true;
+    // the image is pack4/pack8, the flow (2 channels) is always pack1
+    support_packing = true;
 
     pipeline_warp = 0;
     pipeline_warp_pack4 = 0;
+    pipeline_warp_pack8 = 0;
+    pipeline_warp_channels = 0;
 }
 
-int Warp::create_pipeline(const Option& opt)
+static Pipeline* create_warp_pipeline(const VulkanDevice* vkdev, const char* comp_data, const int comp_data_size, const Option& opt,
+    std::vector<uint32_t> (&spirv)[2], ncnn::Mutex& lock)
+{
+    std::vector<vk_specialization_type> specializations(0 + 0);
+
+    std::vector<uint32_t>& module{ spirv[opt.use_fp16_arithmetic] };
+    {
+        ncnn::MutexLockGuard guard(lock);
+        if (module.empty())
+            compile_spirv_module(comp_data, comp_data_size, opt, module);
+    }
+
+    Pipeline* pipeline = new Pipeline(vkdev);
+    pipeline->set_optimal_local_size_xyz();
+    pipeline->create(module.data(), module.size() * 4, specializations);
+
+    return pipeline;
+}
+
+int Warp::create_pipeline(const Option& _opt)
 {
     if (!vkdev)
         return 0;
 
-    std::vector<vk_specialization_type> specializations(0 + 0);
+    // only the blending is done in fp16, the sampling coordinates are fp32
+    Option opt = _opt;
+    opt.use_fp16_arithmetic = opt.use_fp16_storage && vkdev->info.support_fp16_arithmetic();
 
     // pack1
     {
-        static std::vector<uint32_t> spirv;
+        static std::vector<uint32_t> spirv[2];
+        static ncnn::Mutex lock;
+
+        pipeline_warp = create_warp_pipeline(vkdev, warp_comp_data, sizeof(warp_comp_data), opt, spirv, lock);
+    }
+
+    // pack1, channel loop
+    {
+        static std::vector<uint32_t> spirv[2];
         static ncnn::Mutex lock;
-        {
-            ncnn::MutexLockGuard guard(lock);
-            if (spirv.empty())
-                compile_spirv_module(warp_comp_data, sizeof(warp_comp_data), opt, spirv);
-        }
-
-        pipeline_warp = new Pipeline(vkdev);
-        pipeline_warp->set_optimal_local_size_xyz();
-        pipeline_warp->create(spirv.data(), spirv.size() * 4, specializations);
+
+        pipeline_warp_channels = create_warp_pipeline(vkdev, warp_channels_comp_data, sizeof(warp_channels_comp_data), opt, spirv, lock);
     }
 
     // pack4
     {
-        static std::vector<uint32_t> spirv;
+        static std::vector<uint32_t> spirv[2];
         static ncnn::Mutex lock;
-        {
-            ncnn::MutexLockGuard guard(lock);
-            if (spirv.empty())
-                compile_spirv_module(warp_pack4_comp_data, sizeof(warp_pack4_comp_data), opt, spirv);
-        }
-
-        pipeline_warp_pack4 = new Pipeline(vkdev);
-        pipeline_warp_pack4->set_optimal_local_size_xyz();
-        pipeline_warp_pack4->create(spirv.data(), spirv.size() * 4, specializations);
+
+        pipeline_warp_pack4 = create_warp_pipeline(vkdev, warp_pack4_comp_data, sizeof(warp_pack4_comp_data), opt, spirv, lock);
+    }
+
+    // pack8
+    if (opt.use_shader_pack8)
+    {
+        static std::vector<uint32_t> spirv[2];
+        static ncnn::Mutex lock;
+
+        pipeline_warp_pack8 = create_warp_pipeline(vkdev, warp_pack8_comp_data, sizeof(warp_pack8_comp_data), opt, spirv, lock);
     }
 
     return 0;
@@ -63,6 +98,12 @@ int Warp::destroy_pipeline(const Option& opt)
     delete pipeline_warp_pack4;
     pipeline_warp_pack4 = 0;
 
+    delete pipeline_warp_pack8;
+    pipeline_warp_pack8 = 0;
+
+    delete pipeline_warp_channels;
+    pipeline_warp_channels = 0;
+
     return 0;
 }
 
@@ -77,6 +118,9 @@ int Warp::forward(const std::vector<VkMat>& bottom_blobs, std::vector<VkMat>& to
     size_t elemsize = image_blob.elemsize;
     int elempack = image_blob.elempack;
 
+    if (flow_blob.elempack != 1)
+        return -100;
+
     VkMat& top_blob = top_blobs[0];
     top_blob.create(w, h, channels, elemsize, elempack, opt.blob_vkallocator);
     if (top_blob.empty())
@@ -87,16 +131,148 @@ int Warp::forward(const std::vector<VkMat>& bottom_blobs, std::vector<VkMat>& to
     bindings[1] = flow_blob;
     bindings[2] = top_blob;
 
-    std::vector<vk_constant_type> constants(4);
+    // the flow is pack1, its cstep is not the one of a packed image
+    std::vector<vk_constant_type> constants(5);
     constants[0].i = top_blob.w;
     constants[1].i = top_blob.h;
     constants[2].i = top_blob.c;
     constants[3].i = top_blob.cstep;
+    constants[4].i = flow_blob.cstep;
 
-    if (elempack == 4)
+    if (elempack == 8)
+        cmd.record_pipeline(pipeline_warp_pack8, bindings, constants, top_blob);
+    else if (elempack == 4)
         cmd.record_pipeline(pipeline_warp_pack4, bindings, constants, top_blob);
+    else if (channels > 1 && w * h >= warp_channels_min_pixels)
+    {
+        VkMat dispatcher;
+        dispatcher.w = w;
+        dispatcher.h = h;
+        dispatcher.c = 1;
+        cmd.record_pipeline(pipeline_warp_channels, bindings, constants, dispatcher);
+    }
     else // if (elempack == 1)
         cmd.record_pipeline(pipeline_warp, bindings, constants, top_blob);
 
     return 0;
 }
+
+FusedWarp::FusedWarp()
+{
+    support_vulkan = true;
+    support_packing = true;
+
+    align_corner = 0;
+    flow_scale = 1.f;
+
+    pipeline_fused_warp = 0;
+    pipeline_fused_warp_pack4 = 0;
+}
+
+int FusedWarp::load_param(const ParamDict& pd)
+{
+    align_corner = pd.get(0, 0);
+    flow_scale = pd.get(1, 1.f);
+
+    return 0;
+}
+
+int FusedWarp::create_pipeline(const Option& _opt)
+{
+    if (!vkdev)
+        return 0;
+
+    Option opt = _opt;
+    opt.use_fp16_arithmetic = opt.use_fp16_storage && vkdev->info.support_fp16_arithmetic();
+
+    // pack1
+    {
+        static std::vector<uint32_t> spirv[2];
+        static ncnn::Mutex lock;
+
+        pipeline_fused_warp = create_warp_pipeline(vkdev, fused_warp_comp_data, sizeof(fused_warp_comp_data), opt, spirv, lock);
+    }
+
+    // pack4, pack8 input is repacked to pack4
+    {
+        static std::vector<uint32_t> spirv[2];
+        static ncnn::Mutex lock;
+
+        pipeline_fused_warp_pack4 = create_warp_pipeline(vkdev, fused_warp_pack4_comp_data, sizeof(fused_warp_pack4_comp_data), opt,
+            spirv, lock);
+    }
+
+    return 0;
+}
+
+int FusedWarp::destroy_pipeline(const Option& opt)
+{
+    delete pipeline_fused_warp;
+    pipeline_fused_warp = 0;
+
+    delete pipeline_fused_warp_pack4;
+    pipeline_fused_warp_pack4 = 0;
+
+    return 0;
+}
+
+int FusedWarp::forward(const std::vector<VkMat>& bottom_blobs, std::vector<VkMat>& top_blobs, VkCompute& cmd, const Option& opt) const
+{
+    VkMat image_blob = bottom_blobs[0];
+    const VkMat& flow_blob = bottom_blobs[1];
+
+    if (flow_blob.elempack != 1 || flow_blob.c != 2)
+        return -100;
+
+    if (image_blob.elempack == 8)
+    {
+        VkMat image_blob_pack4;
+        vkdev->convert_packing(image_blob, image_blob_pack4, 4, cmd, opt);
+        image_blob = image_blob_pack4;
+    }
+
+    int w = image_blob.w;
+    int h = image_blob.h;
+    int channels = image_blob.c;
+    size_t elemsize = image_blob.elemsize;
+    int elempack = image_blob.elempack;
+
+    VkMat& top_blob = top_blobs[0];
+    top_blob.create(w, h, channels, elemsize, elempack, opt.blob_vkallocator);
+    if (top_blob.empty())
+        return -100;
+
+    std::vector<VkMat> bindings(3);
+    bindings[0] = image_blob;
+    bindings[1] = flow_blob;
+    bindings[2] = top_blob;
+
+    // same scale as the coefficients of Interp
+    const double scale_x = (align_corner && w > 1) ? (double)(flow_blob.w - 1) / (w - 1) : (double)flow_blob.w / w;
+    const double scale_y = (align_corner && h > 1) ? (double)(flow_blob.h - 1) / (h - 1) : (double)flow_blob.h / h;
+
+    std::vector<vk_constant_type> constants(11);
+    constants[0].i = top_blob.w;
+    constants[1].i = top_blob.h;
+    constants[2].i = top_blob.c;
+    constants[3].i = top_blob.cstep;
+    constants[4].i = flow_blob.w;
+    constants[5].i = flow_blob.h;
+    constants[6].i = flow_blob.cstep;
+    constants[7].f = (float)scale_x;
+    constants[8].f = (float)scale_y;
+    constants[9].i = align_corner;
+    constants[10].f = flow_scale;
+
+    VkMat dispatcher;
+    dispatcher.w = w;
+    dispatcher.h = h;
+    dispatcher.c = 1;
+
+    if (elempack == 4)
+        cmd.record_pipeline(pipeline_fused_warp_pack4, bindings, constants, dispatcher);
+    else // if (elempack == 1)
+        cmd.record_pipeline(pipeline_fused_warp, bindings, constants, dispatcher);
+
+    return 0;
+}